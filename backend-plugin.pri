@@ -0,0 +1,13 @@
+TEMPLATE = lib
+CONFIG += plugin
+
+INCLUDEPATH += $$PWD
+
+QT = core dbus network
+
+CONFIG += link_pkgconfig
+PKGCONFIG += connman-qt5 qofono-qt5 qofonoext systemsettings
+
+target.path = $$[QT_INSTALL_LIBS]/geoclue-hybris
+
+INSTALLS += target
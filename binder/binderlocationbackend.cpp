@@ -15,6 +15,9 @@
 
 #include "hybrisprovider.h"
 
+#include <QtCore/QSettings>
+#include <QtCore/QThread>
+#include <QtCore/QVector>
 #include <QtNetwork/QHostAddress>
 
 #include <strings.h>
@@ -22,11 +25,6 @@
 
 #define GNSS_BINDER_DEFAULT_DEV  "/dev/hwbinder"
 
-HybrisLocationBackend *getLocationBackend()
-{
-    return qobject_cast<HybrisLocationBackend *>(new BinderLocationBackend());
-}
-
 enum GnssFunctions {
     GNSS_SET_CALLBACK = 1,
     GNSS_START = 2,
@@ -45,7 +43,24 @@ enum GnssFunctions {
     GNSS_GET_EXTENSION_XTRA = 15,
     GNSS_GET_EXTENSION_GNSS_CONFIGURATION = 16,
     GNSS_GET_EXTENSION_GNSS_DEBUG = 17,
-    GNSS_GET_EXTENSION_GNSS_BATCHING = 18
+    GNSS_GET_EXTENSION_GNSS_BATCHING = 18,
+    // @1.1
+    GNSS_SET_CALLBACK_1_1 = 19,
+    GNSS_SET_POSITION_MODE_1_1 = 20,
+    GNSS_GET_EXTENSION_GNSS_CONFIGURATION_1_1 = 21,
+    GNSS_GET_EXTENSION_GNSS_MEASUREMENT_1_1 = 22,
+    GNSS_INJECT_BEST_LOCATION = 23,
+    // @2.0
+    GNSS_SET_CALLBACK_2_0 = 24,
+    GNSS_GET_EXTENSION_GNSS_CONFIGURATION_2_0 = 25,
+    GNSS_GET_EXTENSION_GNSS_DEBUG_2_0 = 26,
+    GNSS_GET_EXTENSION_AGNSS_2_0 = 27,
+    GNSS_GET_EXTENSION_AGNSS_RIL_2_0 = 28,
+    GNSS_GET_EXTENSION_GNSS_MEASUREMENT_2_0 = 29,
+    GNSS_GET_EXTENSION_MEASUREMENT_CORRECTIONS = 30,
+    GNSS_GET_EXTENSION_VISIBILITY_CONTROL = 31,
+    GNSS_GET_EXTENSION_GNSS_BATCHING_2_0 = 32,
+    GNSS_INJECT_BEST_LOCATION_2_0 = 33
 };
 
 enum GnssCallbacks {
@@ -57,9 +72,87 @@ enum GnssCallbacks {
     GNSS_ACQUIRE_WAKELOCK_CB = 6,
     GNSS_RELEASE_WAKELOCK_CB = 7,
     GNSS_REQUEST_TIME_CB = 8,
-    GNSS_SET_SYSTEM_INFO_CB = 9
+    GNSS_SET_SYSTEM_INFO_CB = 9,
+    // @1.1
+    GNSS_NAME_CB = 10,
+    GNSS_REQUEST_LOCATION_CB = 11,
+    // @2.0
+    GNSS_SET_CAPABILITIES_CB_2_0 = 12,
+    GNSS_LOCATION_CB_2_0 = 13,
+    GNSS_REQUEST_LOCATION_CB_2_0 = 14,
+    GNSS_SV_STATUS_CB_2_0 = 15
+};
+
+// IGnss versions, the highest one registered with hwservicemanager is used.
+enum GnssHalVersion {
+    GNSS_HAL_1_0 = 0,
+    GNSS_HAL_1_1 = 1,
+    GNSS_HAL_2_0 = 2
+};
+
+enum GnssBatchingFunctions {
+    GNSS_BATCHING_INIT = 1,
+    GNSS_BATCHING_GET_BATCH_SIZE = 2,
+    GNSS_BATCHING_START = 3,
+    GNSS_BATCHING_FLUSH = 4,
+    GNSS_BATCHING_STOP = 5,
+    GNSS_BATCHING_CLEANUP = 6
+};
+
+enum GnssBatchingCallbacks {
+    GNSS_BATCHING_LOCATION_BATCH_CB = 1
+};
+
+enum GnssMeasurementFunctions {
+    GNSS_MEASUREMENT_SET_CALLBACK = 1,
+    GNSS_MEASUREMENT_CLOSE = 2
+};
+
+enum GnssMeasurementCallbacks {
+    GNSS_MEASUREMENT_GNSS_MEASUREMENT_CB = 1
+};
+
+enum GnssNavigationMessageFunctions {
+    GNSS_NAVIGATION_MESSAGE_SET_CALLBACK = 1,
+    GNSS_NAVIGATION_MESSAGE_CLOSE = 2
+};
+
+enum GnssNavigationMessageCallbacks {
+    GNSS_NAVIGATION_MESSAGE_CB = 1
+};
+
+enum GnssGeofencingFunctions {
+    GNSS_GEOFENCING_SET_CALLBACK = 1,
+    GNSS_GEOFENCING_ADD_GEOFENCE = 2,
+    GNSS_GEOFENCING_PAUSE_GEOFENCE = 3,
+    GNSS_GEOFENCING_RESUME_GEOFENCE = 4,
+    GNSS_GEOFENCING_REMOVE_GEOFENCE = 5
+};
+
+enum GnssGeofenceCallbacks {
+    GNSS_GEOFENCE_TRANSITION_CB = 1,
+    GNSS_GEOFENCE_STATUS_CB = 2,
+    GNSS_GEOFENCE_ADD_CB = 3,
+    GNSS_GEOFENCE_REMOVE_CB = 4,
+    GNSS_GEOFENCE_PAUSE_CB = 5,
+    GNSS_GEOFENCE_RESUME_CB = 6
+};
+
+enum GnssConfigurationFunctions {
+    GNSS_CONFIGURATION_SET_SUPL_ES = 1,
+    GNSS_CONFIGURATION_SET_SUPL_VERSION = 2,
+    GNSS_CONFIGURATION_SET_SUPL_MODE = 3,
+    GNSS_CONFIGURATION_SET_GPS_LOCK = 4,
+    GNSS_CONFIGURATION_SET_LPP_PROFILE = 5,
+    GNSS_CONFIGURATION_SET_GLONASS_POSITIONING_PROTOCOL = 6,
+    GNSS_CONFIGURATION_SET_EMERGENCY_SUPL_PDN = 7,
+    // @1.1
+    GNSS_CONFIGURATION_SET_BLACKLIST = 8
 };
 
+// IBase::interfaceChain, B_PACK_CHARS(0x0f, 'C', 'H', 'N')
+const guint32 HIDL_INTERFACE_CHAIN_TRANSACTION = 0x0f43484e;
+
 enum GnssDebudFunctions {
     GNSS_DEBUG_GET_DEBUG_DATA = 1
 };
@@ -108,6 +201,35 @@ enum AGnssRilCallbacks {
     AGNSS_RIL_REQUEST_REF_LOC_CB = 2
 };
 
+// Queued commands of the same group replace each other while still pending.
+enum BinderCommandGroup {
+    COMMAND_GROUP_NONE = 0,
+    COMMAND_GROUP_RUN_STATE = 1,
+    COMMAND_GROUP_POSITION_MODE = 2,
+    COMMAND_GROUP_INJECT_TIME = 3,
+    COMMAND_GROUP_INJECT_LOCATION = 4,
+    COMMAND_GROUP_XTRA_DATA = 5,
+    COMMAND_GROUP_AGNSS_DATA_CONN = 6,
+    COMMAND_GROUP_AGNSS_SERVER = 7,
+    COMMAND_GROUP_DEBUG_DATA = 8,
+    COMMAND_GROUP_AGNSS_RIL_REF_LOCATION = 9,
+    COMMAND_GROUP_AGNSS_RIL_SET_ID = 10,
+    COMMAND_GROUP_AGNSS_RIL_NETWORK_STATE = 11,
+    COMMAND_GROUP_AGNSS_RIL_NETWORK_AVAILABILITY = 12
+};
+
+// Extensions initialised by the provider, initialised again after a HAL restart.
+enum BinderExtension {
+    EXTENSION_AGNSS = 0x01,
+    EXTENSION_GNSS_NI = 0x02,
+    EXTENSION_AGNSS_RIL = 0x04,
+    EXTENSION_GNSS_XTRA = 0x08,
+    EXTENSION_GNSS_DEBUG = 0x10,
+    EXTENSION_GNSS_BATCHING = 0x20,
+    EXTENSION_GNSS_GEOFENCING = 0x40,
+    EXTENSION_GNSS_CONFIGURATION = 0x80
+};
+
 enum HybrisApnIpTypeEnum {
     HYBRIS_APN_IP_INVALID  = 0,
     HYBRIS_APN_IP_IPV4     = 1,
@@ -118,6 +240,21 @@ enum HybrisApnIpTypeEnum {
 #define GNSS_IFACE(x)       "android.hardware.gnss@1.0::" x
 #define GNSS_REMOTE         GNSS_IFACE("IGnss")
 #define GNSS_CALLBACK       GNSS_IFACE("IGnssCallback")
+#define GNSS_1_1_REMOTE     "android.hardware.gnss@1.1::IGnss"
+#define GNSS_1_1_CALLBACK   "android.hardware.gnss@1.1::IGnssCallback"
+#define GNSS_2_0_REMOTE     "android.hardware.gnss@2.0::IGnss"
+#define GNSS_2_0_CALLBACK   "android.hardware.gnss@2.0::IGnssCallback"
+#define GNSS_BATCHING_REMOTE    GNSS_IFACE("IGnssBatching")
+#define GNSS_BATCHING_CALLBACK  GNSS_IFACE("IGnssBatchingCallback")
+#define GNSS_MEASUREMENT_REMOTE     GNSS_IFACE("IGnssMeasurement")
+#define GNSS_MEASUREMENT_CALLBACK   GNSS_IFACE("IGnssMeasurementCallback")
+#define GNSS_NAVIGATION_MESSAGE_REMOTE      GNSS_IFACE("IGnssNavigationMessage")
+#define GNSS_NAVIGATION_MESSAGE_CALLBACK    GNSS_IFACE("IGnssNavigationMessageCallback")
+#define GNSS_GEOFENCING_REMOTE      GNSS_IFACE("IGnssGeofencing")
+#define GNSS_GEOFENCE_CALLBACK      GNSS_IFACE("IGnssGeofenceCallback")
+#define GNSS_CONFIGURATION_REMOTE       GNSS_IFACE("IGnssConfiguration")
+#define GNSS_CONFIGURATION_1_1_REMOTE   "android.hardware.gnss@1.1::IGnssConfiguration"
+#define HIDL_BASE_REMOTE    "android.hidl.base@1.0::IBase"
 #define GNSS_DEBUG_REMOTE   GNSS_IFACE("IGnssDebug")
 #define GNSS_NI_REMOTE      GNSS_IFACE("IGnssNi")
 #define GNSS_NI_CALLBACK    GNSS_IFACE("IGnssNiCallback")
@@ -136,6 +273,59 @@ enum HybrisApnIpTypeEnum {
 namespace
 {
 
+// Shared with the provider, [binder] direct_dispatch enables dispatchDirectly().
+const QString BinderConfigFile = QStringLiteral("/etc/gps_xtra.ini");
+
+bool directDispatch = false;
+
+/*
+    libgbinder reads transactions on its looper thread and runs the callbacks from the glib
+    main context, which is the thread of the provider. In direct dispatch mode the callbacks
+    invoke the provider synchronously instead of queueing another event, and fixes are
+    drained from the event queue before its notifier fires.
+*/
+bool dispatchDirectly()
+{
+    return directDispatch && QThread::currentThread() == staticProvider->thread();
+}
+
+Qt::ConnectionType callbackConnection()
+{
+    return dispatchDirectly() ? Qt::DirectConnection : Qt::QueuedConnection;
+}
+
+void dispatchGnssEvents()
+{
+    if (dispatchDirectly())
+        QMetaObject::invokeMethod(staticProvider, "processGnssEvents", Qt::DirectConnection);
+}
+
+// Indexed by GnssHalVersion, each version adds the transactions up to its last code.
+const GBinderClientIfaceInfo GnssIfaces[] = {
+    { GNSS_REMOTE, GNSS_GET_EXTENSION_GNSS_BATCHING },
+    { GNSS_1_1_REMOTE, GNSS_INJECT_BEST_LOCATION },
+    { GNSS_2_0_REMOTE, GNSS_INJECT_BEST_LOCATION_2_0 }
+};
+
+const guint32 GnssSetCallback[] = {
+    GNSS_SET_CALLBACK, GNSS_SET_CALLBACK_1_1, GNSS_SET_CALLBACK_2_0
+};
+
+// Most derived first, the callback of version v implements the last v + 1 entries.
+const char *const GnssCallbackIfaces[] = {
+    GNSS_2_0_CALLBACK, GNSS_1_1_CALLBACK, GNSS_CALLBACK, Q_NULLPTR
+};
+
+// Callbacks are sent with the descriptor of the version that defines them.
+bool isGnssCallbackInterface(const char *iface)
+{
+    for (int i = 0; GnssCallbackIfaces[i]; ++i) {
+        if (!g_strcmp0(iface, GnssCallbackIfaces[i]))
+            return true;
+    }
+    return false;
+}
+
 HybrisApnIpType fromContextProtocol(const QString &protocol)
 {
     if (protocol == QLatin1String("ip"))
@@ -148,22 +338,155 @@ HybrisApnIpType fromContextProtocol(const QString &protocol)
         return HYBRIS_APN_IP_INVALID;
 }
 
-const void *geoclue_binder_gnss_decode_struct1(
-    GBinderReader *in,
-    guint size)
+/*
+ * Holds a buffer object read from a transaction for the lifetime of the decoding scope,
+ * so the returned struct pointer stays valid until the holder goes out of scope.
+ */
+template <typename T>
+class BinderStruct
 {
-    const void *result = Q_NULLPTR;
-    GBinderBuffer *buf = gbinder_reader_read_buffer(in);
+public:
+    explicit BinderStruct(GBinderReader *reader)
+        : m_buffer(gbinder_reader_read_buffer(reader))
+    {
+    }
+
+    ~BinderStruct()
+    {
+        gbinder_buffer_free(m_buffer);
+    }
+
+    const T *data() const
+    {
+        if (m_buffer && m_buffer->size == sizeof(T))
+            return static_cast<const T *>(m_buffer->data);
+        return Q_NULLPTR;
+    }
+
+private:
+    Q_DISABLE_COPY(BinderStruct)
+
+    GBinderBuffer *m_buffer;
+};
+
+const double MpsToKnots = 1.943844;
 
-    if (buf && buf->size == size) {
-        result = buf->data;
+void decodeGnssLocation(const GnssLocation *location, GnssFix *fix)
+{
+    fix->timestamp = location->timestamp;
+    fix->latitude = qQNaN();
+    fix->longitude = qQNaN();
+    fix->altitude = qQNaN();
+    fix->speed = qQNaN();
+    fix->direction = qQNaN();
+    fix->climb = qQNaN();
+    fix->horizontalAccuracy = qQNaN();
+    fix->verticalAccuracy = qQNaN();
+    fix->elapsedRealtimeNs = 0;
+
+    if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_LAT_LONG) {
+        fix->latitude = location->latitudeDegrees;
+        fix->longitude = location->longitudeDegrees;
     }
-    gbinder_buffer_free(buf);
-    return result;
+
+    if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_ALTITUDE)
+        fix->altitude = location->altitudeMeters;
+
+    if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_SPEED)
+        fix->speed = location->speedMetersPerSec * MpsToKnots;
+
+    if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_BEARING)
+        fix->direction = location->bearingDegrees;
+
+    if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_HORIZONTAL_ACCURACY)
+        fix->horizontalAccuracy = location->horizontalAccuracyMeters;
+
+    if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_VERTICAL_ACCURACY)
+        fix->verticalAccuracy = location->verticalAccuracyMeters;
+}
+
+void decodeGnssLocation_2_0(const GnssLocation_2_0 *location, GnssFix *fix)
+{
+    decodeGnssLocation(&location->v1_0, fix);
+
+    if (location->elapsedRealtime.flags & HYBRIS_ELAPSED_REALTIME_HAS_TIMESTAMP_NS)
+        fix->elapsedRealtimeNs = location->elapsedRealtime.timestampNs;
+}
+
+void decodeGnssSvInfo(const GnssSvInfo &svInfo, GnssConstellationType constellation,
+                      GnssSatelliteEpoch *epoch)
+{
+    GnssSatellite &satellite = epoch->satellites[epoch->satelliteCount++];
+    satellite.snr = svInfo.cN0Dbhz;
+    satellite.elevation = svInfo.elevationDegrees;
+    satellite.azimuth = svInfo.azimuthDegrees;
+    satellite.prn = hybrisGnssSvidToPrn(static_cast<HybrisGnssConstellationType>(constellation),
+                                        svInfo.svid);
+
+    if (svInfo.svFlag & HYBRIS_GNSS_SV_FLAGS_USED_IN_FIX)
+        epoch->usedPrns[epoch->usedCount++] = satellite.prn;
+}
+
+void decodeGnssSvStatus(const GnssSvStatus *svStatus, GnssSatelliteEpoch *epoch)
+{
+    epoch->satelliteCount = 0;
+    epoch->usedCount = 0;
+
+    for (int i = 0; i < svStatus->numSvs && i < GnssMaxSatellites; ++i)
+        decodeGnssSvInfo(svStatus->gnssSvList[i], svStatus->gnssSvList[i].constellation, epoch);
 }
 
-#define geoclue_binder_gnss_decode_struct(type,in) \
-    ((const type*)geoclue_binder_gnss_decode_struct1(in, sizeof(type)))
+// @2.0 reports a vector, with the constellation moved out of the 1.0 struct.
+void decodeGnssSvInfoList(const GnssSvInfo_2_0 *svInfoList, gsize count, GnssSatelliteEpoch *epoch)
+{
+    epoch->satelliteCount = 0;
+    epoch->usedCount = 0;
+
+    for (gsize i = 0; i < count && i < GnssMaxSatellites; ++i)
+        decodeGnssSvInfo(svInfoList[i].v1_0, svInfoList[i].constellation, epoch);
+}
+
+void decodeGnssData(const GnssData *data, GnssMeasurementEpoch *epoch)
+{
+    const GnssClock &clock = data->clock;
+    epoch->timeNs = clock.timeNs;
+    epoch->fullBiasNs = clock.fullBiasNs;
+    epoch->timeUncertaintyNs = clock.timeUncertaintyNs;
+    epoch->biasNs = clock.biasNs;
+    epoch->biasUncertaintyNs = clock.biasUncertaintyNs;
+    epoch->driftNsps = clock.driftNsps;
+    epoch->driftUncertaintyNsps = clock.driftUncertaintyNsps;
+    epoch->hwClockDiscontinuityCount = clock.hwClockDiscontinuityCount;
+    epoch->clockFlags = clock.gnssClockFlags;
+    epoch->leapSecond = clock.leapSecond;
+
+    const quint32 count = qMin<quint32>(data->measurementCount, GnssMaxMeasurements);
+    epoch->measurementCount = count;
+
+    for (quint32 i = 0; i < count; ++i) {
+        const GnssMeasurement &measurement = data->measurements[i];
+        epoch->receivedSvTimeNs[i] = measurement.receivedSvTimeInNs;
+        epoch->receivedSvTimeUncertaintyNs[i] = measurement.receivedSvTimeUncertaintyInNs;
+        epoch->carrierCycles[i] = measurement.carrierCycles;
+        epoch->timeOffsetNs[i] = measurement.timeOffsetNs;
+        epoch->cN0DbHz[i] = measurement.cN0DbHz;
+        epoch->pseudorangeRateMps[i] = measurement.pseudorangeRateMps;
+        epoch->pseudorangeRateUncertaintyMps[i] = measurement.pseudorangeRateUncertaintyMps;
+        epoch->accumulatedDeltaRangeM[i] = measurement.accumulatedDeltaRangeM;
+        epoch->accumulatedDeltaRangeUncertaintyM[i] = measurement.accumulatedDeltaRangeUncertaintyM;
+        epoch->carrierPhase[i] = measurement.carrierPhase;
+        epoch->carrierPhaseUncertainty[i] = measurement.carrierPhaseUncertainty;
+        epoch->snrDb[i] = measurement.snrDb;
+        epoch->agcLevelDb[i] = measurement.agcLevelDb;
+        epoch->carrierFrequencyHz[i] = measurement.carrierFrequencyHz;
+        epoch->flags[i] = measurement.flags;
+        epoch->state[i] = measurement.state;
+        epoch->svid[i] = measurement.svid;
+        epoch->accumulatedDeltaRangeState[i] = measurement.accumulatedDeltaRangeState;
+        epoch->constellation[i] = static_cast<quint8>(measurement.constellation);
+        epoch->multipathIndicator[i] = measurement.multipathIndicator;
+    }
+}
 
 bool nmeaChecksumValid(const QByteArray &nmea)
 {
@@ -196,7 +519,7 @@ void parseRmc(const QByteArray &nmea)
         if (fields.at(11) == "W")
             variation = -variation;
 
-        QMetaObject::invokeMethod(staticProvider, "setMagneticVariation", Qt::QueuedConnection,
+        QMetaObject::invokeMethod(staticProvider, "setMagneticVariation", callbackConnection(),
                                   Q_ARG(double, variation));
     }
 }
@@ -224,8 +547,6 @@ void processNmea(gint64 timestamp, const char *nmeaData)
         parseRmc(nmea);
 }
 
-const double MpsToKnots = 1.943844;
-
 GBinderLocalReply *geoclue_binder_gnss_callback(
     GBinderLocalObject *obj,
     GBinderRemoteRequest *req,
@@ -238,48 +559,33 @@ GBinderLocalReply *geoclue_binder_gnss_callback(
     Q_UNUSED(user_data)
     const char *iface = gbinder_remote_request_interface(req);
 
-    if (!g_strcmp0(iface, GNSS_CALLBACK)) {
+    if (isGnssCallbackInterface(iface)) {
         GBinderReader reader;
 
         gbinder_remote_request_init_reader(req, &reader);
         switch (code) {
         case GNSS_LOCATION_CB:
             {
-            Location loc;
-
-            const GnssLocation *location = geoclue_binder_gnss_decode_struct
-                (GnssLocation, &reader);
-
-            loc.setTimestamp(location->timestamp);
-
-            if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_LAT_LONG) {
-                loc.setLatitude(location->latitudeDegrees);
-                loc.setLongitude(location->longitudeDegrees);
-            }
-
-            if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_ALTITUDE)
-                loc.setAltitude(location->altitudeMeters);
-
-            if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_SPEED)
-                loc.setSpeed(location->speedMetersPerSec * MpsToKnots);
-
-            if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_BEARING)
-                loc.setDirection(location->bearingDegrees);
-
-            if ((location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_HORIZONTAL_ACCURACY) ||
-                (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_VERTICAL_ACCURACY)) {
-                Accuracy accuracy;
-                if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_HORIZONTAL_ACCURACY) {
-                    accuracy.setHorizontal(location->horizontalAccuracyMeters);
-                }
-                if (location->gnssLocationFlags & HYBRIS_GNSS_LOCATION_HAS_VERTICAL_ACCURACY) {
-                    accuracy.setVertical(location->verticalAccuracyMeters);
-                }
-                loc.setAccuracy(accuracy);
+            BinderStruct<GnssLocation> location(&reader);
+            if (!location.data())
+                break;
+
+            GnssEventQueue *events = staticProvider->gnssEvents();
+            decodeGnssLocation(location.data(), events->beginFix());
+            events->commitFix();
+            dispatchGnssEvents();
             }
-
-            QMetaObject::invokeMethod(staticProvider, "setLocation", Qt::QueuedConnection,
-                                      Q_ARG(Location, loc));
+            break;
+        case GNSS_LOCATION_CB_2_0:
+            {
+            BinderStruct<GnssLocation_2_0> location(&reader);
+            if (!location.data())
+                break;
+
+            GnssEventQueue *events = staticProvider->gnssEvents();
+            decodeGnssLocation_2_0(location.data(), events->beginFix());
+            events->commitFix();
+            dispatchGnssEvents();
             }
             break;
         case GNSS_STATUS_CB:
@@ -287,50 +593,38 @@ GBinderLocalReply *geoclue_binder_gnss_callback(
             guint32 stat;
             if (gbinder_reader_read_uint32(&reader, &stat)) {
                 if (stat == HYBRIS_GNSS_STATUS_ENGINE_ON) {
-                    QMetaObject::invokeMethod(staticProvider, "engineOn", Qt::QueuedConnection);
+                    QMetaObject::invokeMethod(staticProvider, "engineOn", callbackConnection());
                 }
                 if (stat == HYBRIS_GNSS_STATUS_ENGINE_OFF) {
-                    QMetaObject::invokeMethod(staticProvider, "engineOff", Qt::QueuedConnection);
+                    QMetaObject::invokeMethod(staticProvider, "engineOff", callbackConnection());
                 }
             }
             }
             break;
         case GNSS_SV_STATUS_CB:
             {
-            const GnssSvStatus *svStatus = geoclue_binder_gnss_decode_struct
-                (GnssSvStatus, &reader);
-
-            QList<SatelliteInfo> satellites;
-            QList<int> usedPrns;
-
-            for (int i = 0; i < svStatus->numSvs; ++i) {
-                SatelliteInfo satInfo;
-                GnssSvInfo svInfo = svStatus->gnssSvList[i];
-                satInfo.setSnr(svInfo.cN0Dbhz);
-                satInfo.setElevation(svInfo.elevationDegrees);
-                satInfo.setAzimuth(svInfo.azimuthDegrees);
-                int prn = svInfo.svid;
-                // From https://github.com/barbeau/gpstest
-                // and https://github.com/mvglasow/satstat/wiki/NMEA-IDs
-                if (svInfo.constellation == GnssConstellationType::SBAS) {
-                    prn -= 87;
-                } else if (svInfo.constellation == GnssConstellationType::GLONASS) {
-                    prn += 64;
-                } else if (svInfo.constellation == GnssConstellationType::BEIDOU) {
-                    prn += 200;
-                } else if (svInfo.constellation == GnssConstellationType::GALILEO) {
-                    prn += 300;
-                }
-                satInfo.setPrn(prn);
-                satellites.append(satInfo);
-
-                if (svInfo.svFlag & HYBRIS_GNSS_SV_FLAGS_USED_IN_FIX)
-                    usedPrns.append(prn);
+            BinderStruct<GnssSvStatus> svStatus(&reader);
+            if (!svStatus.data())
+                break;
+
+            GnssEventQueue *events = staticProvider->gnssEvents();
+            decodeGnssSvStatus(svStatus.data(), events->beginSatelliteEpoch());
+            events->commitSatelliteEpoch();
+            dispatchGnssEvents();
             }
-
-            QMetaObject::invokeMethod(staticProvider, "setSatellite", Qt::QueuedConnection,
-                                      Q_ARG(QList<SatelliteInfo>, satellites),
-                                      Q_ARG(QList<int>, usedPrns));
+            break;
+        case GNSS_SV_STATUS_CB_2_0:
+            {
+            gsize count = 0;
+            const GnssSvInfo_2_0 *svInfoList = static_cast<const GnssSvInfo_2_0 *>(
+                gbinder_reader_read_hidl_struct_vec(&reader, &count, sizeof(GnssSvInfo_2_0)));
+            if (!svInfoList && count)
+                break;
+
+            GnssEventQueue *events = staticProvider->gnssEvents();
+            decodeGnssSvInfoList(svInfoList, count, events->beginSatelliteEpoch());
+            events->commitSatelliteEpoch();
+            dispatchGnssEvents();
             }
             break;
         case GNSS_NMEA_CB:
@@ -346,23 +640,42 @@ GBinderLocalReply *geoclue_binder_gnss_callback(
             }
             break;
         case GNSS_SET_CAPABILITIES_CB:
+        case GNSS_SET_CAPABILITIES_CB_2_0:
             {
             guint32 capabilities;
             if (gbinder_reader_read_uint32(&reader, &capabilities)) {
                 qCDebug(lcGeoclueHybris) << "capabilities" << showbase << hex << capabilities;
+                QMetaObject::invokeMethod(staticProvider, "gnssCapabilities", callbackConnection(),
+                                          Q_ARG(quint32, capabilities),
+                                          Q_ARG(bool, code == GNSS_SET_CAPABILITIES_CB_2_0));
             }
             }
             break;
         case GNSS_ACQUIRE_WAKELOCK_CB:
+            staticProvider->gnssWakelock()->acquire();
+            break;
         case GNSS_RELEASE_WAKELOCK_CB:
+            QMetaObject::invokeMethod(staticProvider, "gnssReleaseWakelock", callbackConnection(),
+                                      Q_ARG(quint32, staticProvider->gnssWakelock()->generation()));
             break;
         case GNSS_REQUEST_TIME_CB:
             qCDebug(lcGeoclueHybris) << "GNSS request UTC time";
-            QMetaObject::invokeMethod(staticProvider, "injectUtcTime", Qt::QueuedConnection);
+            QMetaObject::invokeMethod(staticProvider, "injectUtcTime", callbackConnection());
             break;
         case GNSS_SET_SYSTEM_INFO_CB:
             qCDebug(lcGeoclueHybris) << "GNSS set system info";
             break;
+        case GNSS_NAME_CB:
+            {
+            char *name = gbinder_reader_read_hidl_string(&reader);
+            qCDebug(lcGeoclueHybris) << "GNSS name" << name;
+            g_free(name);
+            }
+            break;
+        case GNSS_REQUEST_LOCATION_CB:
+        case GNSS_REQUEST_LOCATION_CB_2_0:
+            qCDebug(lcGeoclueHybris) << "GNSS request location";
+            break;
         default:
             qWarning("Failed to decode callback %u", code);
             break;
@@ -376,7 +689,7 @@ GBinderLocalReply *geoclue_binder_gnss_callback(
     return Q_NULLPTR;
 }
 
-GBinderLocalReply *geoclue_binder_gnss_xtra_callback(
+GBinderLocalReply *geoclue_binder_gnss_batching_callback(
     GBinderLocalObject *obj,
     GBinderRemoteRequest *req,
     guint code,
@@ -388,13 +701,26 @@ GBinderLocalReply *geoclue_binder_gnss_xtra_callback(
     Q_UNUSED(user_data)
     const char *iface = gbinder_remote_request_interface(req);
 
-    if (!g_strcmp0(iface, GNSS_XTRA_CALLBACK)) {
+    if (!g_strcmp0(iface, GNSS_BATCHING_CALLBACK)) {
         GBinderReader reader;
 
         gbinder_remote_request_init_reader(req, &reader);
         switch (code) {
-        case GNSS_XTRA_DOWNLOAD_REQUEST_CB:
-            QMetaObject::invokeMethod(staticProvider, "xtraDownloadRequest", Qt::QueuedConnection);
+        case GNSS_BATCHING_LOCATION_BATCH_CB:
+            {
+            gsize count = 0;
+            const GnssLocation *locations = static_cast<const GnssLocation *>(
+                gbinder_reader_read_hidl_struct_vec(&reader, &count, sizeof(GnssLocation)));
+            if (!locations)
+                break;
+
+            QVector<GnssFix> fixes(count);
+            for (gsize i = 0; i < count; ++i)
+                decodeGnssLocation(&locations[i], &fixes[i]);
+
+            QMetaObject::invokeMethod(staticProvider, "gnssLocationBatch", callbackConnection(),
+                                      Q_ARG(QVector<GnssFix>, fixes));
+            }
             break;
         default:
             qWarning("Failed to decode callback %u", code);
@@ -409,7 +735,7 @@ GBinderLocalReply *geoclue_binder_gnss_xtra_callback(
     return Q_NULLPTR;
 }
 
-GBinderLocalReply *geoclue_binder_agnss_callback(
+GBinderLocalReply *geoclue_binder_gnss_measurement_callback(
     GBinderLocalObject *obj,
     GBinderRemoteRequest *req,
     guint code,
@@ -421,45 +747,73 @@ GBinderLocalReply *geoclue_binder_agnss_callback(
     Q_UNUSED(user_data)
     const char *iface = gbinder_remote_request_interface(req);
 
-    if (!g_strcmp0(iface, AGNSS_CALLBACK)) {
+    if (!g_strcmp0(iface, GNSS_MEASUREMENT_CALLBACK)) {
         GBinderReader reader;
 
         gbinder_remote_request_init_reader(req, &reader);
         switch (code) {
-        case AGNSS_STATUS_IP_V4_CB:
+        case GNSS_MEASUREMENT_GNSS_MEASUREMENT_CB:
             {
-            QHostAddress ipv4;
-            QHostAddress ipv6;
-            QByteArray ssid;
-            QByteArray password;
+            BinderStruct<GnssData> data(&reader);
+            if (!data.data())
+                break;
 
-            const AGnssStatusIpV4 *status = geoclue_binder_gnss_decode_struct
-                (AGnssStatusIpV4, &reader);
+            GnssMeasurementChannel *channel = staticProvider->gnssMeasurements();
+            GnssMeasurementEpoch *epoch = channel->beginEpoch();
+            if (!epoch)
+                break;
 
-            ipv4.setAddress(status->ipV4Addr);
-
-            QMetaObject::invokeMethod(staticProvider, "agpsStatus", Qt::QueuedConnection,
-                                      Q_ARG(qint16, status->type), Q_ARG(quint16, status->status),
-                                      Q_ARG(QHostAddress, ipv4), Q_ARG(QHostAddress, ipv6),
-                                      Q_ARG(QByteArray, ssid), Q_ARG(QByteArray, password));
+            decodeGnssData(data.data(), epoch);
+            channel->commitEpoch();
             }
             break;
-        case AGNSS_STATUS_IP_V6_CB:
-            {
-            QHostAddress ipv4;
-            QHostAddress ipv6;
-            QByteArray ssid;
-            QByteArray password;
+        default:
+            qWarning("Failed to decode callback %u", code);
+            break;
+        }
+        *status = GBINDER_STATUS_OK;
+        return gbinder_local_reply_append_int32(gbinder_local_object_new_reply(obj), 0);
+    } else {
+        qWarning("Unknown interface %s and code %u", iface, code);
+        *status = GBINDER_STATUS_FAILED;
+    }
+    return Q_NULLPTR;
+}
 
-            const AGnssStatusIpV6 *status = geoclue_binder_gnss_decode_struct
-                (AGnssStatusIpV6, &reader);
+GBinderLocalReply *geoclue_binder_gnss_navigation_message_callback(
+    GBinderLocalObject *obj,
+    GBinderRemoteRequest *req,
+    guint code,
+    guint flags,
+    int *status,
+    void *user_data)
+{
+    Q_UNUSED(flags)
+    Q_UNUSED(user_data)
+    const char *iface = gbinder_remote_request_interface(req);
 
-            ipv6.setAddress(status->ipV6Addr);
+    if (!g_strcmp0(iface, GNSS_NAVIGATION_MESSAGE_CALLBACK)) {
+        GBinderReader reader;
 
-            QMetaObject::invokeMethod(staticProvider, "agpsStatus", Qt::QueuedConnection,
-                                      Q_ARG(qint16, status->type), Q_ARG(quint16, status->status),
-                                      Q_ARG(QHostAddress, ipv4), Q_ARG(QHostAddress, ipv6),
-                                      Q_ARG(QByteArray, ssid), Q_ARG(QByteArray, password));
+        gbinder_remote_request_init_reader(req, &reader);
+        switch (code) {
+        case GNSS_NAVIGATION_MESSAGE_CB:
+            {
+            BinderStruct<GnssNavigationMessage> message(&reader);
+            if (!message.data() || !message.data()->data.count)
+                break;
+
+            // The message data follows as a separate buffer.
+            GBinderBuffer *data = gbinder_reader_read_buffer(&reader);
+            if (data && data->size == message.data()->data.count) {
+                QMetaObject::invokeMethod(staticProvider, "gnssNavigationMessage", callbackConnection(),
+                                          Q_ARG(int, message.data()->type),
+                                          Q_ARG(int, message.data()->svid),
+                                          Q_ARG(int, message.data()->status),
+                                          Q_ARG(QByteArray, QByteArray(static_cast<const char *>(data->data),
+                                                                       data->size)));
+            }
+            gbinder_buffer_free(data);
             }
             break;
         default:
@@ -475,8 +829,20 @@ GBinderLocalReply *geoclue_binder_agnss_callback(
     return Q_NULLPTR;
 }
 
+void geofenceOperationFinished(GBinderReader *reader, int operation)
+{
+    gint32 geofenceId;
+    gint32 status;
+
+    if (gbinder_reader_read_int32(reader, &geofenceId) &&
+            gbinder_reader_read_int32(reader, &status)) {
+        QMetaObject::invokeMethod(staticProvider, "gnssGeofenceOperationFinished",
+                                  callbackConnection(), Q_ARG(int, operation),
+                                  Q_ARG(int, geofenceId), Q_ARG(int, status));
+    }
+}
 
-GBinderLocalReply *geoclue_binder_agnss_ril_callback(
+GBinderLocalReply *geoclue_binder_gnss_geofence_callback(
     GBinderLocalObject *obj,
     GBinderRemoteRequest *req,
     guint code,
@@ -488,16 +854,54 @@ GBinderLocalReply *geoclue_binder_agnss_ril_callback(
     Q_UNUSED(user_data)
     const char *iface = gbinder_remote_request_interface(req);
 
-    if (!g_strcmp0(iface, AGNSS_RIL_CALLBACK)) {
+    if (!g_strcmp0(iface, GNSS_GEOFENCE_CALLBACK)) {
         GBinderReader reader;
 
         gbinder_remote_request_init_reader(req, &reader);
         switch (code) {
-        case AGNSS_RIL_REQUEST_REF_ID_CB:
-            qCDebug(lcGeoclueHybris) << "AGNSS RIL request ref ID";
+        case GNSS_GEOFENCE_TRANSITION_CB:
+            {
+            gint32 geofenceId;
+            gint32 transition;
+            gint64 timestamp;
+
+            if (!gbinder_reader_read_int32(&reader, &geofenceId))
+                break;
+
+            BinderStruct<GnssLocation> location(&reader);
+            if (!location.data() || !gbinder_reader_read_int32(&reader, &transition) ||
+                    !gbinder_reader_read_int64(&reader, &timestamp)) {
+                break;
+            }
+
+            GnssFix fix;
+            decodeGnssLocation(location.data(), &fix);
+
+            QMetaObject::invokeMethod(staticProvider, "gnssGeofenceTransition", callbackConnection(),
+                                      Q_ARG(int, geofenceId), Q_ARG(GnssFix, fix),
+                                      Q_ARG(int, transition), Q_ARG(qint64, timestamp));
+            }
             break;
-        case AGNSS_RIL_REQUEST_REF_LOC_CB:
-            qCDebug(lcGeoclueHybris) << "AGNSS RIL request ref location";
+        case GNSS_GEOFENCE_STATUS_CB:
+            {
+            gint32 availability;
+            if (gbinder_reader_read_int32(&reader, &availability)) {
+                QMetaObject::invokeMethod(staticProvider, "gnssGeofenceStatus", callbackConnection(),
+                                          Q_ARG(int, availability));
+            }
+            }
+            break;
+        case GNSS_GEOFENCE_ADD_CB:
+            geofenceOperationFinished(&reader, HYBRIS_GNSS_GEOFENCE_OPERATION_ADD);
+            break;
+        case GNSS_GEOFENCE_REMOVE_CB:
+            geofenceOperationFinished(&reader, HYBRIS_GNSS_GEOFENCE_OPERATION_REMOVE);
+            break;
+        case GNSS_GEOFENCE_PAUSE_CB:
+            geofenceOperationFinished(&reader, HYBRIS_GNSS_GEOFENCE_OPERATION_PAUSE);
+            break;
+        case GNSS_GEOFENCE_RESUME_CB:
+            geofenceOperationFinished(&reader, HYBRIS_GNSS_GEOFENCE_OPERATION_RESUME);
             break;
         default:
             qWarning("Failed to decode callback %u", code);
@@ -512,8 +916,7 @@ GBinderLocalReply *geoclue_binder_agnss_ril_callback(
     return Q_NULLPTR;
 }
 
-
-GBinderLocalReply *geoclue_binder_gnss_ni_callback(
+GBinderLocalReply *geoclue_binder_gnss_xtra_callback(
     GBinderLocalObject *obj,
     GBinderRemoteRequest *req,
     guint code,
@@ -525,13 +928,13 @@ GBinderLocalReply *geoclue_binder_gnss_ni_callback(
     Q_UNUSED(user_data)
     const char *iface = gbinder_remote_request_interface(req);
 
-    if (!g_strcmp0(iface, GNSS_NI_CALLBACK)) {
+    if (!g_strcmp0(iface, GNSS_XTRA_CALLBACK)) {
         GBinderReader reader;
 
         gbinder_remote_request_init_reader(req, &reader);
         switch (code) {
-        case GNSS_NI_NOTIFY_CB:
-            qCDebug(lcGeoclueHybris) << "GNSS NI notify";
+        case GNSS_XTRA_DOWNLOAD_REQUEST_CB:
+            QMetaObject::invokeMethod(staticProvider, "xtraDownloadRequest", callbackConnection());
             break;
         default:
             qWarning("Failed to decode callback %u", code);
@@ -546,53 +949,408 @@ GBinderLocalReply *geoclue_binder_gnss_ni_callback(
     return Q_NULLPTR;
 }
 
-void geoclue_binder_gnss_gnss_died(
-    GBinderRemoteObject */*obj*/,
+GBinderLocalReply *geoclue_binder_agnss_callback(
+    GBinderLocalObject *obj,
+    GBinderRemoteRequest *req,
+    guint code,
+    guint flags,
+    int *status,
     void *user_data)
 {
-    BinderLocationBackend *self = (BinderLocationBackend *)user_data;
-    self->dropGnss();
-}
+    Q_UNUSED(flags)
+    Q_UNUSED(user_data)
+    const char *iface = gbinder_remote_request_interface(req);
 
-}
+    if (!g_strcmp0(iface, AGNSS_CALLBACK)) {
+        GBinderReader reader;
 
-/*==========================================================================*
- * Backend class
- *==========================================================================*/
+        gbinder_remote_request_init_reader(req, &reader);
+        switch (code) {
+        case AGNSS_STATUS_IP_V4_CB:
+            {
+            QHostAddress ipv4;
+            QHostAddress ipv6;
+            QByteArray ssid;
+            QByteArray password;
 
-BinderLocationBackend::BinderLocationBackend(QObject *parent)
-:   HybrisLocationBackend(parent), m_death_id(0), m_fqname(Q_NULLPTR), m_sm(Q_NULLPTR),
-    m_clientGnss(Q_NULLPTR), m_remoteGnss(Q_NULLPTR), m_callbackGnss(Q_NULLPTR),
-    m_clientGnssDebug(Q_NULLPTR), m_remoteGnssDebug(Q_NULLPTR),
-    m_clientGnssNi(Q_NULLPTR), m_remoteGnssNi(Q_NULLPTR), m_callbackGnssNi(Q_NULLPTR),
-    m_clientGnssXtra(Q_NULLPTR), m_remoteGnssXtra(Q_NULLPTR), m_callbackGnssXtra(Q_NULLPTR),
-    m_clientAGnss(Q_NULLPTR), m_remoteAGnss(Q_NULLPTR), m_callbackAGnss(Q_NULLPTR),
-    m_clientAGnssRil(Q_NULLPTR), m_remoteAGnssRil(Q_NULLPTR), m_callbackAGnssRil(Q_NULLPTR)
-{
-}
+            BinderStruct<AGnssStatusIpV4> statusIpV4(&reader);
+            const AGnssStatusIpV4 *status = statusIpV4.data();
+            if (!status)
+                break;
 
-BinderLocationBackend::~BinderLocationBackend()
-{
-    dropGnss();
-}
+            ipv4.setAddress(status->ipV4Addr);
 
-void BinderLocationBackend::dropGnss()
-{
-    if (m_callbackGnss) {
-        gbinder_local_object_drop(m_callbackGnss);
-        m_callbackGnss = Q_NULLPTR;
-    }
-    if (m_clientGnss) {
-        gbinder_client_unref(m_clientGnss);
-        m_clientGnss = Q_NULLPTR;
-    }
-    if (m_remoteGnss) {
-        gbinder_remote_object_remove_handler(m_remoteGnss, m_death_id);
-        gbinder_remote_object_unref(m_remoteGnss);
-        m_death_id = 0;
-        m_remoteGnss = Q_NULLPTR;
-    }
-    if (m_clientGnssDebug) {
+            QMetaObject::invokeMethod(staticProvider, "agpsStatus", callbackConnection(),
+                                      Q_ARG(qint16, status->type), Q_ARG(quint16, status->status),
+                                      Q_ARG(QHostAddress, ipv4), Q_ARG(QHostAddress, ipv6),
+                                      Q_ARG(QByteArray, ssid), Q_ARG(QByteArray, password));
+            }
+            break;
+        case AGNSS_STATUS_IP_V6_CB:
+            {
+            QHostAddress ipv4;
+            QHostAddress ipv6;
+            QByteArray ssid;
+            QByteArray password;
+
+            BinderStruct<AGnssStatusIpV6> statusIpV6(&reader);
+            const AGnssStatusIpV6 *status = statusIpV6.data();
+            if (!status)
+                break;
+
+            ipv6.setAddress(status->ipV6Addr);
+
+            QMetaObject::invokeMethod(staticProvider, "agpsStatus", callbackConnection(),
+                                      Q_ARG(qint16, status->type), Q_ARG(quint16, status->status),
+                                      Q_ARG(QHostAddress, ipv4), Q_ARG(QHostAddress, ipv6),
+                                      Q_ARG(QByteArray, ssid), Q_ARG(QByteArray, password));
+            }
+            break;
+        default:
+            qWarning("Failed to decode callback %u", code);
+            break;
+        }
+        *status = GBINDER_STATUS_OK;
+        return gbinder_local_reply_append_int32(gbinder_local_object_new_reply(obj), 0);
+    } else {
+        qWarning("Unknown interface %s and code %u", iface, code);
+        *status = GBINDER_STATUS_FAILED;
+    }
+    return Q_NULLPTR;
+}
+
+
+GBinderLocalReply *geoclue_binder_agnss_ril_callback(
+    GBinderLocalObject *obj,
+    GBinderRemoteRequest *req,
+    guint code,
+    guint flags,
+    int *status,
+    void *user_data)
+{
+    Q_UNUSED(flags)
+    Q_UNUSED(user_data)
+    const char *iface = gbinder_remote_request_interface(req);
+
+    if (!g_strcmp0(iface, AGNSS_RIL_CALLBACK)) {
+        GBinderReader reader;
+
+        gbinder_remote_request_init_reader(req, &reader);
+        switch (code) {
+        case AGNSS_RIL_REQUEST_REF_ID_CB:
+            {
+            guint32 setIdFlags;
+            if (gbinder_reader_read_uint32(&reader, &setIdFlags)) {
+                qCDebug(lcGeoclueHybris) << "AGNSS RIL request ref ID" << showbase << hex << setIdFlags;
+                QMetaObject::invokeMethod(staticProvider, "agpsRilRequestSetId", callbackConnection(),
+                                          Q_ARG(quint32, setIdFlags));
+            }
+            }
+            break;
+        case AGNSS_RIL_REQUEST_REF_LOC_CB:
+            qCDebug(lcGeoclueHybris) << "AGNSS RIL request ref location";
+            QMetaObject::invokeMethod(staticProvider, "agpsRilRequestRefLocation", callbackConnection());
+            break;
+        default:
+            qWarning("Failed to decode callback %u", code);
+            break;
+        }
+        *status = GBINDER_STATUS_OK;
+        return gbinder_local_reply_append_int32(gbinder_local_object_new_reply(obj), 0);
+    } else {
+        qWarning("Unknown interface %s and code %u", iface, code);
+        *status = GBINDER_STATUS_FAILED;
+    }
+    return Q_NULLPTR;
+}
+
+
+GBinderLocalReply *geoclue_binder_gnss_ni_callback(
+    GBinderLocalObject *obj,
+    GBinderRemoteRequest *req,
+    guint code,
+    guint flags,
+    int *status,
+    void *user_data)
+{
+    Q_UNUSED(flags)
+    Q_UNUSED(user_data)
+    const char *iface = gbinder_remote_request_interface(req);
+
+    if (!g_strcmp0(iface, GNSS_NI_CALLBACK)) {
+        GBinderReader reader;
+
+        gbinder_remote_request_init_reader(req, &reader);
+        switch (code) {
+        case GNSS_NI_NOTIFY_CB:
+            qCDebug(lcGeoclueHybris) << "GNSS NI notify";
+            break;
+        default:
+            qWarning("Failed to decode callback %u", code);
+            break;
+        }
+        *status = GBINDER_STATUS_OK;
+        return gbinder_local_reply_append_int32(gbinder_local_object_new_reply(obj), 0);
+    } else {
+        qWarning("Unknown interface %s and code %u", iface, code);
+        *status = GBINDER_STATUS_FAILED;
+    }
+    return Q_NULLPTR;
+}
+
+void geoclue_binder_gnss_gnss_died(
+    GBinderRemoteObject */*obj*/,
+    void *user_data)
+{
+    BinderLocationBackend *self = (BinderLocationBackend *)user_data;
+    self->gnssDied();
+}
+
+void geoclue_binder_gnss_registered(
+    GBinderServiceManager */*sm*/,
+    const char */*name*/,
+    void *user_data)
+{
+    BinderLocationBackend *self = (BinderLocationBackend *)user_data;
+    self->gnssRegistered();
+}
+
+void geoclue_binder_gnss_command_reply(
+    GBinderClient */*client*/,
+    GBinderRemoteReply *reply,
+    int status,
+    void *user_data)
+{
+    BinderLocationBackend *self = (BinderLocationBackend *)user_data;
+    self->commandFinished(reply, status);
+}
+
+/*
+ * Decodes the DebugData returned by IGnssDebug::getDebugData(), the satellite data
+ * follows as a separate buffer.
+ */
+bool decodeGnssDebugData(GBinderRemoteReply *reply)
+{
+    GBinderReader reader;
+    gint32 status;
+    gbinder_remote_reply_init_reader(reply, &reader);
+
+    if (!gbinder_reader_read_int32(&reader, &status) || status != 0)
+        return false;
+
+    BinderStruct<GnssDebugData> debugData(&reader);
+    if (!debugData.data())
+        return false;
+
+    const GnssDebugData *data = debugData.data();
+    HybrisGnssDebugData result;
+    result.positionValid = data->position.valid;
+    result.latitudeDegrees = data->position.latitudeDegrees;
+    result.longitudeDegrees = data->position.longitudeDegrees;
+    result.altitudeMeters = data->position.altitudeMeters;
+    result.horizontalAccuracyMeters = data->position.horizontalAccuracyMeters;
+    result.positionAgeSeconds = data->position.ageSeconds;
+    result.timeEstimateMs = data->time.timeEstimate;
+    result.timeUncertaintyNs = data->time.timeUncertaintyNs;
+    result.frequencyUncertaintyNsPerSec = data->time.frequencyUncertaintyNsPerSec;
+
+    const guint count = data->satelliteDataArray.count;
+    if (count) {
+        GBinderBuffer *buffer = gbinder_reader_read_buffer(&reader);
+        if (!buffer || buffer->size != count * sizeof(GnssDebugSatellite)) {
+            gbinder_buffer_free(buffer);
+            return false;
+        }
+
+        const GnssDebugSatellite *satellites = static_cast<const GnssDebugSatellite *>(buffer->data);
+        result.satellites.reserve(count);
+        for (guint i = 0; i < count; ++i) {
+            HybrisGnssDebugSatellite satellite;
+            satellite.svid = satellites[i].svid;
+            satellite.constellation = static_cast<HybrisGnssConstellationType>(satellites[i].constellation);
+            satellite.ephemerisType = satellites[i].ephemerisType;
+            satellite.ephemerisSource = satellites[i].ephemerisSource;
+            satellite.ephemerisHealth = satellites[i].ephemerisHealth;
+            satellite.ephemerisAgeSeconds = satellites[i].ephemerisAgeSeconds;
+            satellite.serverPredictionAvailable = satellites[i].serverPredictionIsAvailable;
+            satellite.serverPredictionAgeSeconds = satellites[i].serverPredictionAgeSeconds;
+            result.satellites.append(satellite);
+        }
+        gbinder_buffer_free(buffer);
+    }
+
+    QMetaObject::invokeMethod(staticProvider, "gnssDebugData", Qt::QueuedConnection,
+                              Q_ARG(HybrisGnssDebugData, result));
+    return true;
+}
+
+// Run state and position mode commands must not be reordered relative to each other.
+bool isSessionCommandGroup(int group)
+{
+    return group == COMMAND_GROUP_RUN_STATE || group == COMMAND_GROUP_POSITION_MODE;
+}
+
+}
+
+/*==========================================================================*
+ * Plugin entry points
+ *==========================================================================*/
+
+extern "C" Q_DECL_EXPORT bool hybrisLocationBackendProbe()
+{
+    GBinderServiceManager *sm = gbinder_servicemanager_new(GNSS_BINDER_DEFAULT_DEV);
+    if (!sm)
+        return false;
+
+    // Every IGnss version also registers the names of the versions it extends.
+    int status = 0;
+    GBinderRemoteObject *remote = gbinder_servicemanager_get_service_sync(sm,
+        GNSS_REMOTE "/default", &status);
+    gbinder_servicemanager_unref(sm);
+
+    return remote != Q_NULLPTR;
+}
+
+extern "C" Q_DECL_EXPORT HybrisLocationBackend *hybrisLocationBackendCreate()
+{
+    return new BinderLocationBackend();
+}
+
+/*==========================================================================*
+ * Backend class
+ *==========================================================================*/
+
+BinderLocationBackend::BinderLocationBackend(QObject *parent)
+:   HybrisLocationBackend(parent), m_death_id(0), m_registration_id(0), m_recovering(false),
+    m_recoveryCommands(0),
+    m_fqname(Q_NULLPTR), m_gnssVersion(GNSS_HAL_1_0), m_sm(Q_NULLPTR),
+    m_clientGnss(Q_NULLPTR), m_remoteGnss(Q_NULLPTR), m_callbackGnss(Q_NULLPTR),
+    m_clientGnssBatching(Q_NULLPTR), m_remoteGnssBatching(Q_NULLPTR), m_callbackGnssBatching(Q_NULLPTR),
+    m_clientGnssMeasurement(Q_NULLPTR), m_remoteGnssMeasurement(Q_NULLPTR),
+    m_callbackGnssMeasurement(Q_NULLPTR),
+    m_clientGnssNavigationMessage(Q_NULLPTR), m_remoteGnssNavigationMessage(Q_NULLPTR),
+    m_callbackGnssNavigationMessage(Q_NULLPTR),
+    m_clientGnssGeofencing(Q_NULLPTR), m_remoteGnssGeofencing(Q_NULLPTR),
+    m_callbackGnssGeofencing(Q_NULLPTR),
+    m_clientGnssConfiguration(Q_NULLPTR), m_remoteGnssConfiguration(Q_NULLPTR),
+    m_gnssConfigurationBlacklist(false),
+    m_clientGnssDebug(Q_NULLPTR), m_remoteGnssDebug(Q_NULLPTR),
+    m_clientGnssNi(Q_NULLPTR), m_remoteGnssNi(Q_NULLPTR), m_callbackGnssNi(Q_NULLPTR),
+    m_clientGnssXtra(Q_NULLPTR), m_remoteGnssXtra(Q_NULLPTR), m_callbackGnssXtra(Q_NULLPTR),
+    m_clientAGnss(Q_NULLPTR), m_remoteAGnss(Q_NULLPTR), m_callbackAGnss(Q_NULLPTR),
+    m_clientAGnssRil(Q_NULLPTR), m_remoteAGnssRil(Q_NULLPTR), m_callbackAGnssRil(Q_NULLPTR),
+    m_currentCommandId(0)
+{
+    QSettings settings(BinderConfigFile, QSettings::IniFormat);
+    directDispatch = settings.value(QStringLiteral("binder/direct_dispatch"), false).toBool();
+    if (directDispatch)
+        qCDebug(lcGeoclueHybris) << "Dispatching binder callbacks directly";
+}
+
+BinderLocationBackend::~BinderLocationBackend()
+{
+    dropGnss();
+}
+
+void BinderLocationBackend::dropGnss()
+{
+    dropHal();
+
+    if (m_registration_id) {
+        gbinder_servicemanager_remove_handler(m_sm, m_registration_id);
+        m_registration_id = 0;
+    }
+    m_recovering = false;
+
+    if (m_sm) {
+        gbinder_servicemanager_unref(m_sm);
+        m_sm = Q_NULLPTR;
+    }
+
+    g_free(m_fqname);
+    m_fqname = Q_NULLPTR;
+}
+
+/*
+ * Releases everything referring to the running HAL, keeping the service manager so
+ * that the HAL can be looked up again.
+ */
+void BinderLocationBackend::dropHal()
+{
+    clearCommands();
+
+    if (m_callbackGnss) {
+        gbinder_local_object_drop(m_callbackGnss);
+        m_callbackGnss = Q_NULLPTR;
+    }
+    if (m_clientGnss) {
+        gbinder_client_unref(m_clientGnss);
+        m_clientGnss = Q_NULLPTR;
+    }
+    if (m_remoteGnss) {
+        gbinder_remote_object_remove_handler(m_remoteGnss, m_death_id);
+        gbinder_remote_object_unref(m_remoteGnss);
+        m_death_id = 0;
+        m_remoteGnss = Q_NULLPTR;
+    }
+    if (m_callbackGnssBatching) {
+        gbinder_local_object_drop(m_callbackGnssBatching);
+        m_callbackGnssBatching = Q_NULLPTR;
+    }
+    if (m_clientGnssBatching) {
+        gbinder_client_unref(m_clientGnssBatching);
+        m_clientGnssBatching = Q_NULLPTR;
+    }
+    if (m_remoteGnssBatching) {
+        gbinder_remote_object_unref(m_remoteGnssBatching);
+        m_remoteGnssBatching = Q_NULLPTR;
+    }
+    if (m_callbackGnssMeasurement) {
+        gbinder_local_object_drop(m_callbackGnssMeasurement);
+        m_callbackGnssMeasurement = Q_NULLPTR;
+    }
+    if (m_clientGnssMeasurement) {
+        gbinder_client_unref(m_clientGnssMeasurement);
+        m_clientGnssMeasurement = Q_NULLPTR;
+    }
+    if (m_remoteGnssMeasurement) {
+        gbinder_remote_object_unref(m_remoteGnssMeasurement);
+        m_remoteGnssMeasurement = Q_NULLPTR;
+    }
+    if (m_callbackGnssNavigationMessage) {
+        gbinder_local_object_drop(m_callbackGnssNavigationMessage);
+        m_callbackGnssNavigationMessage = Q_NULLPTR;
+    }
+    if (m_clientGnssNavigationMessage) {
+        gbinder_client_unref(m_clientGnssNavigationMessage);
+        m_clientGnssNavigationMessage = Q_NULLPTR;
+    }
+    if (m_remoteGnssNavigationMessage) {
+        gbinder_remote_object_unref(m_remoteGnssNavigationMessage);
+        m_remoteGnssNavigationMessage = Q_NULLPTR;
+    }
+    if (m_callbackGnssGeofencing) {
+        gbinder_local_object_drop(m_callbackGnssGeofencing);
+        m_callbackGnssGeofencing = Q_NULLPTR;
+    }
+    if (m_clientGnssGeofencing) {
+        gbinder_client_unref(m_clientGnssGeofencing);
+        m_clientGnssGeofencing = Q_NULLPTR;
+    }
+    if (m_remoteGnssGeofencing) {
+        gbinder_remote_object_unref(m_remoteGnssGeofencing);
+        m_remoteGnssGeofencing = Q_NULLPTR;
+    }
+    if (m_clientGnssConfiguration) {
+        gbinder_client_unref(m_clientGnssConfiguration);
+        m_clientGnssConfiguration = Q_NULLPTR;
+    }
+    if (m_remoteGnssConfiguration) {
+        gbinder_remote_object_unref(m_remoteGnssConfiguration);
+        m_remoteGnssConfiguration = Q_NULLPTR;
+    }
+    m_gnssConfigurationBlacklist = false;
+    if (m_clientGnssDebug) {
         gbinder_client_unref(m_clientGnssDebug);
         m_clientGnssDebug = Q_NULLPTR;
     }
@@ -648,13 +1406,121 @@ void BinderLocationBackend::dropGnss()
         gbinder_remote_object_unref(m_remoteAGnssRil);
         m_remoteAGnssRil = Q_NULLPTR;
     }
-    if (m_sm) {
-        gbinder_servicemanager_unref(m_sm);
-        m_sm = Q_NULLPTR;
+}
+
+void BinderLocationBackend::gnssDied()
+{
+    qWarning("GNSS HAL died, waiting for it to be restarted");
+
+    m_recoveryTimer.start();
+    dropHal();
+
+    if (!m_sm || !m_fqname)
+        return;
+
+    m_recovering = true;
+    if (!m_registration_id) {
+        m_registration_id = gbinder_servicemanager_add_registration_handler(m_sm, m_fqname,
+            geoclue_binder_gnss_registered, this);
     }
+}
 
-    g_free(m_fqname);
-    m_fqname = Q_NULLPTR;
+/*
+ * Called when IGnss is registered with hwservicemanager again. Reconnects and replays the
+ * session state so that tracking continues where it was.
+ */
+void BinderLocationBackend::gnssRegistered()
+{
+    if (!m_recovering)
+        return;
+
+    qWarning("GNSS HAL registered, recovering session");
+
+    m_recovering = false;
+    const SessionState session = m_session;
+
+    if (!gnssInit()) {
+        dropHal();
+        m_recovering = true;
+        return;
+    }
+
+    gbinder_servicemanager_remove_handler(m_sm, m_registration_id);
+    m_registration_id = 0;
+
+    if (session.extensions & EXTENSION_AGNSS)
+        aGnssInit();
+    if (session.extensions & EXTENSION_GNSS_NI)
+        gnssNiInit();
+    if (session.extensions & EXTENSION_AGNSS_RIL)
+        aGnssRilInit();
+    if (session.extensions & EXTENSION_GNSS_XTRA)
+        gnssXtraInit();
+    if (session.extensions & EXTENSION_GNSS_DEBUG)
+        gnssDebugInit();
+    if (session.extensions & EXTENSION_GNSS_BATCHING)
+        gnssBatchingInit();
+    if (session.extensions & EXTENSION_GNSS_GEOFENCING)
+        gnssGeofencingInit();
+    if (session.extensions & EXTENSION_GNSS_CONFIGURATION)
+        gnssConfigurationInit();
+
+    if (session.suplMode >= 0)
+        gnssConfigurationSetSuplMode(session.suplMode);
+    if (session.lppProfile >= 0)
+        gnssConfigurationSetLppProfile(session.lppProfile);
+    if (session.glonassPositioningProtocol >= 0)
+        gnssConfigurationSetGlonassPositioningProtocol(session.glonassPositioningProtocol);
+    if (session.blacklistSet)
+        gnssConfigurationSetBlacklist(session.blacklist);
+
+    if (session.networkStateSet)
+        aGnssRilUpdateNetworkState(session.networkConnected, session.networkType, session.networkRoaming);
+    if (session.networkAvailabilitySet)
+        aGnssRilUpdateNetworkAvailability(session.networkAvailable, session.networkApn);
+    if (session.serverSet)
+        aGnssSetServer(session.serverType, session.serverHost.constData(), session.serverPort);
+    if (session.timeInjected)
+        gnssInjectTime(session.timeMs, session.timeReferenceMs, session.uncertaintyMs);
+    if (session.locationInjected)
+        gnssInjectLocation(session.latitudeDegrees, session.longitudeDegrees, session.accuracyMeters);
+    if (session.positionModeSet) {
+        gnssSetPositionMode(session.mode, session.recurrence, session.minIntervalMs,
+                            session.preferredAccuracyMeters, session.preferredTimeMs,
+                            session.lowPowerMode);
+    }
+    if (session.started)
+        gnssStart();
+    if (session.batchingStarted)
+        gnssBatchingStart(session.batchingPeriodNanos, session.batchingWakeUpOnFifoFull);
+    if (session.measurementsStarted)
+        gnssMeasurementStart();
+    if (session.navigationMessagesStarted)
+        gnssNavigationMessageStart();
+
+    // Geofences are not persisted by the HAL.
+    for (QMap<int32_t, Geofence>::const_iterator it = session.geofences.constBegin();
+            it != session.geofences.constEnd(); ++it) {
+        gnssGeofenceAdd(it.key(), it->latitudeDegrees, it->longitudeDegrees, it->radiusMeters,
+                        it->lastTransition, it->monitorTransitions,
+                        it->notificationResponsivenessMs, it->unknownTimerMs);
+        if (it->paused)
+            gnssGeofencePause(it.key());
+    }
+
+    // Recovered once the HAL has answered the last replayed command.
+    m_recoveryCommands = m_commands.count() + (m_currentCommandId ? 1 : 0);
+    if (!m_recoveryCommands)
+        recoveryFinished();
+}
+
+void BinderLocationBackend::recoveryFinished()
+{
+    const int recoveryTime = m_recoveryTimer.elapsed();
+    qWarning("GNSS HAL recovered in %d ms", recoveryTime);
+
+    QMetaObject::invokeMethod(staticProvider, "gnssRecovered", Qt::QueuedConnection,
+                              Q_ARG(int, recoveryTime));
 }
 
 bool BinderLocationBackend::isReplySuccess(GBinderRemoteReply *reply)
@@ -674,13 +1540,24 @@ bool BinderLocationBackend::isReplySuccess(GBinderRemoteReply *reply)
     return true;
 }
 
-GBinderRemoteObject *BinderLocationBackend::getExtensionObject(GBinderRemoteReply *reply)
+bool BinderLocationBackend::isReplyStatusOk(GBinderRemoteReply *reply)
 {
-    GBinderReader reader;
     gint32 status;
-    gbinder_remote_reply_init_reader(reply, &reader);
 
-    if (!gbinder_reader_read_int32(&reader, &status) || status != 0) {
+    if (!gbinder_remote_reply_read_int32(reply, &status) || status != 0) {
+        return false;
+    }
+
+    return true;
+}
+
+GBinderRemoteObject *BinderLocationBackend::getExtensionObject(GBinderRemoteReply *reply)
+{
+    GBinderReader reader;
+    gint32 status;
+    gbinder_remote_reply_init_reader(reply, &reader);
+
+    if (!gbinder_reader_read_int32(&reader, &status) || status != 0) {
         qWarning("Failed to get extension object %d", status);
         return Q_NULLPTR;
     }
@@ -688,6 +1565,178 @@ GBinderRemoteObject *BinderLocationBackend::getExtensionObject(GBinderRemoteRepl
     return gbinder_reader_read_object(&reader);
 }
 
+bool BinderLocationBackend::remoteImplements(GBinderRemoteObject *remote, const char *iface)
+{
+    GBinderClient *client = gbinder_client_new(remote, HIDL_BASE_REMOTE);
+    GBinderRemoteReply *reply;
+    GBinderReader reader;
+    int status = 0;
+    gint32 result = -1;
+    bool ret = false;
+
+    reply = gbinder_client_transact_sync_reply(client, HIDL_INTERFACE_CHAIN_TRANSACTION,
+                                               Q_NULLPTR, &status);
+    if (!status) {
+        gbinder_remote_reply_init_reader(reply, &reader);
+        if (gbinder_reader_read_int32(&reader, &result) && result == 0) {
+            char **chain = gbinder_reader_read_hidl_string_vec(&reader);
+            for (char **name = chain; name && *name && !ret; ++name)
+                ret = !g_strcmp0(*name, iface);
+            g_strfreev(chain);
+        }
+    }
+
+    gbinder_remote_reply_unref(reply);
+    gbinder_client_unref(client);
+
+    return ret;
+}
+
+/*
+ * HAL calls are queued and sent one at a time with asynchronous transactions, so a slow
+ * HAL never blocks the main loop. Pending commands of the same group are merged, the
+ * newest request replacing the older one in its queue position.
+ */
+void BinderLocationBackend::queueCommand(GBinderClient *client, guint32 code,
+                                         GBinderLocalRequest *request, int command, int group,
+                                         bool statusOnly, const char *error, int data)
+{
+    if (group != COMMAND_GROUP_NONE) {
+        for (int i = m_commands.count() - 1; i >= 0; --i) {
+            Command &pending = m_commands[i];
+            if (pending.group == group) {
+                qCDebug(lcGeoclueHybris) << "Merging GNSS command" << pending.command
+                                         << "with" << command;
+                if (pending.request)
+                    gbinder_local_request_unref(pending.request);
+                pending.client = client;
+                pending.code = code;
+                pending.request = request ? gbinder_local_request_ref(request) : Q_NULLPTR;
+                pending.command = command;
+                pending.statusOnly = statusOnly;
+                pending.error = error;
+                pending.data = data;
+                return;
+            }
+            if (isSessionCommandGroup(pending.group) && isSessionCommandGroup(group))
+                break;
+        }
+    }
+
+    Command pending;
+    pending.client = client;
+    pending.code = code;
+    pending.request = request ? gbinder_local_request_ref(request) : Q_NULLPTR;
+    pending.command = command;
+    pending.group = group;
+    pending.statusOnly = statusOnly;
+    pending.error = error;
+    pending.data = data;
+    m_commands.enqueue(pending);
+
+    sendNextCommand();
+}
+
+void BinderLocationBackend::sendNextCommand()
+{
+    while (!m_currentCommandId && !m_commands.isEmpty()) {
+        m_currentCommand = m_commands.dequeue();
+        m_currentCommandId = gbinder_client_transact(m_currentCommand.client,
+            m_currentCommand.code, 0, m_currentCommand.request,
+            geoclue_binder_gnss_command_reply, Q_NULLPTR, this);
+
+        if (!m_currentCommandId) {
+            // Transaction could not be submitted, report it like a failed reply and move on.
+            finishCommand(Q_NULLPTR, GBINDER_STATUS_FAILED);
+        }
+    }
+}
+
+void BinderLocationBackend::commandFinished(GBinderRemoteReply *reply, int status)
+{
+    finishCommand(reply, status);
+    sendNextCommand();
+}
+
+// Reports the result of the current command, the next one is not sent.
+void BinderLocationBackend::finishCommand(GBinderRemoteReply *reply, int status)
+{
+    bool success = false;
+
+    if (!status && reply) {
+        if (m_currentCommand.command == HYBRIS_GNSS_COMMAND_DEBUG_DATA)
+            success = decodeGnssDebugData(reply);
+        else
+            success = m_currentCommand.statusOnly ? isReplyStatusOk(reply) : isReplySuccess(reply);
+    }
+
+    if (!success) {
+        qWarning("%s", m_currentCommand.error);
+    }
+
+    if (m_currentCommand.request)
+        gbinder_local_request_unref(m_currentCommand.request);
+    m_currentCommand.request = Q_NULLPTR;
+    m_currentCommandId = 0;
+
+    QMetaObject::invokeMethod(staticProvider, "gnssCommandFinished", Qt::QueuedConnection,
+                              Q_ARG(int, m_currentCommand.command), Q_ARG(bool, success),
+                              Q_ARG(int, m_currentCommand.data));
+
+    if (m_recoveryCommands && --m_recoveryCommands == 0)
+        recoveryFinished();
+}
+
+/*
+ * Sends the still pending commands synchronously, used when the HAL is about to be shut
+ * down and the main loop will not run again. The command in flight has already reached the
+ * HAL, only its reply is dropped.
+ */
+void BinderLocationBackend::flushCommands()
+{
+    if (m_currentCommandId) {
+        gbinder_client_cancel(m_currentCommand.client, m_currentCommandId);
+        if (m_currentCommand.request)
+            gbinder_local_request_unref(m_currentCommand.request);
+        m_currentCommand.request = Q_NULLPTR;
+        m_currentCommandId = 0;
+    }
+
+    while (!m_commands.isEmpty()) {
+        Command pending = m_commands.dequeue();
+        int status = 0;
+        GBinderRemoteReply *reply = gbinder_client_transact_sync_reply(pending.client,
+            pending.code, pending.request, &status);
+
+        if (status || !reply ||
+                !(pending.statusOnly ? isReplyStatusOk(reply) : isReplySuccess(reply))) {
+            qWarning("%s", pending.error);
+        }
+
+        if (pending.request)
+            gbinder_local_request_unref(pending.request);
+        gbinder_remote_reply_unref(reply);
+    }
+}
+
+void BinderLocationBackend::clearCommands()
+{
+    m_recoveryCommands = 0;
+
+    if (m_currentCommandId) {
+        gbinder_client_cancel(m_currentCommand.client, m_currentCommandId);
+        if (m_currentCommand.request)
+            gbinder_local_request_unref(m_currentCommand.request);
+        m_currentCommandId = 0;
+    }
+
+    while (!m_commands.isEmpty()) {
+        Command pending = m_commands.dequeue();
+        if (pending.request)
+            gbinder_local_request_unref(pending.request);
+    }
+}
+
 // Gnss
 bool BinderLocationBackend::gnssInit()
 {
@@ -695,33 +1744,50 @@ bool BinderLocationBackend::gnssInit()
 
     qWarning("Initialising GNSS interface");
 
-    m_sm = gbinder_servicemanager_new(GNSS_BINDER_DEFAULT_DEV);
+    if (!m_sm)
+        m_sm = gbinder_servicemanager_new(GNSS_BINDER_DEFAULT_DEV);
     if (m_sm) {
         int status = 0;
 
-        /* Fetch remote reference from hwservicemanager */
-        m_fqname = g_strconcat(GNSS_REMOTE "/default", Q_NULLPTR);
-        m_remoteGnss = gbinder_servicemanager_get_service_sync(m_sm,
-            m_fqname, &status);
+        /* Fetch remote reference from hwservicemanager, the version is
+         * negotiated once and kept when the HAL is restarted */
+        if (!m_fqname) {
+            for (int version = GNSS_HAL_2_0; version >= GNSS_HAL_1_0 && !m_remoteGnss; --version) {
+                char *fqname = g_strconcat(GnssIfaces[version].iface, "/default", Q_NULLPTR);
+                m_remoteGnss = gbinder_servicemanager_get_service_sync(m_sm, fqname, &status);
+                if (m_remoteGnss) {
+                    m_fqname = fqname;
+                    m_gnssVersion = version;
+                } else {
+                    g_free(fqname);
+                }
+            }
+        } else {
+            m_remoteGnss = gbinder_servicemanager_get_service_sync(m_sm,
+                m_fqname, &status);
+        }
 
         if (m_remoteGnss) {
             GBinderLocalRequest *req;
             GBinderRemoteReply *reply;
 
+            qWarning("Using %s", GnssIfaces[m_gnssVersion].iface);
+
             /* get_service returns auto-released reference,
              * we need to add a reference of our own */
             gbinder_remote_object_ref(m_remoteGnss);
-            m_clientGnss = gbinder_client_new(m_remoteGnss, GNSS_REMOTE);
+            m_clientGnss = gbinder_client_new2(m_remoteGnss, GnssIfaces, m_gnssVersion + 1);
             m_death_id = gbinder_remote_object_add_death_handler
                 (m_remoteGnss, geoclue_binder_gnss_gnss_died, this);
-            m_callbackGnss = gbinder_servicemanager_new_local_object
-                (m_sm, GNSS_CALLBACK, geoclue_binder_gnss_callback, this);
+            m_callbackGnss = gbinder_servicemanager_new_local_object2
+                (m_sm, GnssCallbackIfaces + GNSS_HAL_2_0 - m_gnssVersion,
+                 geoclue_binder_gnss_callback, this);
 
-            /* IGnss::setCallback */
-            req = gbinder_client_new_request(m_clientGnss);
+            /* IGnss::setCallback, setCallback_1_1 or setCallback_2_0 */
+            req = gbinder_client_new_request2(m_clientGnss, GnssSetCallback[m_gnssVersion]);
             gbinder_local_request_append_local_object(req, m_callbackGnss);
             reply = gbinder_client_transact_sync_reply(m_clientGnss,
-                GNSS_SET_CALLBACK, req, &status);
+                GnssSetCallback[m_gnssVersion], req, &status);
 
             if (!status) {
                 ret = isReplySuccess(reply);
@@ -740,175 +1806,725 @@ bool BinderLocationBackend::gnssInit()
 
 bool BinderLocationBackend::gnssStart()
 {
+    m_session.started = true;
+    if (m_recovering)
+        return true;
+
+    if (!m_clientGnss) {
+        qWarning("Failed to start positioning");
+        return false;
+    }
+
+    queueCommand(m_clientGnss, GNSS_START, Q_NULLPTR, HYBRIS_GNSS_COMMAND_START,
+                 COMMAND_GROUP_RUN_STATE, false, "Failed to start positioning");
+    return true;
+}
+
+bool BinderLocationBackend::gnssStop()
+{
+    m_session.started = false;
+    if (m_recovering)
+        return true;
+
+    if (!m_clientGnss) {
+        qWarning("Failed to stop positioning");
+        return false;
+    }
+
+    queueCommand(m_clientGnss, GNSS_STOP, Q_NULLPTR, HYBRIS_GNSS_COMMAND_STOP,
+                 COMMAND_GROUP_RUN_STATE, false, "Failed to stop positioning");
+    return true;
+}
+
+void BinderLocationBackend::gnssCleanup()
+{
+    if (m_clientGnss) {
+        flushCommands();
+        if (m_clientGnssBatching) {
+            gbinder_client_transact(m_clientGnssBatching, GNSS_BATCHING_CLEANUP, 0, NULL, NULL,
+                                    NULL, NULL);
+        }
+        gbinder_client_transact(m_clientGnss, GNSS_CLEANUP, 0, NULL, NULL, NULL, NULL);
+    }
+}
+
+bool BinderLocationBackend::gnssInjectLocation(double latitudeDegrees, double longitudeDegrees, float accuracyMeters)
+{
+    m_session.locationInjected = true;
+    m_session.latitudeDegrees = latitudeDegrees;
+    m_session.longitudeDegrees = longitudeDegrees;
+    m_session.accuracyMeters = accuracyMeters;
+    if (m_recovering)
+        return true;
+
+    if (m_clientGnss) {
+        GBinderLocalRequest *req;
+        GBinderWriter writer;
+
+        req = gbinder_client_new_request(m_clientGnss);
+        gbinder_local_request_init_writer(req, &writer);
+        gbinder_writer_append_double(&writer, latitudeDegrees);
+        gbinder_writer_append_double(&writer, longitudeDegrees);
+        gbinder_writer_append_float(&writer, accuracyMeters);
+        queueCommand(m_clientGnss, GNSS_INJECT_LOCATION, req, HYBRIS_GNSS_COMMAND_INJECT_LOCATION,
+                     COMMAND_GROUP_INJECT_LOCATION, false, "Failed to inject location");
+
+        gbinder_local_request_unref(req);
+        return true;
+    }
+    return false;
+}
+
+bool BinderLocationBackend::gnssInjectTime(HybrisGnssUtcTime timeMs, int64_t timeReferenceMs, int32_t uncertaintyMs)
+{
+    // The reference is monotonic time, so the same injection stays valid after a restart.
+    m_session.timeInjected = true;
+    m_session.timeMs = timeMs;
+    m_session.timeReferenceMs = timeReferenceMs;
+    m_session.uncertaintyMs = uncertaintyMs;
+    if (m_recovering)
+        return true;
+
+    if (m_clientGnss) {
+        GBinderLocalRequest *req;
+        GBinderWriter writer;
+
+        req = gbinder_client_new_request(m_clientGnss);
+        gbinder_local_request_init_writer(req, &writer);
+        gbinder_writer_append_int64(&writer, timeMs);
+        gbinder_writer_append_int64(&writer, timeReferenceMs);
+        gbinder_writer_append_int32(&writer, uncertaintyMs);
+        queueCommand(m_clientGnss, GNSS_INJECT_TIME, req, HYBRIS_GNSS_COMMAND_INJECT_TIME,
+                     COMMAND_GROUP_INJECT_TIME, false, "Failed to inject time");
+
+        gbinder_local_request_unref(req);
+        return true;
+    }
+    return false;
+}
+
+void BinderLocationBackend::gnssDeleteAidingData(HybrisGnssAidingData aidingDataFlags)
+{
+    if (m_clientGnss) {
+        GBinderLocalRequest *req;
+
+        req = gbinder_client_new_request(m_clientGnss);
+        gbinder_local_request_append_int32(req, aidingDataFlags);
+        queueCommand(m_clientGnss, GNSS_DELETE_AIDING_DATA, req,
+                     HYBRIS_GNSS_COMMAND_DELETE_AIDING_DATA, COMMAND_GROUP_NONE, true,
+                     "GNSS delete aiding data failed");
+
+        gbinder_local_request_unref(req);
+    }
+}
+
+bool BinderLocationBackend::gnssSetPositionMode(HybrisGnssPositionMode mode, HybrisGnssPositionRecurrence recurrence,
+                                       uint32_t minIntervalMs, uint32_t preferredAccuracyMeters,
+                                       uint32_t preferredTimeMs, bool lowPowerMode)
+{
+    m_session.positionModeSet = true;
+    m_session.mode = mode;
+    m_session.recurrence = recurrence;
+    m_session.minIntervalMs = minIntervalMs;
+    m_session.preferredAccuracyMeters = preferredAccuracyMeters;
+    m_session.preferredTimeMs = preferredTimeMs;
+    m_session.lowPowerMode = lowPowerMode;
+    if (m_recovering)
+        return true;
+
+    if (m_clientGnss) {
+        GBinderLocalRequest *req;
+        GBinderWriter writer;
+        // Low power mode needs setPositionMode_1_1, 1.0 HALs ignore it.
+        const guint32 code = m_gnssVersion >= GNSS_HAL_1_1 ? GNSS_SET_POSITION_MODE_1_1
+                                                           : GNSS_SET_POSITION_MODE;
+
+        req = gbinder_client_new_request2(m_clientGnss, code);
+        gbinder_local_request_init_writer(req, &writer);
+        gbinder_writer_append_int32(&writer, mode);
+        gbinder_writer_append_int32(&writer, recurrence);
+        gbinder_writer_append_int32(&writer, minIntervalMs);
+        gbinder_writer_append_int32(&writer, preferredAccuracyMeters);
+        gbinder_writer_append_int32(&writer, preferredTimeMs);
+        if (code == GNSS_SET_POSITION_MODE_1_1)
+            gbinder_writer_append_bool(&writer, lowPowerMode);
+        queueCommand(m_clientGnss, code, req,
+                     HYBRIS_GNSS_COMMAND_SET_POSITION_MODE, COMMAND_GROUP_POSITION_MODE, false,
+                     "GNSS set position mode failed");
+
+        gbinder_local_request_unref(req);
+        return true;
+    }
+    qWarning("GNSS set position mode failed");
+    return false;
+}
+
+// GnssBatching
+bool BinderLocationBackend::gnssBatchingInit()
+{
+    m_session.extensions |= EXTENSION_GNSS_BATCHING;
+    if (m_recovering)
+        return false;
+
+    GBinderRemoteReply *reply;
+    int status = 0;
+    bool ret = false;
+
+    reply = gbinder_client_transact_sync_reply(m_clientGnss,
+        GNSS_GET_EXTENSION_GNSS_BATCHING, Q_NULLPTR, &status);
+
+    if (!status) {
+        m_remoteGnssBatching = getExtensionObject(reply);
+
+        if (m_remoteGnssBatching) {
+            qWarning("Initialising GNSS Batching interface");
+            GBinderLocalRequest *req;
+            m_clientGnssBatching = gbinder_client_new(m_remoteGnssBatching, GNSS_BATCHING_REMOTE);
+            m_callbackGnssBatching = gbinder_servicemanager_new_local_object
+                (m_sm, GNSS_BATCHING_CALLBACK, geoclue_binder_gnss_batching_callback, this);
+
+            gbinder_remote_reply_unref(reply);
+
+            /* IGnssBatching::init */
+            req = gbinder_client_new_request(m_clientGnssBatching);
+            gbinder_local_request_append_local_object(req, m_callbackGnssBatching);
+            reply = gbinder_client_transact_sync_reply(m_clientGnssBatching,
+                GNSS_BATCHING_INIT, req, &status);
+
+            if (!status)
+                ret = isReplySuccess(reply);
+
+            if (!ret)
+                qWarning("Initialising GNSS Batching interface failed");
+
+            gbinder_local_request_unref(req);
+        }
+    }
+    gbinder_remote_reply_unref(reply);
+
+    return ret;
+}
+
+int BinderLocationBackend::gnssBatchingGetBatchSize()
+{
+    if (!m_clientGnssBatching)
+        return 0;
+
+    GBinderRemoteReply *reply;
+    GBinderReader reader;
+    int status = 0;
+    gint32 result;
+    guint32 batchSize = 0;
+
+    reply = gbinder_client_transact_sync_reply(m_clientGnssBatching,
+        GNSS_BATCHING_GET_BATCH_SIZE, Q_NULLPTR, &status);
+
+    if (!status) {
+        gbinder_remote_reply_init_reader(reply, &reader);
+        if (!gbinder_reader_read_int32(&reader, &result) || result != 0 ||
+                !gbinder_reader_read_uint32(&reader, &batchSize)) {
+            qWarning("GNSS Batching get batch size failed");
+            batchSize = 0;
+        }
+    }
+    gbinder_remote_reply_unref(reply);
+
+    // uint16_t in the HAL interface, the upper half is padding.
+    return batchSize & 0xffff;
+}
+
+bool BinderLocationBackend::gnssBatchingStart(int64_t periodNanos, bool wakeUpOnFifoFull)
+{
+    m_session.batchingStarted = true;
+    m_session.batchingPeriodNanos = periodNanos;
+    m_session.batchingWakeUpOnFifoFull = wakeUpOnFifoFull;
+    if (m_recovering)
+        return true;
+
+    if (!m_clientGnssBatching)
+        return false;
+
+    GBinderLocalRequest *req;
+    GBinderWriter writer;
+    GnssBatchingOptions *options;
+
+    req = gbinder_client_new_request(m_clientGnssBatching);
+    gbinder_local_request_init_writer(req, &writer);
+    options = gbinder_writer_new0(&writer, GnssBatchingOptions);
+    options->periodNanos = periodNanos;
+    options->flags = wakeUpOnFifoFull ? HYBRIS_GNSS_BATCHING_FLAGS_WAKEUP_ON_FIFO_FULL : 0;
+    gbinder_writer_append_buffer_object(&writer, options, sizeof(*options));
+    queueCommand(m_clientGnssBatching, GNSS_BATCHING_START, req,
+                 HYBRIS_GNSS_COMMAND_BATCHING_START, COMMAND_GROUP_NONE, false,
+                 "GNSS Batching start failed");
+
+    gbinder_local_request_unref(req);
+    return true;
+}
+
+void BinderLocationBackend::gnssBatchingFlush()
+{
+    if (m_recovering || !m_clientGnssBatching)
+        return;
+
+    queueCommand(m_clientGnssBatching, GNSS_BATCHING_FLUSH, Q_NULLPTR,
+                 HYBRIS_GNSS_COMMAND_BATCHING_FLUSH, COMMAND_GROUP_NONE, true,
+                 "GNSS Batching flush failed");
+}
+
+bool BinderLocationBackend::gnssBatchingStop()
+{
+    m_session.batchingStarted = false;
+    if (m_recovering)
+        return true;
+
+    if (!m_clientGnssBatching)
+        return false;
+
+    queueCommand(m_clientGnssBatching, GNSS_BATCHING_STOP, Q_NULLPTR,
+                 HYBRIS_GNSS_COMMAND_BATCHING_STOP, COMMAND_GROUP_NONE, false,
+                 "GNSS Batching stop failed");
+    return true;
+}
+
+// GnssMeasurement
+bool BinderLocationBackend::gnssMeasurementStart()
+{
+    m_session.measurementsStarted = true;
+    if (m_recovering)
+        return true;
+
+    GBinderRemoteReply *reply;
+    GBinderLocalRequest *req;
+    GBinderReader reader;
+    int status = 0;
+    gint32 result = -1;
+
+    if (!m_clientGnssMeasurement) {
+        reply = gbinder_client_transact_sync_reply(m_clientGnss,
+            GNSS_GET_EXTENSION_GNSS_MEASUREMENT, Q_NULLPTR, &status);
+
+        if (!status)
+            m_remoteGnssMeasurement = getExtensionObject(reply);
+        gbinder_remote_reply_unref(reply);
+
+        if (!m_remoteGnssMeasurement) {
+            qWarning("GNSS Measurement interface not available");
+            m_session.measurementsStarted = false;
+            return false;
+        }
+
+        qWarning("Initialising GNSS Measurement interface");
+        m_clientGnssMeasurement = gbinder_client_new(m_remoteGnssMeasurement, GNSS_MEASUREMENT_REMOTE);
+        m_callbackGnssMeasurement = gbinder_servicemanager_new_local_object
+            (m_sm, GNSS_MEASUREMENT_CALLBACK, geoclue_binder_gnss_measurement_callback, this);
+    }
+
+    /* IGnssMeasurement::setCallback, measurements are reported until close */
+    req = gbinder_client_new_request(m_clientGnssMeasurement);
+    gbinder_local_request_append_local_object(req, m_callbackGnssMeasurement);
+    reply = gbinder_client_transact_sync_reply(m_clientGnssMeasurement,
+        GNSS_MEASUREMENT_SET_CALLBACK, req, &status);
+
+    if (!status) {
+        gbinder_remote_reply_init_reader(reply, &reader);
+        if (!gbinder_reader_read_int32(&reader, &status) || status != 0 ||
+                !gbinder_reader_read_int32(&reader, &result)) {
+            result = -1;
+        }
+    }
+    gbinder_local_request_unref(req);
+    gbinder_remote_reply_unref(reply);
+
+    // GnssMeasurementStatus::SUCCESS
+    if (result != 0) {
+        qWarning("GNSS Measurement set callback failed %d", result);
+        m_session.measurementsStarted = false;
+        return false;
+    }
+
+    return true;
+}
+
+void BinderLocationBackend::gnssMeasurementStop()
+{
+    m_session.measurementsStarted = false;
+    if (m_recovering || !m_clientGnssMeasurement)
+        return;
+
+    queueCommand(m_clientGnssMeasurement, GNSS_MEASUREMENT_CLOSE, Q_NULLPTR,
+                 HYBRIS_GNSS_COMMAND_MEASUREMENT_CLOSE, COMMAND_GROUP_NONE, true,
+                 "GNSS Measurement close failed");
+}
+
+// GnssNavigationMessage
+bool BinderLocationBackend::gnssNavigationMessageStart()
+{
+    m_session.navigationMessagesStarted = true;
+    if (m_recovering)
+        return true;
+
+    GBinderRemoteReply *reply;
+    GBinderLocalRequest *req;
+    GBinderReader reader;
+    int status = 0;
+    gint32 result = -1;
+
+    if (!m_clientGnssNavigationMessage) {
+        reply = gbinder_client_transact_sync_reply(m_clientGnss,
+            GNSS_GET_EXTENSION_GNSS_NAVIGATION_MESSAGE, Q_NULLPTR, &status);
+
+        if (!status)
+            m_remoteGnssNavigationMessage = getExtensionObject(reply);
+        gbinder_remote_reply_unref(reply);
+
+        if (!m_remoteGnssNavigationMessage) {
+            qWarning("GNSS Navigation Message interface not available");
+            m_session.navigationMessagesStarted = false;
+            return false;
+        }
+
+        qWarning("Initialising GNSS Navigation Message interface");
+        m_clientGnssNavigationMessage = gbinder_client_new(m_remoteGnssNavigationMessage,
+                                                           GNSS_NAVIGATION_MESSAGE_REMOTE);
+        m_callbackGnssNavigationMessage = gbinder_servicemanager_new_local_object
+            (m_sm, GNSS_NAVIGATION_MESSAGE_CALLBACK, geoclue_binder_gnss_navigation_message_callback, this);
+    }
+
+    /* IGnssNavigationMessage::setCallback, messages are reported until close */
+    req = gbinder_client_new_request(m_clientGnssNavigationMessage);
+    gbinder_local_request_append_local_object(req, m_callbackGnssNavigationMessage);
+    reply = gbinder_client_transact_sync_reply(m_clientGnssNavigationMessage,
+        GNSS_NAVIGATION_MESSAGE_SET_CALLBACK, req, &status);
+
+    if (!status) {
+        gbinder_remote_reply_init_reader(reply, &reader);
+        if (!gbinder_reader_read_int32(&reader, &status) || status != 0 ||
+                !gbinder_reader_read_int32(&reader, &result)) {
+            result = -1;
+        }
+    }
+    gbinder_local_request_unref(req);
+    gbinder_remote_reply_unref(reply);
+
+    // GnssNavigationMessageStatus::SUCCESS
+    if (result != 0) {
+        qWarning("GNSS Navigation Message set callback failed %d", result);
+        m_session.navigationMessagesStarted = false;
+        return false;
+    }
+
+    return true;
+}
+
+void BinderLocationBackend::gnssNavigationMessageStop()
+{
+    m_session.navigationMessagesStarted = false;
+    if (m_recovering || !m_clientGnssNavigationMessage)
+        return;
+
+    queueCommand(m_clientGnssNavigationMessage, GNSS_NAVIGATION_MESSAGE_CLOSE, Q_NULLPTR,
+                 HYBRIS_GNSS_COMMAND_NAVIGATION_MESSAGE_CLOSE, COMMAND_GROUP_NONE, true,
+                 "GNSS Navigation Message close failed");
+}
+
+// GnssGeofencing
+bool BinderLocationBackend::gnssGeofencingInit()
+{
+    m_session.extensions |= EXTENSION_GNSS_GEOFENCING;
+    if (m_recovering)
+        return false;
+
+    GBinderRemoteReply *reply;
+    int status = 0;
     bool ret = false;
 
-    if (m_clientGnss) {
-        int status = 0;
-        GBinderRemoteReply *reply;
+    reply = gbinder_client_transact_sync_reply(m_clientGnss,
+        GNSS_GET_EXTENSION_GNSS_GEOFENCING, Q_NULLPTR, &status);
+
+    if (!status) {
+        m_remoteGnssGeofencing = getExtensionObject(reply);
+
+        if (m_remoteGnssGeofencing) {
+            qWarning("Initialising GNSS Geofencing interface");
+            GBinderLocalRequest *req;
+            m_clientGnssGeofencing = gbinder_client_new(m_remoteGnssGeofencing, GNSS_GEOFENCING_REMOTE);
+            m_callbackGnssGeofencing = gbinder_servicemanager_new_local_object
+                (m_sm, GNSS_GEOFENCE_CALLBACK, geoclue_binder_gnss_geofence_callback, this);
+
+            gbinder_remote_reply_unref(reply);
+
+            /* IGnssGeofencing::setCallback */
+            req = gbinder_client_new_request(m_clientGnssGeofencing);
+            gbinder_local_request_append_local_object(req, m_callbackGnssGeofencing);
+            reply = gbinder_client_transact_sync_reply(m_clientGnssGeofencing,
+                GNSS_GEOFENCING_SET_CALLBACK, req, &status);
+
+            if (!status)
+                ret = isReplyStatusOk(reply);
+
+            if (!ret)
+                qWarning("Initialising GNSS Geofencing interface failed");
+
+            gbinder_local_request_unref(req);
+        }
+    }
+    gbinder_remote_reply_unref(reply);
+
+    return ret;
+}
+
+bool BinderLocationBackend::gnssGeofenceAdd(int32_t geofenceId, double latitudeDegrees,
+                                            double longitudeDegrees, double radiusMeters,
+                                            int32_t lastTransition, int32_t monitorTransitions,
+                                            uint32_t notificationResponsivenessMs,
+                                            uint32_t unknownTimerMs)
+{
+    Geofence &geofence = m_session.geofences[geofenceId];
+    geofence.latitudeDegrees = latitudeDegrees;
+    geofence.longitudeDegrees = longitudeDegrees;
+    geofence.radiusMeters = radiusMeters;
+    geofence.lastTransition = lastTransition;
+    geofence.monitorTransitions = monitorTransitions;
+    geofence.notificationResponsivenessMs = notificationResponsivenessMs;
+    geofence.unknownTimerMs = unknownTimerMs;
+    geofence.paused = false;
+    if (m_recovering)
+        return true;
+
+    if (!m_clientGnssGeofencing) {
+        m_session.geofences.remove(geofenceId);
+        return false;
+    }
+
+    GBinderLocalRequest *req;
+    GBinderWriter writer;
+
+    req = gbinder_client_new_request(m_clientGnssGeofencing);
+    gbinder_local_request_init_writer(req, &writer);
+    gbinder_writer_append_int32(&writer, geofenceId);
+    gbinder_writer_append_double(&writer, latitudeDegrees);
+    gbinder_writer_append_double(&writer, longitudeDegrees);
+    gbinder_writer_append_double(&writer, radiusMeters);
+    gbinder_writer_append_int32(&writer, lastTransition);
+    gbinder_writer_append_int32(&writer, monitorTransitions);
+    gbinder_writer_append_int32(&writer, notificationResponsivenessMs);
+    gbinder_writer_append_int32(&writer, unknownTimerMs);
+    queueCommand(m_clientGnssGeofencing, GNSS_GEOFENCING_ADD_GEOFENCE, req,
+                 HYBRIS_GNSS_COMMAND_GEOFENCE_ADD, COMMAND_GROUP_NONE, true,
+                 "GNSS Geofencing add geofence failed", geofenceId);
+
+    gbinder_local_request_unref(req);
+    return true;
+}
+
+bool BinderLocationBackend::gnssGeofencePause(int32_t geofenceId)
+{
+    if (m_session.geofences.contains(geofenceId))
+        m_session.geofences[geofenceId].paused = true;
+    if (m_recovering)
+        return true;
+
+    if (!m_clientGnssGeofencing)
+        return false;
+
+    GBinderLocalRequest *req;
+
+    req = gbinder_client_new_request(m_clientGnssGeofencing);
+    gbinder_local_request_append_int32(req, geofenceId);
+    queueCommand(m_clientGnssGeofencing, GNSS_GEOFENCING_PAUSE_GEOFENCE, req,
+                 HYBRIS_GNSS_COMMAND_GEOFENCE_PAUSE, COMMAND_GROUP_NONE, true,
+                 "GNSS Geofencing pause geofence failed");
+
+    gbinder_local_request_unref(req);
+    return true;
+}
+
+bool BinderLocationBackend::gnssGeofenceResume(int32_t geofenceId, int32_t monitorTransitions)
+{
+    if (m_session.geofences.contains(geofenceId)) {
+        m_session.geofences[geofenceId].paused = false;
+        m_session.geofences[geofenceId].monitorTransitions = monitorTransitions;
+    }
+    if (m_recovering)
+        return true;
+
+    if (!m_clientGnssGeofencing)
+        return false;
+
+    GBinderLocalRequest *req;
+    GBinderWriter writer;
+
+    req = gbinder_client_new_request(m_clientGnssGeofencing);
+    gbinder_local_request_init_writer(req, &writer);
+    gbinder_writer_append_int32(&writer, geofenceId);
+    gbinder_writer_append_int32(&writer, monitorTransitions);
+    queueCommand(m_clientGnssGeofencing, GNSS_GEOFENCING_RESUME_GEOFENCE, req,
+                 HYBRIS_GNSS_COMMAND_GEOFENCE_RESUME, COMMAND_GROUP_NONE, true,
+                 "GNSS Geofencing resume geofence failed");
+
+    gbinder_local_request_unref(req);
+    return true;
+}
+
+bool BinderLocationBackend::gnssGeofenceRemove(int32_t geofenceId)
+{
+    m_session.geofences.remove(geofenceId);
+    if (m_recovering)
+        return true;
 
-        reply = gbinder_client_transact_sync_reply(m_clientGnss,
-            GNSS_START, Q_NULLPTR, &status);
+    if (!m_clientGnssGeofencing)
+        return false;
 
-        if (!status) {
-            ret = isReplySuccess(reply);
-        }
+    GBinderLocalRequest *req;
 
-        gbinder_remote_reply_unref(reply);
-    }
+    req = gbinder_client_new_request(m_clientGnssGeofencing);
+    gbinder_local_request_append_int32(req, geofenceId);
+    queueCommand(m_clientGnssGeofencing, GNSS_GEOFENCING_REMOVE_GEOFENCE, req,
+                 HYBRIS_GNSS_COMMAND_GEOFENCE_REMOVE, COMMAND_GROUP_NONE, true,
+                 "GNSS Geofencing remove geofence failed");
 
-    if (!ret) {
-        qWarning("Failed to start positioning");
-    }
-    return ret;
+    gbinder_local_request_unref(req);
+    return true;
 }
 
-bool BinderLocationBackend::gnssStop()
+// GnssConfiguration
+bool BinderLocationBackend::gnssConfigurationInit()
 {
-    bool ret = false;
+    m_session.extensions |= EXTENSION_GNSS_CONFIGURATION;
+    if (m_recovering)
+        return false;
 
-    if (m_clientGnss) {
-        int status = 0;
-        GBinderRemoteReply *reply;
+    GBinderRemoteReply *reply;
+    int status = 0;
 
-        reply = gbinder_client_transact_sync_reply(m_clientGnss,
-            GNSS_STOP, Q_NULLPTR, &status);
+    reply = gbinder_client_transact_sync_reply(m_clientGnss,
+        GNSS_GET_EXTENSION_GNSS_CONFIGURATION, Q_NULLPTR, &status);
 
-        if (!status) {
-            ret = isReplySuccess(reply);
+    if (!status) {
+        m_remoteGnssConfiguration = getExtensionObject(reply);
+        if (m_remoteGnssConfiguration) {
+            qWarning("Initialising GNSS Configuration interface");
+
+            // setBlacklist is only in @1.1 and is checked against the 1.1 descriptor.
+            m_gnssConfigurationBlacklist = remoteImplements(m_remoteGnssConfiguration,
+                                                            GNSS_CONFIGURATION_1_1_REMOTE);
+            const GBinderClientIfaceInfo ifaces[] = {
+                { GNSS_CONFIGURATION_REMOTE, GNSS_CONFIGURATION_SET_EMERGENCY_SUPL_PDN },
+                { GNSS_CONFIGURATION_1_1_REMOTE, GNSS_CONFIGURATION_SET_BLACKLIST }
+            };
+            m_clientGnssConfiguration = gbinder_client_new2(m_remoteGnssConfiguration, ifaces,
+                                                            m_gnssConfigurationBlacklist ? 2 : 1);
         }
-
-        gbinder_remote_reply_unref(reply);
-    }
-
-    if (!ret) {
-        qWarning("Failed to stop positioning");
     }
-    return ret;
-}
+    gbinder_remote_reply_unref(reply);
 
-void BinderLocationBackend::gnssCleanup()
-{
-    if (m_clientGnss) {
-        gbinder_client_transact(m_clientGnss, GNSS_CLEANUP, 0, NULL, NULL, NULL, NULL);
-    }
+    return m_clientGnssConfiguration;
 }
 
-bool BinderLocationBackend::gnssInjectLocation(double latitudeDegrees, double longitudeDegrees, float accuracyMeters)
+bool BinderLocationBackend::gnssConfigurationSetSuplMode(uint8_t suplMode)
 {
-    bool ret = false;
-
-    if (m_clientGnss) {
-        int status = 0;
+    m_session.suplMode = suplMode;
+    if (m_recovering)
+        return true;
 
-        GBinderLocalRequest *req;
-        GBinderRemoteReply *reply;
-        GBinderWriter writer;
+    if (!m_clientGnssConfiguration)
+        return false;
 
-        req = gbinder_client_new_request(m_clientGnss);
-        gbinder_local_request_init_writer(req, &writer);
-        gbinder_writer_append_double(&writer, latitudeDegrees);
-        gbinder_writer_append_double(&writer, longitudeDegrees);
-        gbinder_writer_append_float(&writer, accuracyMeters);
-        reply = gbinder_client_transact_sync_reply(m_clientGnss,
-            GNSS_INJECT_LOCATION, req, &status);
+    GBinderLocalRequest *req;
 
-        if (!status) {
-            ret = isReplySuccess(reply);
-        }
-        if (!ret) {
-            qWarning("Failed to inject location");
-        }
+    req = gbinder_client_new_request2(m_clientGnssConfiguration, GNSS_CONFIGURATION_SET_SUPL_MODE);
+    gbinder_local_request_append_int32(req, suplMode);
+    queueCommand(m_clientGnssConfiguration, GNSS_CONFIGURATION_SET_SUPL_MODE, req,
+                 HYBRIS_GNSS_COMMAND_CONFIGURATION, COMMAND_GROUP_NONE, false,
+                 "GNSS Configuration set SUPL mode failed");
 
-        gbinder_local_request_unref(req);
-        gbinder_remote_reply_unref(reply);
-    }
-    return ret;
+    gbinder_local_request_unref(req);
+    return true;
 }
 
-bool BinderLocationBackend::gnssInjectTime(HybrisGnssUtcTime timeMs, int64_t timeReferenceMs, int32_t uncertaintyMs)
+bool BinderLocationBackend::gnssConfigurationSetLppProfile(uint8_t lppProfile)
 {
-    bool ret = false;
+    m_session.lppProfile = lppProfile;
+    if (m_recovering)
+        return true;
 
-    if (m_clientGnss) {
-        int status = 0;
-        GBinderLocalRequest *req;
-        GBinderRemoteReply *reply;
-        GBinderWriter writer;
-
-        req = gbinder_client_new_request(m_clientGnss);
-        gbinder_local_request_init_writer(req, &writer);
-        gbinder_writer_append_int64(&writer, timeMs);
-        gbinder_writer_append_int64(&writer, timeReferenceMs);
-        gbinder_writer_append_int32(&writer, uncertaintyMs);
+    if (!m_clientGnssConfiguration)
+        return false;
 
-        reply = gbinder_client_transact_sync_reply(m_clientGnss,
-            GNSS_INJECT_TIME, req, &status);
+    GBinderLocalRequest *req;
 
-        if (!status) {
-            ret = isReplySuccess(reply);
-        }
+    req = gbinder_client_new_request2(m_clientGnssConfiguration, GNSS_CONFIGURATION_SET_LPP_PROFILE);
+    gbinder_local_request_append_int32(req, lppProfile);
+    queueCommand(m_clientGnssConfiguration, GNSS_CONFIGURATION_SET_LPP_PROFILE, req,
+                 HYBRIS_GNSS_COMMAND_CONFIGURATION, COMMAND_GROUP_NONE, false,
+                 "GNSS Configuration set LPP profile failed");
 
-        if (!ret) {
-            qWarning("Failed to inject time");
-        }
-        gbinder_local_request_unref(req);
-        gbinder_remote_reply_unref(reply);
-    }
-    return ret;
+    gbinder_local_request_unref(req);
+    return true;
 }
 
-void BinderLocationBackend::gnssDeleteAidingData(HybrisGnssAidingData aidingDataFlags)
+bool BinderLocationBackend::gnssConfigurationSetGlonassPositioningProtocol(uint8_t protocol)
 {
-    if (m_clientGnss) {
-        GBinderLocalRequest *req;
+    m_session.glonassPositioningProtocol = protocol;
+    if (m_recovering)
+        return true;
 
-        req = gbinder_client_new_request(m_clientGnss);
-        gbinder_local_request_append_int32(req, aidingDataFlags);
-        gbinder_client_transact(m_clientGnss, GNSS_DELETE_AIDING_DATA, 
-                                0, req, NULL, NULL, NULL);
+    if (!m_clientGnssConfiguration)
+        return false;
 
-        gbinder_local_request_unref(req);
-    }
+    GBinderLocalRequest *req;
+
+    req = gbinder_client_new_request2(m_clientGnssConfiguration,
+                                      GNSS_CONFIGURATION_SET_GLONASS_POSITIONING_PROTOCOL);
+    gbinder_local_request_append_int32(req, protocol);
+    queueCommand(m_clientGnssConfiguration, GNSS_CONFIGURATION_SET_GLONASS_POSITIONING_PROTOCOL, req,
+                 HYBRIS_GNSS_COMMAND_CONFIGURATION, COMMAND_GROUP_NONE, false,
+                 "GNSS Configuration set GLONASS positioning protocol failed");
+
+    gbinder_local_request_unref(req);
+    return true;
 }
 
-bool BinderLocationBackend::gnssSetPositionMode(HybrisGnssPositionMode mode, HybrisGnssPositionRecurrence recurrence,
-                                       uint32_t minIntervalMs, uint32_t preferredAccuracyMeters,
-                                       uint32_t preferredTimeMs)
+bool BinderLocationBackend::gnssConfigurationSetBlacklist(const QVector<HybrisGnssConstellationType> &constellations)
 {
-    bool ret = false;
+    m_session.blacklistSet = true;
+    m_session.blacklist = constellations;
+    if (m_recovering)
+        return true;
 
-    if (m_clientGnss) {
-        int status = 0;
-        GBinderLocalRequest *req;
-        GBinderRemoteReply *reply;
-        GBinderWriter writer;
+    if (!m_clientGnssConfiguration || !m_gnssConfigurationBlacklist)
+        return false;
 
-        req = gbinder_client_new_request(m_clientGnss);
-        gbinder_local_request_init_writer(req, &writer);
-        gbinder_writer_append_int32(&writer, mode);
-        gbinder_writer_append_int32(&writer, recurrence);
-        gbinder_writer_append_int32(&writer, minIntervalMs);
-        gbinder_writer_append_int32(&writer, preferredAccuracyMeters);
-        gbinder_writer_append_int32(&writer, preferredTimeMs);
-        reply = gbinder_client_transact_sync_reply(m_clientGnss,
-            GNSS_SET_POSITION_MODE, req, &status);
+    // svid 0 blacklists the whole constellation.
+    QVector<GnssBlacklistedSource> sources(constellations.count());
+    for (int i = 0; i < constellations.count(); ++i) {
+        sources[i].constellation = static_cast<GnssConstellationType>(constellations.at(i));
+        sources[i].svid = 0;
+    }
 
-        if (!status) {
-            ret = isReplySuccess(reply);
-        }
+    GBinderLocalRequest *req;
+    GBinderWriter writer;
 
-        if (!ret) {
-            qWarning("GNSS set position mode failed");
-        }
-        gbinder_local_request_unref(req);
-        gbinder_remote_reply_unref(reply);
-    }
-    return ret;
+    req = gbinder_client_new_request2(m_clientGnssConfiguration, GNSS_CONFIGURATION_SET_BLACKLIST);
+    gbinder_local_request_init_writer(req, &writer);
+    gbinder_writer_append_hidl_vec(&writer, sources.constData(), sources.count(),
+                                   sizeof(GnssBlacklistedSource));
+    queueCommand(m_clientGnssConfiguration, GNSS_CONFIGURATION_SET_BLACKLIST, req,
+                 HYBRIS_GNSS_COMMAND_CONFIGURATION, COMMAND_GROUP_NONE, false,
+                 "GNSS Configuration set blacklist failed");
+
+    gbinder_local_request_unref(req);
+    return true;
 }
 
 // GnssDebug
 void BinderLocationBackend::gnssDebugInit()
 {
+    m_session.extensions |= EXTENSION_GNSS_DEBUG;
+    if (m_recovering)
+        return;
+
     GBinderRemoteReply *reply;
     int status = 0;
 
@@ -925,9 +2541,31 @@ void BinderLocationBackend::gnssDebugInit()
     gbinder_remote_reply_unref(reply);
 }
 
+bool BinderLocationBackend::gnssDebugRequestData()
+{
+    if (!m_clientGnssDebug)
+        return false;
+
+    // Decoded in commandFinished(), the reply carries the debug data.
+    queueCommand(m_clientGnssDebug, GNSS_DEBUG_GET_DEBUG_DATA, Q_NULLPTR,
+                 HYBRIS_GNSS_COMMAND_DEBUG_DATA, COMMAND_GROUP_DEBUG_DATA, true,
+                 "GNSS Debug get debug data failed");
+    return true;
+}
+
+QVector<HybrisGnssThreadInfo> BinderLocationBackend::gnssDebugThreads()
+{
+    // Callbacks are delivered on the libgbinder looper, the HAL threads live in its process.
+    return QVector<HybrisGnssThreadInfo>();
+}
+
 // GnnNi
 void BinderLocationBackend::gnssNiInit()
 {
+    m_session.extensions |= EXTENSION_GNSS_NI;
+    if (m_recovering)
+        return;
+
     GBinderRemoteReply *reply;
     int status = 0;
 
@@ -966,33 +2604,27 @@ void BinderLocationBackend::gnssNiInit()
 void BinderLocationBackend::gnssNiRespond(int32_t notifId, HybrisGnssUserResponseType userResponse)
 {
     if (m_clientGnssNi) {
-        int status = 0;
         GBinderLocalRequest *req;
-        GBinderRemoteReply *reply;
         GBinderWriter writer;
 
         req = gbinder_client_new_request(m_clientGnssNi);
         gbinder_local_request_init_writer(req, &writer);
         gbinder_writer_append_int32(&writer, notifId);
         gbinder_writer_append_int32(&writer, userResponse);
-
-        reply = gbinder_client_transact_sync_reply(m_clientGnssNi,
-            GNSS_NI_RESPOND, req, &status);
-
-        if (!status) {
-            if (!gbinder_remote_reply_read_int32(reply, &status) || status != 0) {
-                qWarning("GNSS NI respond failed %d", status);
-            }
-        }
+        queueCommand(m_clientGnssNi, GNSS_NI_RESPOND, req, HYBRIS_GNSS_COMMAND_NI_RESPOND,
+                     COMMAND_GROUP_NONE, true, "GNSS NI respond failed");
 
         gbinder_local_request_unref(req);
-        gbinder_remote_reply_unref(reply);
     }
 }
 
 // GnssXtra
 void BinderLocationBackend::gnssXtraInit()
 {
+    m_session.extensions |= EXTENSION_GNSS_XTRA;
+    if (m_recovering)
+        return;
+
     GBinderRemoteReply *reply;
     int status = 0;
 
@@ -1028,34 +2660,33 @@ void BinderLocationBackend::gnssXtraInit()
 
 bool BinderLocationBackend::gnssXtraInjectXtraData(QByteArray &xtraData)
 {
-    bool ret = false;
     if (m_clientGnssXtra) {
-        int status = 0;
-
         GBinderLocalRequest *req;
-        GBinderRemoteReply *reply;
+        GBinderWriter writer;
 
+        // The request outlives this call, let it own a copy of the data.
         req = gbinder_client_new_request(m_clientGnssXtra);
-        gbinder_local_request_append_hidl_string(req, xtraData.constData());
-        reply = gbinder_client_transact_sync_reply(m_clientGnssXtra,
-            GNSS_XTRA_INJECT_XTRA_DATA, req, &status);
-
-        if (!status) {
-            ret = isReplySuccess(reply);
-        }
+        gbinder_local_request_init_writer(req, &writer);
+        gbinder_writer_append_hidl_string(&writer,
+            gbinder_writer_strdup(&writer, xtraData.constData()));
+        queueCommand(m_clientGnssXtra, GNSS_XTRA_INJECT_XTRA_DATA, req,
+                     HYBRIS_GNSS_COMMAND_XTRA_INJECT_DATA, COMMAND_GROUP_XTRA_DATA, false,
+                     "GNSS Xtra inject xtra data failed");
 
-        if (!ret) {
-            qWarning("GNSS Xtra inject xtra data failed");
-        }
         gbinder_local_request_unref(req);
-        gbinder_remote_reply_unref(reply);
+        return true;
     }
-    return ret;
+    qWarning("GNSS Xtra inject xtra data failed");
+    return false;
 }
 
 // AGnss
 void BinderLocationBackend::aGnssInit()
 {
+    m_session.extensions |= EXTENSION_AGNSS;
+    if (m_recovering)
+        return;
+
     GBinderRemoteReply *reply;
     int status = 0;
 
@@ -1093,94 +2724,83 @@ void BinderLocationBackend::aGnssInit()
 
 bool BinderLocationBackend::aGnssDataConnClosed()
 {
-    int status = 0;
-    bool ret = false;
-    GBinderRemoteReply *reply;
-
-    reply = gbinder_client_transact_sync_reply(m_clientAGnss,
-        AGNSS_DATA_CONN_CLOSED, Q_NULLPTR, &status);
-
-    if (!status) {
-        ret = isReplySuccess(reply);
-    }
+    if (!m_clientAGnss)
+        return false;
 
-    gbinder_remote_reply_unref(reply);
-    return ret;
+    queueCommand(m_clientAGnss, AGNSS_DATA_CONN_CLOSED, Q_NULLPTR,
+                 HYBRIS_AGNSS_COMMAND_DATA_CONN_CLOSED, COMMAND_GROUP_AGNSS_DATA_CONN, false,
+                 "AGNSS data connection closed failed");
+    return true;
 }
 
 bool BinderLocationBackend::aGnssDataConnFailed()
 {
-    int status = 0;
-    bool ret = false;
-    GBinderRemoteReply *reply;
-
-    reply = gbinder_client_transact_sync_reply(m_clientAGnss,
-        AGNSS_DATA_CONN_FAILED, Q_NULLPTR, &status);
-
-    if (!status) {
-        ret = isReplySuccess(reply);
-    }
+    if (!m_clientAGnss)
+        return false;
 
-    gbinder_remote_reply_unref(reply);
-    return ret;
+    queueCommand(m_clientAGnss, AGNSS_DATA_CONN_FAILED, Q_NULLPTR,
+                 HYBRIS_AGNSS_COMMAND_DATA_CONN_FAILED, COMMAND_GROUP_AGNSS_DATA_CONN, false,
+                 "AGNSS data connection failed failed");
+    return true;
 }
 
 bool BinderLocationBackend::aGnssDataConnOpen(const QByteArray &apn, const QString &protocol)
 {
-    int status = 0;
-    bool ret = false;
     GBinderLocalRequest *req;
-    GBinderRemoteReply *reply;
     GBinderWriter writer;
 
+    if (!m_clientAGnss)
+        return false;
+
     req = gbinder_client_new_request(m_clientAGnss);
 
     gbinder_local_request_init_writer(req, &writer);
-    gbinder_writer_append_hidl_string(&writer, apn.constData());
+    gbinder_writer_append_hidl_string(&writer, gbinder_writer_strdup(&writer, apn.constData()));
     gbinder_writer_append_int32(&writer, fromContextProtocol(protocol));
-    reply = gbinder_client_transact_sync_reply(m_clientAGnss,
-        AGNSS_DATA_CONN_OPEN, req, &status);
-
-    if (!status) {
-        ret = isReplySuccess(reply);
-    }
+    queueCommand(m_clientAGnss, AGNSS_DATA_CONN_OPEN, req, HYBRIS_AGNSS_COMMAND_DATA_CONN_OPEN,
+                 COMMAND_GROUP_AGNSS_DATA_CONN, false, "AGNSS data connection open failed");
 
     gbinder_local_request_unref(req);
-    gbinder_remote_reply_unref(reply);
 
-    return ret;
+    return true;
 }
 
 int BinderLocationBackend::aGnssSetServer(HybrisAGnssType type, const char* hostname, int port)
 {
-    int status = 0;
-    bool ret = false;
     GBinderLocalRequest *req;
-    GBinderRemoteReply *reply;
     GBinderWriter writer;
 
+    m_session.serverSet = true;
+    m_session.serverType = type;
+    m_session.serverHost = hostname;
+    m_session.serverPort = port;
+    if (m_recovering)
+        return GBINDER_STATUS_OK;
+
+    if (!m_clientAGnss)
+        return GBINDER_STATUS_FAILED;
+
     req = gbinder_client_new_request(m_clientAGnss);
 
     gbinder_local_request_init_writer(req, &writer);
     gbinder_writer_append_int32(&writer, type);
-    gbinder_writer_append_hidl_string(&writer, hostname);
+    gbinder_writer_append_hidl_string(&writer, gbinder_writer_strdup(&writer, hostname));
     gbinder_writer_append_int32(&writer, port);
-    reply = gbinder_client_transact_sync_reply(m_clientAGnss,
-        AGNSS_SET_SERVER, req, &status);
-
-    if (!status) {
-        ret = isReplySuccess(reply);
-    }
+    queueCommand(m_clientAGnss, AGNSS_SET_SERVER, req, HYBRIS_AGNSS_COMMAND_SET_SERVER,
+                 COMMAND_GROUP_AGNSS_SERVER, false, "AGNSS set server failed");
 
     gbinder_local_request_unref(req);
-    gbinder_remote_reply_unref(reply);
 
-    return ret;
+    return GBINDER_STATUS_OK;
 }
 
 // AGnssRil
 void BinderLocationBackend::aGnssRilInit()
 {
+    m_session.extensions |= EXTENSION_AGNSS_RIL;
+    if (m_recovering)
+        return;
+
     GBinderRemoteReply *reply;
     int status = 0;
 
@@ -1215,3 +2835,107 @@ void BinderLocationBackend::aGnssRilInit()
     }
     gbinder_remote_reply_unref(reply);
 }
+
+bool BinderLocationBackend::aGnssRilSetRefLocation(const HybrisAGnssRefLocation &location)
+{
+    // A restarted HAL requests the reference location again.
+    if (m_recovering || !m_clientAGnssRil)
+        return false;
+
+    GBinderLocalRequest *req;
+    GBinderWriter writer;
+    AGnssRefLocation *refLocation;
+
+    req = gbinder_client_new_request(m_clientAGnssRil);
+    gbinder_local_request_init_writer(req, &writer);
+    refLocation = gbinder_writer_new0(&writer, AGnssRefLocation);
+    refLocation->type = location.type;
+    refLocation->cellID.type = location.type;
+    refLocation->cellID.mcc = location.mcc;
+    refLocation->cellID.mnc = location.mnc;
+    refLocation->cellID.lac = location.lac;
+    refLocation->cellID.cid = location.cid;
+    refLocation->cellID.tac = location.tac;
+    refLocation->cellID.pcid = location.pcid;
+    gbinder_writer_append_buffer_object(&writer, refLocation, sizeof(*refLocation));
+    queueCommand(m_clientAGnssRil, AGNSS_RIL_SET_REF_LOCATION, req,
+                 HYBRIS_AGNSS_RIL_COMMAND_SET_REF_LOCATION, COMMAND_GROUP_AGNSS_RIL_REF_LOCATION,
+                 true, "AGNSS RIL set ref location failed");
+
+    gbinder_local_request_unref(req);
+    return true;
+}
+
+bool BinderLocationBackend::aGnssRilSetSetId(HybrisAGnssSetIDType type, const QByteArray &setId)
+{
+    if (m_recovering || !m_clientAGnssRil)
+        return false;
+
+    GBinderLocalRequest *req;
+    GBinderWriter writer;
+
+    req = gbinder_client_new_request(m_clientAGnssRil);
+    gbinder_local_request_init_writer(req, &writer);
+    gbinder_writer_append_int32(&writer, type);
+    gbinder_writer_append_hidl_string(&writer, gbinder_writer_strdup(&writer, setId.constData()));
+    queueCommand(m_clientAGnssRil, AGNSS_RIL_SET_ID, req, HYBRIS_AGNSS_RIL_COMMAND_SET_ID,
+                 COMMAND_GROUP_AGNSS_RIL_SET_ID, false, "AGNSS RIL set ID failed");
+
+    gbinder_local_request_unref(req);
+    return true;
+}
+
+bool BinderLocationBackend::aGnssRilUpdateNetworkState(bool connected, HybrisNetworkType type, bool roaming)
+{
+    m_session.networkStateSet = true;
+    m_session.networkConnected = connected;
+    m_session.networkType = type;
+    m_session.networkRoaming = roaming;
+    if (m_recovering)
+        return true;
+
+    if (!m_clientAGnssRil)
+        return false;
+
+    GBinderLocalRequest *req;
+    GBinderWriter writer;
+
+    req = gbinder_client_new_request(m_clientAGnssRil);
+    gbinder_local_request_init_writer(req, &writer);
+    gbinder_writer_append_bool(&writer, connected);
+    gbinder_writer_append_int32(&writer, type);
+    gbinder_writer_append_bool(&writer, roaming);
+    queueCommand(m_clientAGnssRil, AGNSS_RIL_UPDATE_NETWORK_STATE, req,
+                 HYBRIS_AGNSS_RIL_COMMAND_UPDATE_NETWORK_STATE, COMMAND_GROUP_AGNSS_RIL_NETWORK_STATE,
+                 false, "AGNSS RIL update network state failed");
+
+    gbinder_local_request_unref(req);
+    return true;
+}
+
+bool BinderLocationBackend::aGnssRilUpdateNetworkAvailability(bool available, const QByteArray &apn)
+{
+    m_session.networkAvailabilitySet = true;
+    m_session.networkAvailable = available;
+    m_session.networkApn = apn;
+    if (m_recovering)
+        return true;
+
+    if (!m_clientAGnssRil)
+        return false;
+
+    GBinderLocalRequest *req;
+    GBinderWriter writer;
+
+    req = gbinder_client_new_request(m_clientAGnssRil);
+    gbinder_local_request_init_writer(req, &writer);
+    gbinder_writer_append_bool(&writer, available);
+    gbinder_writer_append_hidl_string(&writer, gbinder_writer_strdup(&writer, apn.constData()));
+    queueCommand(m_clientAGnssRil, AGNSS_RIL_UPDATE_NETWORK_AVAILABILITY, req,
+                 HYBRIS_AGNSS_RIL_COMMAND_UPDATE_NETWORK_AVAILABILITY,
+                 COMMAND_GROUP_AGNSS_RIL_NETWORK_AVAILABILITY, false,
+                 "AGNSS RIL update network availability failed");
+
+    gbinder_local_request_unref(req);
+    return true;
+}
@@ -20,6 +20,8 @@
 #include <QtCore/QStringList>
 #include <QtCore/QBasicTimer>
 #include <QtCore/QQueue>
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QMap>
 #include <QtDBus/QDBusContext>
 #include <QtNetwork/QNetworkReply>
 
@@ -37,6 +39,9 @@ public:
     ~BinderLocationBackend();
 
     void dropGnss();
+    void gnssDied();
+    void gnssRegistered();
+    void commandFinished(GBinderRemoteReply *reply, int status);
 
     // Gnss
     bool gnssInit();
@@ -48,10 +53,43 @@ public:
     void gnssDeleteAidingData(HybrisGnssAidingData aidingDataFlags);
     bool gnssSetPositionMode(HybrisGnssPositionMode mode, HybrisGnssPositionRecurrence recurrence,
                              uint32_t minIntervalMs, uint32_t preferredAccuracyMeters,
-                             uint32_t preferredTimeMs);
+                             uint32_t preferredTimeMs, bool lowPowerMode);
+
+    // GnssBatching
+    bool gnssBatchingInit();
+    int gnssBatchingGetBatchSize();
+    bool gnssBatchingStart(int64_t periodNanos, bool wakeUpOnFifoFull);
+    void gnssBatchingFlush();
+    bool gnssBatchingStop();
+
+    // GnssMeasurement
+    bool gnssMeasurementStart();
+    void gnssMeasurementStop();
+
+    // GnssNavigationMessage
+    bool gnssNavigationMessageStart();
+    void gnssNavigationMessageStop();
+
+    // GnssGeofencing
+    bool gnssGeofencingInit();
+    bool gnssGeofenceAdd(int32_t geofenceId, double latitudeDegrees, double longitudeDegrees,
+                         double radiusMeters, int32_t lastTransition, int32_t monitorTransitions,
+                         uint32_t notificationResponsivenessMs, uint32_t unknownTimerMs);
+    bool gnssGeofencePause(int32_t geofenceId);
+    bool gnssGeofenceResume(int32_t geofenceId, int32_t monitorTransitions);
+    bool gnssGeofenceRemove(int32_t geofenceId);
+
+    // GnssConfiguration
+    bool gnssConfigurationInit();
+    bool gnssConfigurationSetSuplMode(uint8_t suplMode);
+    bool gnssConfigurationSetLppProfile(uint8_t lppProfile);
+    bool gnssConfigurationSetGlonassPositioningProtocol(uint8_t protocol);
+    bool gnssConfigurationSetBlacklist(const QVector<HybrisGnssConstellationType> &constellations);
 
     // GnssDebug
     void gnssDebugInit();
+    bool gnssDebugRequestData();
+    QVector<HybrisGnssThreadInfo> gnssDebugThreads();
 
     // GnnNi
     void gnssNiInit();
@@ -70,19 +108,154 @@ public:
 
     // AGnssRil
     void aGnssRilInit();
+    bool aGnssRilSetRefLocation(const HybrisAGnssRefLocation &location);
+    bool aGnssRilSetSetId(HybrisAGnssSetIDType type, const QByteArray &setId);
+    bool aGnssRilUpdateNetworkState(bool connected, HybrisNetworkType type, bool roaming);
+    bool aGnssRilUpdateNetworkAvailability(bool available, const QByteArray &apn);
 
 private:
+    struct Command {
+        GBinderClient *client;
+        guint32 code;
+        GBinderLocalRequest *request;
+        int command;
+        int group;
+        bool statusOnly;
+        const char *error;
+        int data;
+    };
+
+    struct Geofence {
+        double latitudeDegrees;
+        double longitudeDegrees;
+        double radiusMeters;
+        int32_t lastTransition;
+        int32_t monitorTransitions;
+        uint32_t notificationResponsivenessMs;
+        uint32_t unknownTimerMs;
+        bool paused;
+    };
+
+    // Session state replayed to the HAL after it has been restarted.
+    struct SessionState {
+        SessionState()
+        :   extensions(0), started(false), positionModeSet(false), mode(0), recurrence(0),
+            minIntervalMs(0), preferredAccuracyMeters(0), preferredTimeMs(0), lowPowerMode(false),
+            timeInjected(false),
+            timeMs(0), timeReferenceMs(0), uncertaintyMs(0), locationInjected(false),
+            latitudeDegrees(0), longitudeDegrees(0), accuracyMeters(0), serverSet(false),
+            serverType(0), serverPort(0), batchingStarted(false), batchingPeriodNanos(0),
+            batchingWakeUpOnFifoFull(false), measurementsStarted(false),
+            navigationMessagesStarted(false), suplMode(-1), lppProfile(-1),
+            glonassPositioningProtocol(-1), blacklistSet(false), networkStateSet(false),
+            networkConnected(false), networkType(0), networkRoaming(false),
+            networkAvailabilitySet(false), networkAvailable(false)
+        {
+        }
+
+        uint extensions;
+        bool started;
+
+        bool positionModeSet;
+        HybrisGnssPositionMode mode;
+        HybrisGnssPositionRecurrence recurrence;
+        uint32_t minIntervalMs;
+        uint32_t preferredAccuracyMeters;
+        uint32_t preferredTimeMs;
+        bool lowPowerMode;
+
+        bool timeInjected;
+        HybrisGnssUtcTime timeMs;
+        int64_t timeReferenceMs;
+        int32_t uncertaintyMs;
+
+        bool locationInjected;
+        double latitudeDegrees;
+        double longitudeDegrees;
+        float accuracyMeters;
+
+        bool serverSet;
+        HybrisAGnssType serverType;
+        QByteArray serverHost;
+        int serverPort;
+
+        bool batchingStarted;
+        int64_t batchingPeriodNanos;
+        bool batchingWakeUpOnFifoFull;
+
+        bool measurementsStarted;
+        bool navigationMessagesStarted;
+
+        int suplMode;
+        int lppProfile;
+        int glonassPositioningProtocol;
+        bool blacklistSet;
+        QVector<HybrisGnssConstellationType> blacklist;
+
+        bool networkStateSet;
+        bool networkConnected;
+        HybrisNetworkType networkType;
+        bool networkRoaming;
+        bool networkAvailabilitySet;
+        bool networkAvailable;
+        QByteArray networkApn;
+
+        QMap<int32_t, Geofence> geofences;
+    };
+
+    void dropHal();
+    void recoveryFinished();
+
     bool isReplySuccess(GBinderRemoteReply *reply);
+    bool isReplyStatusOk(GBinderRemoteReply *reply);
     GBinderRemoteObject *getExtensionObject(GBinderRemoteReply *reply);
+    bool remoteImplements(GBinderRemoteObject *remote, const char *iface);
+
+    void queueCommand(GBinderClient *client, guint32 code, GBinderLocalRequest *request,
+                      int command, int group, bool statusOnly, const char *error, int data = 0);
+    void sendNextCommand();
+    void finishCommand(GBinderRemoteReply *reply, int status);
+    void flushCommands();
+    void clearCommands();
+
+    QQueue<Command> m_commands;
+    Command m_currentCommand;
+    gulong m_currentCommandId;
 
     gulong m_death_id;
+    gulong m_registration_id;
+    bool m_recovering;
+    QElapsedTimer m_recoveryTimer;
+    int m_recoveryCommands;
+    SessionState m_session;
     char *m_fqname;
+    int m_gnssVersion;
     GBinderServiceManager *m_sm;
 
     GBinderClient *m_clientGnss;
     GBinderRemoteObject *m_remoteGnss;
     GBinderLocalObject *m_callbackGnss;
 
+    GBinderClient *m_clientGnssBatching;
+    GBinderRemoteObject *m_remoteGnssBatching;
+    GBinderLocalObject *m_callbackGnssBatching;
+
+    GBinderClient *m_clientGnssMeasurement;
+    GBinderRemoteObject *m_remoteGnssMeasurement;
+    GBinderLocalObject *m_callbackGnssMeasurement;
+
+    GBinderClient *m_clientGnssNavigationMessage;
+    GBinderRemoteObject *m_remoteGnssNavigationMessage;
+    GBinderLocalObject *m_callbackGnssNavigationMessage;
+
+    GBinderClient *m_clientGnssGeofencing;
+    GBinderRemoteObject *m_remoteGnssGeofencing;
+    GBinderLocalObject *m_callbackGnssGeofencing;
+
+    GBinderClient *m_clientGnssConfiguration;
+    GBinderRemoteObject *m_remoteGnssConfiguration;
+    bool m_gnssConfigurationBlacklist;
+
     GBinderClient *m_clientGnssDebug;
     GBinderRemoteObject *m_remoteGnssDebug;
 
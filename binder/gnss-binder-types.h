@@ -71,6 +71,21 @@ typedef struct gnss_location {
 
 G_STATIC_ASSERT(sizeof(GnssLocation) == 64);
 
+typedef struct elapsed_realtime {
+    guint16 flags ALIGNED(2);
+    guint64 timestampNs ALIGNED(8);
+    guint64 timeUncertaintyNs ALIGNED(8);
+} ALIGNED(8) ElapsedRealtime;
+
+G_STATIC_ASSERT(sizeof(ElapsedRealtime) == 24);
+
+typedef struct gnss_location_2_0 {
+    GnssLocation v1_0 ALIGNED(8);
+    ElapsedRealtime elapsedRealtime ALIGNED(8);
+} ALIGNED(8) GnssLocation_2_0;
+
+G_STATIC_ASSERT(sizeof(GnssLocation_2_0) == 88);
+
 typedef struct gnss_sv_info {
     gint16 svid ALIGNED(2);
     GnssConstellationType constellation ALIGNED(1);
@@ -83,6 +98,13 @@ typedef struct gnss_sv_info {
 
 G_STATIC_ASSERT(sizeof(GnssSvInfo) == 24);
 
+typedef struct gnss_sv_info_2_0 {
+    GnssSvInfo v1_0 ALIGNED(4);
+    GnssConstellationType constellation ALIGNED(1);
+} ALIGNED(4) GnssSvInfo_2_0;
+
+G_STATIC_ASSERT(sizeof(GnssSvInfo_2_0) == 28);
+
 typedef struct gnss_sv_status {
     gint32 numSvs ALIGNED(4);
     GnssSvInfo gnssSvList[64] ALIGNED(4);
@@ -90,6 +112,128 @@ typedef struct gnss_sv_status {
 
 G_STATIC_ASSERT(sizeof(GnssSvStatus) == 1540);
 
+enum {
+    HYBRIS_GNSS_BATCHING_FLAGS_WAKEUP_ON_FIFO_FULL = 1,
+};
+
+typedef struct gnss_batching_options {
+    gint64 periodNanos ALIGNED(8);
+    guint8 flags ALIGNED(1);
+} ALIGNED(8) GnssBatchingOptions;
+
+G_STATIC_ASSERT(sizeof(GnssBatchingOptions) == 16);
+
+typedef struct gnss_measurement {
+    guint32 flags ALIGNED(4);
+    gint16 svid ALIGNED(2);
+    GnssConstellationType constellation ALIGNED(1);
+    gdouble timeOffsetNs ALIGNED(8);
+    guint32 state ALIGNED(4);
+    gint64 receivedSvTimeInNs ALIGNED(8);
+    gint64 receivedSvTimeUncertaintyInNs ALIGNED(8);
+    gdouble cN0DbHz ALIGNED(8);
+    gdouble pseudorangeRateMps ALIGNED(8);
+    gdouble pseudorangeRateUncertaintyMps ALIGNED(8);
+    guint16 accumulatedDeltaRangeState ALIGNED(2);
+    gdouble accumulatedDeltaRangeM ALIGNED(8);
+    gdouble accumulatedDeltaRangeUncertaintyM ALIGNED(8);
+    gfloat carrierFrequencyHz ALIGNED(4);
+    gint64 carrierCycles ALIGNED(8);
+    gdouble carrierPhase ALIGNED(8);
+    gdouble carrierPhaseUncertainty ALIGNED(8);
+    guint8 multipathIndicator ALIGNED(1);
+    gdouble snrDb ALIGNED(8);
+    gdouble agcLevelDb ALIGNED(8);
+} ALIGNED(8) GnssMeasurement;
+
+G_STATIC_ASSERT(sizeof(GnssMeasurement) == 144);
+
+typedef struct gnss_clock {
+    guint16 gnssClockFlags ALIGNED(2);
+    gint16 leapSecond ALIGNED(2);
+    gint64 timeNs ALIGNED(8);
+    gdouble timeUncertaintyNs ALIGNED(8);
+    gint64 fullBiasNs ALIGNED(8);
+    gdouble biasNs ALIGNED(8);
+    gdouble biasUncertaintyNs ALIGNED(8);
+    gdouble driftNsps ALIGNED(8);
+    gdouble driftUncertaintyNsps ALIGNED(8);
+    guint32 hwClockDiscontinuityCount ALIGNED(4);
+} ALIGNED(8) GnssClock;
+
+G_STATIC_ASSERT(sizeof(GnssClock) == 72);
+
+typedef struct gnss_data {
+    guint32 measurementCount ALIGNED(4);
+    GnssMeasurement measurements[64] ALIGNED(8);
+    GnssClock clock ALIGNED(8);
+} ALIGNED(8) GnssData;
+
+G_STATIC_ASSERT(sizeof(GnssData) == 9296);
+
+typedef struct gnss_navigation_message {
+    gint16 svid ALIGNED(2);
+    guint16 type ALIGNED(2);
+    guint16 status ALIGNED(2);
+    gint16 messageId ALIGNED(2);
+    gint16 submessageId ALIGNED(2);
+    GBinderHidlVec data ALIGNED(8);
+} ALIGNED(8) GnssNavigationMessage;
+
+G_STATIC_ASSERT(sizeof(GnssNavigationMessage) == 32);
+
+typedef struct gnss_blacklisted_source {
+    GnssConstellationType constellation ALIGNED(1);
+    gint16 svid ALIGNED(2);
+} ALIGNED(2) GnssBlacklistedSource;
+
+G_STATIC_ASSERT(sizeof(GnssBlacklistedSource) == 4);
+
+typedef struct gnss_debug_position {
+    guint8 valid ALIGNED(1);
+    gdouble latitudeDegrees ALIGNED(8);
+    gdouble longitudeDegrees ALIGNED(8);
+    gfloat altitudeMeters ALIGNED(4);
+    gfloat speedMetersPerSec ALIGNED(4);
+    gfloat bearingDegrees ALIGNED(4);
+    gdouble horizontalAccuracyMeters ALIGNED(8);
+    gdouble verticalAccuracyMeters ALIGNED(8);
+    gdouble speedAccuracyMetersPerSecond ALIGNED(8);
+    gdouble bearingAccuracyDegrees ALIGNED(8);
+    gfloat ageSeconds ALIGNED(4);
+} ALIGNED(8) GnssDebugPosition;
+
+G_STATIC_ASSERT(sizeof(GnssDebugPosition) == 80);
+
+typedef struct gnss_debug_time {
+    gint64 timeEstimate ALIGNED(8);
+    gfloat timeUncertaintyNs ALIGNED(4);
+    gfloat frequencyUncertaintyNsPerSec ALIGNED(4);
+} ALIGNED(8) GnssDebugTime;
+
+G_STATIC_ASSERT(sizeof(GnssDebugTime) == 16);
+
+typedef struct gnss_debug_satellite {
+    gint16 svid ALIGNED(2);
+    GnssConstellationType constellation ALIGNED(1);
+    guint8 ephemerisType ALIGNED(1);
+    guint8 ephemerisSource ALIGNED(1);
+    guint8 ephemerisHealth ALIGNED(1);
+    gfloat ephemerisAgeSeconds ALIGNED(4);
+    guint8 serverPredictionIsAvailable ALIGNED(1);
+    gfloat serverPredictionAgeSeconds ALIGNED(4);
+} ALIGNED(4) GnssDebugSatellite;
+
+G_STATIC_ASSERT(sizeof(GnssDebugSatellite) == 20);
+
+typedef struct gnss_debug_data {
+    GnssDebugPosition position ALIGNED(8);
+    GnssDebugTime time ALIGNED(8);
+    GBinderHidlVec satelliteDataArray ALIGNED(8);
+} ALIGNED(8) GnssDebugData;
+
+G_STATIC_ASSERT(sizeof(GnssDebugData) == 112);
+
 typedef uint8_t AGnssType;
 typedef uint8_t AGnssStatusValue;
 
@@ -112,6 +256,11 @@ enum {
     HYBRIS_GNSS_LOCATION_HAS_BEARING_ACCURACY = 128, // 0x0080
 };
 
+enum {
+    HYBRIS_ELAPSED_REALTIME_HAS_TIMESTAMP_NS = 1, // 0x0001
+    HYBRIS_ELAPSED_REALTIME_HAS_TIME_UNCERTAINTY_NS = 2, // 0x0002
+};
+
 typedef struct agnss_status_ip_v4 {
     AGnssType type ALIGNED(1);
     AGnssStatusValue status ALIGNED(1);
@@ -128,4 +277,23 @@ typedef struct agnss_status_ip_v6 {
 
 G_STATIC_ASSERT(sizeof(AGnssStatusIpV6) == 18);
 
+typedef struct agnss_ref_location_cell_id {
+    guint8 type ALIGNED(1);
+    guint16 mcc ALIGNED(2);
+    guint16 mnc ALIGNED(2);
+    guint16 lac ALIGNED(2);
+    guint32 cid ALIGNED(4);
+    guint16 tac ALIGNED(2);
+    guint16 pcid ALIGNED(2);
+} ALIGNED(4) AGnssRefLocationCellID;
+
+G_STATIC_ASSERT(sizeof(AGnssRefLocationCellID) == 16);
+
+typedef struct agnss_ref_location {
+    guint8 type ALIGNED(1);
+    AGnssRefLocationCellID cellID ALIGNED(4);
+} ALIGNED(4) AGnssRefLocation;
+
+G_STATIC_ASSERT(sizeof(AGnssRefLocation) == 20);
+
 #endif // GNSS_BINDER_TYPES_H
@@ -0,0 +1 @@
+include($$PWD/geoclue-providers-hybris.pri)
@@ -8,15 +8,22 @@ target.path = /usr/libexec
 QT = core dbus network
 
 CONFIG += link_pkgconfig
-PKGCONFIG += connman-qt5 qofono-qt5 qofonoext systemsettings
+PKGCONFIG += connman-qt5 qofono-qt5 qofonoext systemsettings libsystemd
 
-LIBS += -lrt
+LIBS += -lrt -ldl
+
+# The backend plugins resolve the provider symbols from the executable.
+QMAKE_LFLAGS += -rdynamic
+DEFINES += GEOCLUE_HYBRIS_PLUGIN_DIR=\\\"$$[QT_INSTALL_LIBS]/geoclue-hybris\\\"
+# Outside of the home directory, the service runs with ProtectHome.
+DEFINES += GEOCLUE_HYBRIS_STATE_DIR=\\\"/var/lib/geoclue-hybris\\\"
 
 dbus_geoclue.files = \
     org.freedesktop.Geoclue.xml \
     org.freedesktop.Geoclue.Position.xml \
     org.freedesktop.Geoclue.Velocity.xml \
-    org.freedesktop.Geoclue.Satellite.xml
+    org.freedesktop.Geoclue.Satellite.xml \
+    org.freedesktop.Geoclue.Providers.Hybris.xml
 dbus_geoclue.header_flags = "-l HybrisProvider -i hybrisprovider.h"
 dbus_geoclue.source_flags = "-l HybrisProvider"
 
@@ -43,12 +50,23 @@ geoclue_provider.files = geoclue-hybris.provider
 geoclue_provider.path = /usr/share/geoclue-providers
 
 HEADERS += \
+    gnsseventqueue.h \
+    gnssmeasurementchannel.h \
+    gnssnavigationcache.h \
+    gnsswakelock.h \
+    gnsswatchdog.h \
     hybrislocationbackend.h \
     hybrisprovider.h \
     locationtypes.h
 
 SOURCES += \
     main.cpp \
+    gnsseventqueue.cpp \
+    gnssmeasurementchannel.cpp \
+    gnssnavigationcache.cpp \
+    gnsswakelock.cpp \
+    gnsswatchdog.cpp \
+    hybrislocationbackend.cpp \
     hybrisprovider.cpp
 
 OTHER_FILES = \
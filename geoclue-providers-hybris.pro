@@ -0,0 +1,19 @@
+TEMPLATE = subdirs
+
+provider.file = geoclue-hybris.pro
+SUBDIRS = provider
+
+# Each backend is built when its HAL headers are available, the provider picks one at runtime.
+packagesExist(libgbinder) {
+    SUBDIRS += binder
+    binder.file = binder/binderlocationbackend.pro
+}
+
+packagesExist(libhardware android-headers) {
+    SUBDIRS += hal
+    hal.file = hal/hallocationbackend.pro
+}
+
+OTHER_FILES = \
+    rpm/geoclue-providers-hybris.spec \
+    rpm/geoclue-providers-hybris-binder.spec
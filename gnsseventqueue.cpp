@@ -0,0 +1,92 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#include "gnsseventqueue.h"
+
+#include <errno.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+
+GnssEventQueue::GnssEventQueue()
+:   m_eventFd(eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)), m_wakeUpPending(false), m_order(0)
+{
+    if (m_eventFd == -1)
+        qFatal("Failed to create GNSS event fd, %s", strerror(errno));
+}
+
+GnssEventQueue::~GnssEventQueue()
+{
+    close(m_eventFd);
+}
+
+GnssFix *GnssEventQueue::beginFix()
+{
+    Event<GnssFix> *event = m_fixes.beginWrite();
+    event->order = m_order.fetch_add(1, std::memory_order_relaxed);
+    return &event->data;
+}
+
+void GnssEventQueue::commitFix()
+{
+    m_fixes.endWrite();
+    wakeUp();
+}
+
+GnssSatelliteEpoch *GnssEventQueue::beginSatelliteEpoch()
+{
+    Event<GnssSatelliteEpoch> *event = m_satelliteEpochs.beginWrite();
+    event->order = m_order.fetch_add(1, std::memory_order_relaxed);
+    return &event->data;
+}
+
+void GnssEventQueue::commitSatelliteEpoch()
+{
+    m_satelliteEpochs.endWrite();
+    wakeUp();
+}
+
+void GnssEventQueue::acknowledge()
+{
+    eventfd_t value;
+    eventfd_read(m_eventFd, &value);
+
+    // Cleared before draining, anything committed from now on wakes the consumer again.
+    m_wakeUpPending.store(false, std::memory_order_seq_cst);
+}
+
+bool GnssEventQueue::takeFix(GnssFix *fix, quint64 *order)
+{
+    Event<GnssFix> event;
+    if (!m_fixes.read(&event))
+        return false;
+
+    *fix = event.data;
+    *order = event.order;
+    return true;
+}
+
+bool GnssEventQueue::takeSatelliteEpoch(GnssSatelliteEpoch *epoch, quint64 *order)
+{
+    Event<GnssSatelliteEpoch> event;
+    if (!m_satelliteEpochs.read(&event))
+        return false;
+
+    *epoch = event.data;
+    *order = event.order;
+    return true;
+}
+
+void GnssEventQueue::wakeUp()
+{
+    if (!m_wakeUpPending.exchange(true, std::memory_order_seq_cst))
+        eventfd_write(m_eventFd, 1);
+}
@@ -0,0 +1,181 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#ifndef GNSSEVENTQUEUE_H
+#define GNSSEVENTQUEUE_H
+
+#include <atomic>
+
+#include <QtCore/QtGlobal>
+#include <QtCore/QMetaType>
+
+const int GnssMaxSatellites = 64;
+
+/*
+    Plain position fix as delivered by the HAL. Missing values are NaN, speed is in knots.
+    elapsedRealtimeNs is the CLOCK_BOOTTIME time of the fix, 0 if the HAL does not report it.
+*/
+struct GnssFix {
+    qint64 timestamp;
+    double latitude;
+    double longitude;
+    double altitude;
+    double speed;
+    double direction;
+    double climb;
+    double horizontalAccuracy;
+    double verticalAccuracy;
+    qint64 elapsedRealtimeNs;
+};
+
+Q_DECLARE_METATYPE(GnssFix)
+
+struct GnssSatellite {
+    int prn;
+    int elevation;
+    int azimuth;
+    int snr;
+};
+
+struct GnssSatelliteEpoch {
+    int satelliteCount;
+    GnssSatellite satellites[GnssMaxSatellites];
+    int usedCount;
+    int usedPrns[GnssMaxSatellites];
+};
+
+/*
+    Bounded single-producer/single-consumer ring of preallocated slots.
+
+    The producer never blocks and never fails: when the consumer falls behind the oldest
+    unread slot is overwritten. Each slot is guarded by a sequence number so the consumer
+    detects slots overwritten while it was copying them and accounts them as dropped.
+*/
+template <typename T, int Size>
+class GnssEventRing
+{
+public:
+    GnssEventRing() : m_head(0), m_tail(0), m_dropped(0)
+    {
+        for (int i = 0; i < Size; ++i)
+            m_slots[i].sequence.store(0, std::memory_order_relaxed);
+    }
+
+    // Producer side.
+    T *beginWrite()
+    {
+        const quint64 head = m_head.load(std::memory_order_relaxed);
+        Slot &slot = m_slots[head % Size];
+        slot.sequence.store(2 * head + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        return &slot.data;
+    }
+
+    void endWrite()
+    {
+        const quint64 head = m_head.load(std::memory_order_relaxed);
+        m_slots[head % Size].sequence.store(2 * head + 2, std::memory_order_release);
+        m_head.store(head + 1, std::memory_order_release);
+    }
+
+    // Consumer side.
+    bool read(T *data)
+    {
+        for (;;) {
+            const quint64 head = m_head.load(std::memory_order_acquire);
+            if (m_tail == head)
+                return false;
+
+            if (head - m_tail > quint64(Size)) {
+                m_dropped.fetch_add(head - m_tail - Size, std::memory_order_relaxed);
+                m_tail = head - Size;
+            }
+
+            Slot &slot = m_slots[m_tail % Size];
+            const quint64 expected = 2 * m_tail + 2;
+            const quint64 before = slot.sequence.load(std::memory_order_acquire);
+            if (before == expected) {
+                *data = slot.data;
+                std::atomic_thread_fence(std::memory_order_acquire);
+                if (slot.sequence.load(std::memory_order_relaxed) == expected) {
+                    ++m_tail;
+                    return true;
+                }
+            }
+
+            // Overwritten by the producer before or while it was read.
+            m_dropped.fetch_add(1, std::memory_order_relaxed);
+            ++m_tail;
+        }
+    }
+
+    quint64 dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<quint64> sequence;
+        T data;
+    };
+
+    Slot m_slots[Size];
+    std::atomic<quint64> m_head;
+    quint64 m_tail;
+    std::atomic<quint64> m_dropped;
+};
+
+/*
+    Carries fixes and satellite epochs from HAL callback threads to the main thread.
+
+    Producers fill a slot returned by begin*() and publish it with commit*(), which signals
+    the eventfd returned by fd() if the consumer is not already due to wake up. The
+    consumer calls acknowledge() and then drains the rings with take*(). Every event is
+    numbered when its slot is taken, so the consumer can merge both rings in the order
+    the HAL reported them.
+*/
+class GnssEventQueue
+{
+public:
+    GnssEventQueue();
+    ~GnssEventQueue();
+
+    int fd() const { return m_eventFd; }
+
+    GnssFix *beginFix();
+    void commitFix();
+
+    GnssSatelliteEpoch *beginSatelliteEpoch();
+    void commitSatelliteEpoch();
+
+    void acknowledge();
+    bool takeFix(GnssFix *fix, quint64 *order);
+    bool takeSatelliteEpoch(GnssSatelliteEpoch *epoch, quint64 *order);
+
+    quint64 droppedFixes() const { return m_fixes.dropped(); }
+    quint64 droppedSatelliteEpochs() const { return m_satelliteEpochs.dropped(); }
+
+private:
+    template <typename T>
+    struct Event {
+        quint64 order;
+        T data;
+    };
+
+    void wakeUp();
+
+    int m_eventFd;
+    std::atomic<bool> m_wakeUpPending;
+    std::atomic<quint64> m_order;
+
+    GnssEventRing<Event<GnssFix>, 16> m_fixes;
+    GnssEventRing<Event<GnssSatelliteEpoch>, 4> m_satelliteEpochs;
+};
+
+#endif // GNSSEVENTQUEUE_H
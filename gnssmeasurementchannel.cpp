@@ -0,0 +1,147 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#include "gnssmeasurementchannel.h"
+
+#include <QtCore/QByteArray>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+GnssMeasurementChannel::GnssMeasurementChannel()
+:   m_memoryFd(-1), m_size(0), m_slotsOffset(0), m_slotSize(0), m_header(Q_NULLPTR)
+{
+}
+
+GnssMeasurementChannel::~GnssMeasurementChannel()
+{
+    foreach (int eventFd, m_subscribers)
+        close(eventFd);
+
+    if (m_header)
+        munmap(m_header, m_size);
+    if (m_memoryFd != -1)
+        close(m_memoryFd);
+}
+
+bool GnssMeasurementChannel::open()
+{
+    if (m_header)
+        return true;
+
+    m_slotsOffset = (sizeof(GnssMeasurementChannelHeader) + 63) & ~size_t(63);
+    m_slotSize = (sizeof(GnssMeasurementSlot) + 63) & ~size_t(63);
+    m_size = m_slotsOffset + GnssMeasurementChannelSlots * m_slotSize;
+
+    m_memoryFd = memfd_create("geoclue-hybris-measurements", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (m_memoryFd == -1) {
+        qWarning("Failed to create GNSS measurement memory, %s", strerror(errno));
+        return false;
+    }
+
+    // Subscribers map the memory, it must never shrink under them.
+    if (ftruncate(m_memoryFd, m_size) == -1 ||
+            fcntl(m_memoryFd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) == -1) {
+        qWarning("Failed to size GNSS measurement memory, %s", strerror(errno));
+        close(m_memoryFd);
+        m_memoryFd = -1;
+        return false;
+    }
+
+    void *memory = mmap(Q_NULLPTR, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_memoryFd, 0);
+    if (memory == MAP_FAILED) {
+        qWarning("Failed to map GNSS measurement memory, %s", strerror(errno));
+        close(m_memoryFd);
+        m_memoryFd = -1;
+        return false;
+    }
+
+    // Fresh memfd pages are zeroed, which is a valid empty channel.
+    m_header = static_cast<GnssMeasurementChannelHeader *>(memory);
+    m_header->magic = GnssMeasurementChannelMagic;
+    m_header->version = GnssMeasurementChannelVersion;
+    m_header->slotCount = GnssMeasurementChannelSlots;
+    m_header->slotSize = m_slotSize;
+
+    return true;
+}
+
+/*
+    Returns a new read-only descriptor of the shared memory, owned by the caller.
+*/
+int GnssMeasurementChannel::duplicateReadOnlyFd() const
+{
+    if (m_memoryFd == -1)
+        return -1;
+
+    const QByteArray path = "/proc/self/fd/" + QByteArray::number(m_memoryFd);
+    return ::open(path.constData(), O_RDONLY | O_CLOEXEC);
+}
+
+/*
+    Returns the event fd signalled for a new subscriber, the channel keeps ownership.
+*/
+int GnssMeasurementChannel::addSubscriber()
+{
+    const int eventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (eventFd == -1)
+        return -1;
+
+    QMutexLocker locker(&m_subscribersMutex);
+    m_subscribers.append(eventFd);
+    return eventFd;
+}
+
+void GnssMeasurementChannel::removeSubscriber(int eventFd)
+{
+    QMutexLocker locker(&m_subscribersMutex);
+    if (m_subscribers.removeOne(eventFd))
+        close(eventFd);
+}
+
+bool GnssMeasurementChannel::hasSubscribers() const
+{
+    QMutexLocker locker(&m_subscribersMutex);
+    return !m_subscribers.isEmpty();
+}
+
+GnssMeasurementSlot *GnssMeasurementChannel::slot(quint64 index) const
+{
+    char *slots = reinterpret_cast<char *>(m_header) + m_slotsOffset;
+    return reinterpret_cast<GnssMeasurementSlot *>(slots + (index % GnssMeasurementChannelSlots) * m_slotSize);
+}
+
+GnssMeasurementEpoch *GnssMeasurementChannel::beginEpoch()
+{
+    if (!m_header)
+        return Q_NULLPTR;
+
+    const quint64 head = m_header->head.load(std::memory_order_relaxed);
+    GnssMeasurementSlot *current = slot(head);
+    current->sequence.store(2 * head + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    return &current->epoch;
+}
+
+void GnssMeasurementChannel::commitEpoch()
+{
+    const quint64 head = m_header->head.load(std::memory_order_relaxed);
+    slot(head)->sequence.store(2 * head + 2, std::memory_order_release);
+    m_header->head.store(head + 1, std::memory_order_release);
+
+    QMutexLocker locker(&m_subscribersMutex);
+    foreach (int eventFd, m_subscribers)
+        eventfd_write(eventFd, 1);
+}
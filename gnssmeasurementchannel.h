@@ -0,0 +1,136 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#ifndef GNSSMEASUREMENTCHANNEL_H
+#define GNSSMEASUREMENTCHANNEL_H
+
+#include <atomic>
+
+#include <QtCore/QMutex>
+#include <QtCore/QVector>
+#include <QtCore/QtGlobal>
+
+const int GnssMaxMeasurements = 64;
+
+/*
+    One measurement epoch, stored column-wise so that tools can process a single field of
+    all satellites without touching the rest. Only the first measurementCount entries of
+    each column are valid. Field meanings and units follow the HAL GnssData structure.
+*/
+struct GnssMeasurementEpoch {
+    // GnssClock
+    qint64 timeNs;
+    qint64 fullBiasNs;
+    double timeUncertaintyNs;
+    double biasNs;
+    double biasUncertaintyNs;
+    double driftNsps;
+    double driftUncertaintyNsps;
+    quint32 hwClockDiscontinuityCount;
+    quint16 clockFlags;
+    qint16 leapSecond;
+
+    quint32 measurementCount;
+    quint32 reserved;
+
+    // GnssMeasurement columns
+    qint64 receivedSvTimeNs[GnssMaxMeasurements];
+    qint64 receivedSvTimeUncertaintyNs[GnssMaxMeasurements];
+    qint64 carrierCycles[GnssMaxMeasurements];
+    double timeOffsetNs[GnssMaxMeasurements];
+    double cN0DbHz[GnssMaxMeasurements];
+    double pseudorangeRateMps[GnssMaxMeasurements];
+    double pseudorangeRateUncertaintyMps[GnssMaxMeasurements];
+    double accumulatedDeltaRangeM[GnssMaxMeasurements];
+    double accumulatedDeltaRangeUncertaintyM[GnssMaxMeasurements];
+    double carrierPhase[GnssMaxMeasurements];
+    double carrierPhaseUncertainty[GnssMaxMeasurements];
+    double snrDb[GnssMaxMeasurements];
+    double agcLevelDb[GnssMaxMeasurements];
+    float carrierFrequencyHz[GnssMaxMeasurements];
+    quint32 flags[GnssMaxMeasurements];
+    quint32 state[GnssMaxMeasurements];
+    qint32 svid[GnssMaxMeasurements];
+    quint16 accumulatedDeltaRangeState[GnssMaxMeasurements];
+    quint8 constellation[GnssMaxMeasurements];
+    quint8 multipathIndicator[GnssMaxMeasurements];
+};
+
+/*
+    Layout of the shared memory handed out by org.freedesktop.Geoclue.Providers.Hybris
+    OpenMeasurements(). The memory starts with GnssMeasurementChannelHeader followed by
+    slotCount slots of slotSize bytes, each a GnssMeasurementSlot.
+
+    Epoch n is written to slot n % slotCount. The slot sequence is 2n + 1 while the epoch
+    is written and 2n + 2 once it is complete, head is the number of completed epochs.
+    A reader copies the epoch of a slot and accepts it if the sequence is 2n + 2 both
+    before and after the copy, otherwise the epoch was overwritten and is lost. The event
+    fd returned with the memory becomes readable whenever new epochs are committed.
+*/
+const quint32 GnssMeasurementChannelMagic = 0x4d534e47; // "GNSM"
+const quint32 GnssMeasurementChannelVersion = 1;
+const int GnssMeasurementChannelSlots = 16;
+
+struct GnssMeasurementChannelHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 slotCount;
+    quint32 slotSize;
+    std::atomic<quint64> head;
+};
+
+struct GnssMeasurementSlot {
+    std::atomic<quint64> sequence;
+    quint64 reserved;
+    GnssMeasurementEpoch epoch;
+};
+
+/*
+    Producer side of the measurement channel. The shared memory is created by open(),
+    HAL callbacks fill a slot returned by beginEpoch() and publish it with commitEpoch().
+*/
+class GnssMeasurementChannel
+{
+public:
+    GnssMeasurementChannel();
+    ~GnssMeasurementChannel();
+
+    // Main thread.
+    bool open();
+    bool isOpen() const { return m_header != Q_NULLPTR; }
+
+    int duplicateReadOnlyFd() const;
+
+    int addSubscriber();
+    void removeSubscriber(int eventFd);
+    bool hasSubscribers() const;
+
+    // Producer side.
+    GnssMeasurementEpoch *beginEpoch();
+    void commitEpoch();
+
+private:
+    Q_DISABLE_COPY(GnssMeasurementChannel)
+
+    GnssMeasurementSlot *slot(quint64 index) const;
+
+    int m_memoryFd;
+    size_t m_size;
+    size_t m_slotsOffset;
+    size_t m_slotSize;
+    GnssMeasurementChannelHeader *m_header;
+
+    // Written from the main thread, signalled from HAL callback threads.
+    mutable QMutex m_subscribersMutex;
+    QVector<int> m_subscribers;
+};
+
+#endif // GNSSMEASUREMENTCHANNEL_H
@@ -0,0 +1,353 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#include "gnssnavigationcache.h"
+#include "hybrislocationbackend.h"
+
+#include <QtCore/QDir>
+#include <QtCore/QFile>
+#include <QtCore/QFileInfo>
+#include <QtCore/QSaveFile>
+
+#include <string.h>
+
+namespace
+{
+
+const qint64 GpsEpoch = Q_INT64_C(315964800000);
+const qint64 WeekLength = Q_INT64_C(604800000);
+
+// Fit interval of GPS ephemerides is 4 hours centered on toe.
+const qint64 GpsEphemerisValidity = 2 * 3600 * 1000;
+const qint64 GalileoEphemerisValidity = 4 * 3600 * 1000;
+
+const int GpsSubframeSize = 40;
+const int GalileoPageSize = 29;
+
+const quint32 GpsPreamble = 0x8b;
+
+// Subframe 4 page 18 with the UTC parameters is identified by this SV ID.
+const int GpsUtcPageSvid = 56;
+
+int ephemerisIndex(int constellation, int svid)
+{
+    if (constellation == HYBRIS_GNSS_CONSTELLATION_GPS && svid >= 1 && svid <= GnssNavigationGpsSatellites)
+        return svid - 1;
+    if (constellation == HYBRIS_GNSS_CONSTELLATION_GALILEO && svid >= 1 && svid <= GnssNavigationGalileoSatellites)
+        return GnssNavigationGpsSatellites + svid - 1;
+    return -1;
+}
+
+// Up to 32 bits starting at bit offset, MSB first.
+quint32 readBits(const quint8 *data, int offset, int count)
+{
+    quint32 value = 0;
+    for (int i = offset; i < offset + count; ++i)
+        value = (value << 1) | ((data[i / 8] >> (7 - i % 8)) & 1);
+    return value;
+}
+
+// 24 data bits of word index of a packed GPS subframe.
+quint32 gpsWord(const quint8 *subframe, int index)
+{
+    return readBits(subframe, index * 24, 24);
+}
+
+}
+
+GnssNavigationCache::GnssNavigationCache()
+:   m_leapSeconds(GnssDefaultLeapSeconds), m_dirty(false)
+{
+    memset(m_ephemerides, 0, sizeof(m_ephemerides));
+    memset(m_almanacs, 0, sizeof(m_almanacs));
+}
+
+/*
+    Returns the UTC time of a GPS/Galileo time of week closest to referenceTime. Both
+    systems share the same seconds of week.
+*/
+qint64 GnssNavigationCache::resolveTimeOfWeek(qint64 referenceTime, qint64 timeOfWeek) const
+{
+    const qint64 leapSeconds = qint64(m_leapSeconds) * 1000;
+    const qint64 gpsTime = referenceTime - GpsEpoch + leapSeconds;
+    qint64 time = gpsTime - gpsTime % WeekLength + timeOfWeek;
+    if (time - gpsTime > WeekLength / 2)
+        time -= WeekLength;
+    else if (gpsTime - time > WeekLength / 2)
+        time += WeekLength;
+
+    return time + GpsEpoch - leapSeconds;
+}
+
+void GnssNavigationCache::addMessage(int type, int svid, int status, const QByteArray &data,
+                                     qint64 receivedTime)
+{
+    if (!(status & (HYBRIS_GNSS_NAVIGATION_MESSAGE_STATUS_PARITY_PASSED |
+                    HYBRIS_GNSS_NAVIGATION_MESSAGE_STATUS_PARITY_REBUILT))) {
+        return;
+    }
+
+    switch (type) {
+    case HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_GPS_L1CA:
+        addGpsSubframe(svid, data, receivedTime);
+        break;
+    case HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_GAL_I:
+        addGalileoPage(svid, data, receivedTime);
+        break;
+    default:
+        break;
+    }
+}
+
+/*
+    GPS L1 C/A subframe of ten 30-bit words, each in the low bits of a big endian 32-bit
+    word. Data bits are transmitted inverted when the last parity bit of the previous word
+    is set, the first word is recognised by its preamble.
+*/
+void GnssNavigationCache::addGpsSubframe(int svid, const QByteArray &data, qint64 receivedTime)
+{
+    const int index = ephemerisIndex(HYBRIS_GNSS_CONSTELLATION_GPS, svid);
+    if (index == -1 || data.size() < GpsSubframeSize)
+        return;
+
+    const quint8 *raw = reinterpret_cast<const quint8 *>(data.constData());
+    quint8 subframe[GnssEphemerisSubframeSize];
+    quint32 previousParity = 0;
+
+    for (int i = 0; i < 10; ++i) {
+        const quint32 word = readBits(raw, i * 32 + 2, 30);
+        quint32 bits = word >> 6;
+
+        if (i == 0) {
+            if ((bits >> 16) == (~GpsPreamble & 0xff))
+                bits ^= 0xffffff;
+            else if ((bits >> 16) != GpsPreamble)
+                return;
+        } else if (previousParity) {
+            bits ^= 0xffffff;
+        }
+        previousParity = word & 1;
+
+        subframe[i * 3] = bits >> 16;
+        subframe[i * 3 + 1] = bits >> 8;
+        subframe[i * 3 + 2] = bits;
+    }
+
+    const int subframeId = (gpsWord(subframe, 1) >> 2) & 0x7;
+
+    if (subframeId == 4 || subframeId == 5) {
+        // Almanac pages carry the SV they describe, other pages are ignored.
+        const quint32 word3 = gpsWord(subframe, 2);
+        const int almanacSvid = (word3 >> 16) & 0x3f;
+
+        if (subframeId == 4 && almanacSvid == GpsUtcPageSvid) {
+            // Current leap seconds, delta tLS, are the first 8 bits of word 9.
+            const int leapSeconds = qint8(gpsWord(subframe, 8) >> 16);
+            if (leapSeconds != m_leapSeconds) {
+                m_leapSeconds = leapSeconds;
+                m_dirty = true;
+            }
+            return;
+        }
+
+        if (almanacSvid < 1 || almanacSvid > GnssNavigationAlmanacs)
+            return;
+
+        GnssAlmanac &almanac = m_almanacs[almanacSvid - 1];
+        const qint64 toaTime = resolveTimeOfWeek(receivedTime, qint64(gpsWord(subframe, 3) >> 16) * 4096000);
+        const quint16 health = gpsWord(subframe, 4) & 0xff;
+
+        almanac.receivedTime = receivedTime;
+        if (almanac.toaTime == toaTime && almanac.health == health)
+            return;
+
+        almanac.constellation = HYBRIS_GNSS_CONSTELLATION_GPS;
+        almanac.svid = almanacSvid;
+        almanac.toaTime = toaTime;
+        almanac.health = health;
+        memcpy(almanac.data, subframe + 6, sizeof(almanac.data));
+        m_dirty = true;
+        return;
+    }
+
+    if (subframeId < 1 || subframeId > 3)
+        return;
+
+    GnssEphemeris &ephemeris = m_ephemerides[index];
+    ephemeris.constellation = HYBRIS_GNSS_CONSTELLATION_GPS;
+    ephemeris.svid = svid;
+    ephemeris.receivedTime = receivedTime;
+    ephemeris.subframeMask |= 1 << (subframeId - 1);
+    memcpy(ephemeris.subframes[subframeId - 1], subframe, GnssEphemerisSubframeSize);
+
+    if ((ephemeris.subframeMask & 0x7) != 0x7)
+        return;
+
+    // IODC (low 8 bits) and both IODE must match for a consistent set.
+    const quint16 iodc = gpsWord(ephemeris.subframes[0], 7) >> 16;
+    const quint16 iode2 = gpsWord(ephemeris.subframes[1], 2) >> 16;
+    const quint16 iode3 = gpsWord(ephemeris.subframes[2], 9) >> 16;
+    if (iodc != iode2 || iode2 != iode3)
+        return;
+
+    const qint64 toe = qint64((gpsWord(ephemeris.subframes[1], 9) >> 8) & 0xffff) * 16000;
+    const qint64 toeTime = resolveTimeOfWeek(receivedTime, toe);
+    if (ephemeris.toeTime == toeTime && ephemeris.issue == iode2)
+        return;
+
+    ephemeris.toeTime = toeTime;
+    ephemeris.issue = iode2;
+    ephemeris.health = (gpsWord(ephemeris.subframes[0], 2) >> 2) & 0x3f;
+    m_dirty = true;
+}
+
+/*
+    Galileo E1-B I/NAV page of an even and an odd part of 114 bits each. The 128-bit word
+    is made of the 112 data bits of the even part and the first 16 data bits of the odd
+    part, ephemerides are in words 1 to 4 and health in word 5.
+*/
+void GnssNavigationCache::addGalileoPage(int svid, const QByteArray &data, qint64 receivedTime)
+{
+    const int index = ephemerisIndex(HYBRIS_GNSS_CONSTELLATION_GALILEO, svid);
+    if (index == -1 || data.size() < GalileoPageSize)
+        return;
+
+    const quint8 *page = reinterpret_cast<const quint8 *>(data.constData());
+
+    // Even part first, alert pages carry no navigation data.
+    if (readBits(page, 0, 2) != 0 || readBits(page, 114, 2) != 2)
+        return;
+
+    quint8 word[16];
+    for (int i = 0; i < 14; ++i)
+        word[i] = readBits(page, 2 + i * 8, 8);
+    word[14] = readBits(page, 116, 8);
+    word[15] = readBits(page, 124, 8);
+
+    const int wordType = word[0] >> 2;
+    if (wordType < 1 || wordType > 5)
+        return;
+
+    GnssEphemeris &ephemeris = m_ephemerides[index];
+    ephemeris.constellation = HYBRIS_GNSS_CONSTELLATION_GALILEO;
+    ephemeris.svid = svid;
+    ephemeris.receivedTime = receivedTime;
+    ephemeris.subframeMask |= 1 << (wordType - 1);
+    memset(ephemeris.subframes[wordType - 1], 0, GnssEphemerisSubframeSize);
+    memcpy(ephemeris.subframes[wordType - 1], word, sizeof(word));
+
+    if (wordType == 5) {
+        // Signal health and data validity status of E5b and E1-B.
+        const quint16 health = readBits(word, 67, 6);
+        if (ephemeris.health != health) {
+            ephemeris.health = health;
+            if (ephemeris.toeTime)
+                m_dirty = true;
+        }
+        return;
+    }
+
+    if ((ephemeris.subframeMask & 0xf) != 0xf)
+        return;
+
+    const quint16 iodNav = readBits(ephemeris.subframes[0], 6, 10);
+    for (int i = 1; i < 4; ++i) {
+        if (readBits(ephemeris.subframes[i], 6, 10) != iodNav)
+            return;
+    }
+
+    const qint64 toe = qint64(readBits(ephemeris.subframes[0], 16, 14)) * 60000;
+    const qint64 toeTime = resolveTimeOfWeek(receivedTime, toe);
+    if (ephemeris.toeTime == toeTime && ephemeris.issue == iodNav)
+        return;
+
+    ephemeris.toeTime = toeTime;
+    ephemeris.issue = iodNav;
+    m_dirty = true;
+}
+
+bool GnssNavigationCache::isEphemerisValid(const GnssEphemeris &ephemeris, qint64 currentTime) const
+{
+    if (ephemeris.toeTime == 0 || ephemeris.health != 0)
+        return false;
+
+    const qint64 validity = ephemeris.constellation == HYBRIS_GNSS_CONSTELLATION_GALILEO
+            ? GalileoEphemerisValidity : GpsEphemerisValidity;
+    return qAbs(currentTime - ephemeris.toeTime) < validity;
+}
+
+int GnssNavigationCache::validEphemerisCount(qint64 currentTime) const
+{
+    int count = 0;
+    for (int i = 0; i < GnssNavigationEphemerides; ++i) {
+        if (isEphemerisValid(m_ephemerides[i], currentTime))
+            ++count;
+    }
+    return count;
+}
+
+bool GnssNavigationCache::load(const QString &fileName)
+{
+    QFile file(fileName);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const qint64 size = sizeof(GnssNavigationCacheHeader) + sizeof(m_ephemerides) + sizeof(m_almanacs);
+    if (file.size() != size)
+        return false;
+
+    uchar *memory = file.map(0, size);
+    if (!memory)
+        return false;
+
+    const GnssNavigationCacheHeader *header = reinterpret_cast<const GnssNavigationCacheHeader *>(memory);
+    const bool valid = header->magic == GnssNavigationCacheMagic &&
+            header->version == GnssNavigationCacheVersion &&
+            header->ephemerisCount == GnssNavigationEphemerides &&
+            header->almanacCount == GnssNavigationAlmanacs;
+
+    if (valid) {
+        const uchar *entries = memory + sizeof(GnssNavigationCacheHeader);
+        memcpy(m_ephemerides, entries, sizeof(m_ephemerides));
+        memcpy(m_almanacs, entries + sizeof(m_ephemerides), sizeof(m_almanacs));
+        m_leapSeconds = header->leapSeconds;
+        m_dirty = false;
+    }
+
+    file.unmap(memory);
+    return valid;
+}
+
+bool GnssNavigationCache::save(const QString &fileName)
+{
+    QDir().mkpath(QFileInfo(fileName).path());
+
+    QSaveFile file(fileName);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    GnssNavigationCacheHeader header;
+    header.magic = GnssNavigationCacheMagic;
+    header.version = GnssNavigationCacheVersion;
+    header.ephemerisCount = GnssNavigationEphemerides;
+    header.almanacCount = GnssNavigationAlmanacs;
+    header.leapSeconds = m_leapSeconds;
+    header.reserved = 0;
+
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(reinterpret_cast<const char *>(m_ephemerides), sizeof(m_ephemerides));
+    file.write(reinterpret_cast<const char *>(m_almanacs), sizeof(m_almanacs));
+    if (!file.commit())
+        return false;
+
+    m_dirty = false;
+    return true;
+}
@@ -0,0 +1,117 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#ifndef GNSSNAVIGATIONCACHE_H
+#define GNSSNAVIGATIONCACHE_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QString>
+#include <QtCore/QtGlobal>
+
+const int GnssNavigationGpsSatellites = 32;
+const int GnssNavigationGalileoSatellites = 36;
+const int GnssNavigationEphemerides = GnssNavigationGpsSatellites + GnssNavigationGalileoSatellites;
+const int GnssNavigationAlmanacs = GnssNavigationGpsSatellites;
+
+// GPS subframes 1-3 or Galileo I/NAV words 1-5, data bits only.
+const int GnssEphemerisSubframes = 5;
+const int GnssEphemerisSubframeSize = 30;
+
+/*
+    Broadcast ephemeris of one satellite. subframes holds the latest raw data of each
+    subframe, issue, health and toeTime describe the last complete and consistent set.
+    Times are UTC milliseconds, toeTime is 0 until a complete ephemeris was received.
+*/
+struct GnssEphemeris {
+    qint64 toeTime;
+    qint64 receivedTime;
+    quint8 constellation;
+    quint8 subframeMask;
+    quint16 svid;
+    quint16 issue;
+    quint16 health;
+    quint8 subframes[GnssEphemerisSubframes][GnssEphemerisSubframeSize];
+};
+
+Q_STATIC_ASSERT(sizeof(GnssEphemeris) == 176);
+
+// GPS almanac page, data holds words 3 to 10 of the subframe.
+struct GnssAlmanac {
+    qint64 toaTime;
+    qint64 receivedTime;
+    quint8 constellation;
+    quint8 reserved;
+    quint16 svid;
+    quint16 health;
+    quint16 reserved2;
+    quint8 data[24];
+};
+
+Q_STATIC_ASSERT(sizeof(GnssAlmanac) == 48);
+
+/*
+    The cache file is a GnssNavigationCacheHeader followed by ephemerisCount GnssEphemeris
+    and almanacCount GnssAlmanac entries, in host byte order, so it can be mapped and used
+    in place.
+*/
+const quint32 GnssNavigationCacheMagic = 0x56414e47; // "GNAV"
+const quint32 GnssNavigationCacheVersion = 2;
+
+struct GnssNavigationCacheHeader {
+    quint32 magic;
+    quint32 version;
+    quint32 ephemerisCount;
+    quint32 almanacCount;
+    qint32 leapSeconds;
+    quint32 reserved;
+};
+
+Q_STATIC_ASSERT(sizeof(GnssNavigationCacheHeader) == 24);
+
+// GPS-UTC offset in seconds until the GPS UTC parameters have been received.
+const int GnssDefaultLeapSeconds = 18;
+
+/*
+    Ephemeris and almanac table filled from the navigation messages of the GNSS chip.
+    Decodes GPS L1 C/A LNAV subframes and Galileo E1-B I/NAV pages, and the GPS-UTC leap
+    seconds from the GPS UTC parameters page.
+*/
+class GnssNavigationCache
+{
+public:
+    GnssNavigationCache();
+
+    void addMessage(int type, int svid, int status, const QByteArray &data, qint64 receivedTime);
+
+    bool load(const QString &fileName);
+    bool save(const QString &fileName);
+    bool isDirty() const { return m_dirty; }
+
+    const GnssEphemeris &ephemeris(int index) const { return m_ephemerides[index]; }
+    const GnssAlmanac &almanac(int index) const { return m_almanacs[index]; }
+
+    bool isEphemerisValid(const GnssEphemeris &ephemeris, qint64 currentTime) const;
+    int validEphemerisCount(qint64 currentTime) const;
+
+    int leapSeconds() const { return m_leapSeconds; }
+
+private:
+    qint64 resolveTimeOfWeek(qint64 referenceTime, qint64 timeOfWeek) const;
+    void addGpsSubframe(int svid, const QByteArray &data, qint64 receivedTime);
+    void addGalileoPage(int svid, const QByteArray &data, qint64 receivedTime);
+
+    GnssEphemeris m_ephemerides[GnssNavigationEphemerides];
+    GnssAlmanac m_almanacs[GnssNavigationAlmanacs];
+    int m_leapSeconds;
+    bool m_dirty;
+};
+
+#endif // GNSSNAVIGATIONCACHE_H
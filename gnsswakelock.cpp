@@ -0,0 +1,144 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#include "gnsswakelock.h"
+
+#include <QtCore/QMutexLocker>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+namespace
+{
+
+// Long enough for a batch of fixes, the kernel releases the lock after this.
+const qint64 WakelockTimeoutMs = 10000;
+
+qint64 bootTimeMs()
+{
+    timespec now;
+    clock_gettime(CLOCK_BOOTTIME, &now);
+    return qint64(now.tv_sec) * 1000 + now.tv_nsec / 1000000;
+}
+
+int openControl(const QByteArray &directory, const char *name)
+{
+    const QByteArray path = directory + '/' + name;
+    int fd = open(path.constData(), O_WRONLY | O_CLOEXEC | O_APPEND);
+    if (fd == -1)
+        qWarning("Failed to open %s, GNSS wakelocks are only accounted, %s", path.constData(), strerror(errno));
+    return fd;
+}
+
+}
+
+GnssWakelock::GnssWakelock(const QByteArray &name)
+:   m_name(name), m_held(false), m_generation(0), m_acquireTime(0)
+{
+    // The executable may be setuid, the override is only honoured without elevated privileges.
+    QByteArray directory;
+    if (getuid() == geteuid() && getgid() == getegid())
+        directory = qgetenv("GEOCLUE_HYBRIS_WAKELOCK_DIR");
+    if (directory.isEmpty())
+        directory = QByteArrayLiteral("/sys/power");
+
+    m_lockFd = openControl(directory, "wake_lock");
+    m_unlockFd = openControl(directory, "wake_unlock");
+
+    memset(&m_statistics, 0, sizeof(m_statistics));
+}
+
+GnssWakelock::~GnssWakelock()
+{
+    release(generation());
+
+    if (m_lockFd != -1)
+        close(m_lockFd);
+    if (m_unlockFd != -1)
+        close(m_unlockFd);
+}
+
+void GnssWakelock::acquire()
+{
+    QMutexLocker locker(&m_mutex);
+
+    ++m_generation;
+
+    const qint64 now = bootTimeMs();
+    if (m_held) {
+        // The kernel may have dropped it already, account the previous hold as timed out.
+        if (now - m_acquireTime >= WakelockTimeoutMs)
+            account(now);
+        else
+            return;
+    }
+
+    m_held = true;
+    m_acquireTime = now;
+    ++m_statistics.acquireCount;
+
+    write(m_lockFd, m_name + ' ' + QByteArray::number(WakelockTimeoutMs * 1000000));
+}
+
+quint32 GnssWakelock::generation() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_generation;
+}
+
+void GnssWakelock::release(quint32 generation)
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_held || generation != m_generation)
+        return;
+
+    account(bootTimeMs());
+    write(m_unlockFd, m_name);
+}
+
+GnssWakelockStatistics GnssWakelock::statistics() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_statistics;
+}
+
+void GnssWakelock::write(int fd, const QByteArray &data)
+{
+    if (fd == -1)
+        return;
+
+    if (::write(fd, data.constData(), data.length()) == -1)
+        qWarning("Failed to update GNSS wakelock, %s", strerror(errno));
+}
+
+// Called with the mutex held.
+void GnssWakelock::account(qint64 now)
+{
+    m_held = false;
+
+    qint64 holdTime = now - m_acquireTime;
+    if (holdTime >= WakelockTimeoutMs) {
+        ++m_statistics.timeoutCount;
+        holdTime = WakelockTimeoutMs;
+    }
+
+    m_statistics.totalHoldTimeMs += holdTime;
+    m_statistics.longestHoldTimeMs = qMax(m_statistics.longestHoldTimeMs, holdTime);
+
+    int bucket = 0;
+    while (bucket < GnssWakelockBuckets - 1 && holdTime >= GnssWakelockBucketLimits[bucket])
+        ++bucket;
+    ++m_statistics.histogram[bucket];
+}
@@ -0,0 +1,71 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#ifndef GNSSWAKELOCK_H
+#define GNSSWAKELOCK_H
+
+#include <QtCore/QByteArray>
+#include <QtCore/QMutex>
+#include <QtCore/QtGlobal>
+
+// Upper bounds in milliseconds of the hold time buckets, the last bucket is unbounded.
+const int GnssWakelockBuckets = 5;
+const qint64 GnssWakelockBucketLimits[GnssWakelockBuckets - 1] = { 10, 100, 1000, 5000 };
+
+struct GnssWakelockStatistics {
+    quint32 acquireCount;
+    quint32 timeoutCount;
+    qint64 totalHoldTimeMs;
+    qint64 longestHoldTimeMs;
+    quint32 histogram[GnssWakelockBuckets];
+};
+
+/*
+    Suspend blocker held on behalf of the GNSS HAL while it delivers data. Like the Android
+    location service it is not reference counted. Each acquire() returns a new generation and
+    release() is ignored when the lock was acquired again since that generation was read, so a
+    release deferred to another thread does not drop a newer hold.
+
+    The lock is taken through /sys/power/wake_lock with a timeout, so a HAL which never
+    releases it cannot keep the device awake. The GEOCLUE_HYBRIS_WAKELOCK_DIR environment
+    variable points wake_lock and wake_unlock to existing plain files instead, it is ignored
+    when the process runs setuid or setgid.
+
+    acquire() and release() may be called from any thread.
+*/
+class GnssWakelock
+{
+public:
+    explicit GnssWakelock(const QByteArray &name);
+    ~GnssWakelock();
+
+    void acquire();
+    quint32 generation() const;
+    void release(quint32 generation);
+
+    GnssWakelockStatistics statistics() const;
+
+private:
+    void write(int fd, const QByteArray &data);
+    void account(qint64 now);
+
+    const QByteArray m_name;
+    int m_lockFd;
+    int m_unlockFd;
+
+    mutable QMutex m_mutex;
+    bool m_held;
+    quint32 m_generation;
+    qint64 m_acquireTime;
+    GnssWakelockStatistics m_statistics;
+};
+
+#endif // GNSSWAKELOCK_H
@@ -0,0 +1,417 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#include "gnsswatchdog.h"
+#include "hybrisprovider.h"
+
+#include <QtCore/QElapsedTimer>
+
+#include <algorithm>
+
+#include <string.h>
+
+#include <systemd/sd-daemon.h>
+
+namespace
+{
+
+// Deadlines of the calls, most only pass a request to the chip.
+const int FastDeadline = 200;
+const int SlowDeadline = 2000;
+const int InitDeadline = 10000;
+
+// Calls in a row exceeding their deadline before the provider exits to be restarted.
+const int MaximumConsecutiveTimeouts = 3;
+
+double percentile(const QVector<qint64> &sorted, int percent)
+{
+    const int index = qMin(sorted.count() - 1, sorted.count() * percent / 100);
+    return sorted.at(index) / 1000000.0;
+}
+
+}
+
+GnssWatchdog::GnssWatchdog()
+:   m_consecutiveTimeouts(0), m_systemdInterval(0)
+{
+    // Notified twice per period, as recommended by sd_watchdog_enabled(3).
+    uint64_t usec = 0;
+    if (sd_watchdog_enabled(0, &usec) > 0)
+        m_systemdInterval = qMax<int>(1, usec / 2000);
+}
+
+bool GnssWatchdog::callFinished(const char *method, int deadlineMs, qint64 elapsedNs)
+{
+    Samples &samples = m_samples[QByteArray::fromRawData(method, strlen(method))];
+    samples.elapsedNs[samples.count % GnssCallSamples] = elapsedNs;
+    ++samples.count;
+
+    if (elapsedNs < qint64(deadlineMs) * 1000000) {
+        m_consecutiveTimeouts = 0;
+        return false;
+    }
+
+    ++samples.timeouts;
+    qWarning("GNSS backend call %s took %lld ms, deadline %d ms", method, elapsedNs / 1000000, deadlineMs);
+
+    if (++m_consecutiveTimeouts < MaximumConsecutiveTimeouts)
+        return false;
+
+    m_consecutiveTimeouts = 0;
+    return true;
+}
+
+QVector<GnssCallStatistics> GnssWatchdog::statistics() const
+{
+    QVector<GnssCallStatistics> statistics;
+
+    for (QHash<QByteArray, Samples>::const_iterator it = m_samples.begin(); it != m_samples.end(); ++it) {
+        const int count = qMin<quint64>(it->count, GnssCallSamples);
+        QVector<qint64> sorted(count);
+        std::copy(it->elapsedNs, it->elapsedNs + count, sorted.begin());
+        std::sort(sorted.begin(), sorted.end());
+
+        GnssCallStatistics call;
+        call.method = it.key();
+        call.count = it->count;
+        call.timeouts = it->timeouts;
+        call.p50Ms = percentile(sorted, 50);
+        call.p99Ms = percentile(sorted, 99);
+        call.maximumMs = sorted.last() / 1000000.0;
+        statistics.append(call);
+    }
+
+    return statistics;
+}
+
+void GnssWatchdog::notifySystemd()
+{
+    sd_notify(0, "WATCHDOG=1");
+}
+
+class GnssWatchdogBackend::Call
+{
+public:
+    Call(GnssWatchdogBackend *backend, const char *method, int deadlineMs)
+    :   m_watchdog(backend->m_watchdog), m_method(method), m_deadlineMs(deadlineMs)
+    {
+        m_timer.start();
+    }
+
+    ~Call()
+    {
+        if (m_watchdog->callFinished(m_method, m_deadlineMs, m_timer.nsecsElapsed()))
+            QMetaObject::invokeMethod(staticProvider, "gnssBackendWedged", Qt::QueuedConnection);
+    }
+
+private:
+    GnssWatchdog *m_watchdog;
+    const char *m_method;
+    int m_deadlineMs;
+    QElapsedTimer m_timer;
+};
+
+GnssWatchdogBackend::GnssWatchdogBackend(HybrisLocationBackend *backend, GnssWatchdog *watchdog)
+:   m_backend(backend), m_watchdog(watchdog)
+{
+}
+
+GnssWatchdogBackend::~GnssWatchdogBackend()
+{
+    delete m_backend;
+}
+
+// Gnss
+bool GnssWatchdogBackend::gnssInit()
+{
+    Call call(this, "gnssInit", InitDeadline);
+    return m_backend->gnssInit();
+}
+
+bool GnssWatchdogBackend::gnssStart()
+{
+    Call call(this, "gnssStart", SlowDeadline);
+    return m_backend->gnssStart();
+}
+
+bool GnssWatchdogBackend::gnssStop()
+{
+    Call call(this, "gnssStop", SlowDeadline);
+    return m_backend->gnssStop();
+}
+
+void GnssWatchdogBackend::gnssCleanup()
+{
+    Call call(this, "gnssCleanup", SlowDeadline);
+    m_backend->gnssCleanup();
+}
+
+bool GnssWatchdogBackend::gnssInjectTime(HybrisGnssUtcTime timeMs, int64_t timeReferenceMs,
+                                         int32_t uncertaintyMs)
+{
+    Call call(this, "gnssInjectTime", FastDeadline);
+    return m_backend->gnssInjectTime(timeMs, timeReferenceMs, uncertaintyMs);
+}
+
+bool GnssWatchdogBackend::gnssInjectLocation(double latitudeDegrees, double longitudeDegrees,
+                                             float accuracyMeters)
+{
+    Call call(this, "gnssInjectLocation", FastDeadline);
+    return m_backend->gnssInjectLocation(latitudeDegrees, longitudeDegrees, accuracyMeters);
+}
+
+void GnssWatchdogBackend::gnssDeleteAidingData(HybrisGnssAidingData aidingDataFlags)
+{
+    Call call(this, "gnssDeleteAidingData", FastDeadline);
+    m_backend->gnssDeleteAidingData(aidingDataFlags);
+}
+
+bool GnssWatchdogBackend::gnssSetPositionMode(HybrisGnssPositionMode mode,
+                                              HybrisGnssPositionRecurrence recurrence,
+                                              uint32_t minIntervalMs, uint32_t preferredAccuracyMeters,
+                                              uint32_t preferredTimeMs, bool lowPowerMode)
+{
+    Call call(this, "gnssSetPositionMode", FastDeadline);
+    return m_backend->gnssSetPositionMode(mode, recurrence, minIntervalMs, preferredAccuracyMeters,
+                                          preferredTimeMs, lowPowerMode);
+}
+
+// GnssBatching
+bool GnssWatchdogBackend::gnssBatchingInit()
+{
+    Call call(this, "gnssBatchingInit", SlowDeadline);
+    return m_backend->gnssBatchingInit();
+}
+
+int GnssWatchdogBackend::gnssBatchingGetBatchSize()
+{
+    Call call(this, "gnssBatchingGetBatchSize", FastDeadline);
+    return m_backend->gnssBatchingGetBatchSize();
+}
+
+bool GnssWatchdogBackend::gnssBatchingStart(int64_t periodNanos, bool wakeUpOnFifoFull)
+{
+    Call call(this, "gnssBatchingStart", SlowDeadline);
+    return m_backend->gnssBatchingStart(periodNanos, wakeUpOnFifoFull);
+}
+
+void GnssWatchdogBackend::gnssBatchingFlush()
+{
+    Call call(this, "gnssBatchingFlush", FastDeadline);
+    m_backend->gnssBatchingFlush();
+}
+
+bool GnssWatchdogBackend::gnssBatchingStop()
+{
+    Call call(this, "gnssBatchingStop", SlowDeadline);
+    return m_backend->gnssBatchingStop();
+}
+
+// GnssMeasurement
+bool GnssWatchdogBackend::gnssMeasurementStart()
+{
+    Call call(this, "gnssMeasurementStart", SlowDeadline);
+    return m_backend->gnssMeasurementStart();
+}
+
+void GnssWatchdogBackend::gnssMeasurementStop()
+{
+    Call call(this, "gnssMeasurementStop", SlowDeadline);
+    m_backend->gnssMeasurementStop();
+}
+
+// GnssNavigationMessage
+bool GnssWatchdogBackend::gnssNavigationMessageStart()
+{
+    Call call(this, "gnssNavigationMessageStart", SlowDeadline);
+    return m_backend->gnssNavigationMessageStart();
+}
+
+void GnssWatchdogBackend::gnssNavigationMessageStop()
+{
+    Call call(this, "gnssNavigationMessageStop", SlowDeadline);
+    m_backend->gnssNavigationMessageStop();
+}
+
+// GnssGeofencing
+bool GnssWatchdogBackend::gnssGeofencingInit()
+{
+    Call call(this, "gnssGeofencingInit", SlowDeadline);
+    return m_backend->gnssGeofencingInit();
+}
+
+bool GnssWatchdogBackend::gnssGeofenceAdd(int32_t geofenceId, double latitudeDegrees,
+                                          double longitudeDegrees, double radiusMeters,
+                                          int32_t lastTransition, int32_t monitorTransitions,
+                                          uint32_t notificationResponsivenessMs, uint32_t unknownTimerMs)
+{
+    Call call(this, "gnssGeofenceAdd", FastDeadline);
+    return m_backend->gnssGeofenceAdd(geofenceId, latitudeDegrees, longitudeDegrees, radiusMeters,
+                                      lastTransition, monitorTransitions,
+                                      notificationResponsivenessMs, unknownTimerMs);
+}
+
+bool GnssWatchdogBackend::gnssGeofencePause(int32_t geofenceId)
+{
+    Call call(this, "gnssGeofencePause", FastDeadline);
+    return m_backend->gnssGeofencePause(geofenceId);
+}
+
+bool GnssWatchdogBackend::gnssGeofenceResume(int32_t geofenceId, int32_t monitorTransitions)
+{
+    Call call(this, "gnssGeofenceResume", FastDeadline);
+    return m_backend->gnssGeofenceResume(geofenceId, monitorTransitions);
+}
+
+bool GnssWatchdogBackend::gnssGeofenceRemove(int32_t geofenceId)
+{
+    Call call(this, "gnssGeofenceRemove", FastDeadline);
+    return m_backend->gnssGeofenceRemove(geofenceId);
+}
+
+// GnssConfiguration
+bool GnssWatchdogBackend::gnssConfigurationInit()
+{
+    Call call(this, "gnssConfigurationInit", SlowDeadline);
+    return m_backend->gnssConfigurationInit();
+}
+
+bool GnssWatchdogBackend::gnssConfigurationSetSuplMode(uint8_t suplMode)
+{
+    Call call(this, "gnssConfigurationSetSuplMode", FastDeadline);
+    return m_backend->gnssConfigurationSetSuplMode(suplMode);
+}
+
+bool GnssWatchdogBackend::gnssConfigurationSetLppProfile(uint8_t lppProfile)
+{
+    Call call(this, "gnssConfigurationSetLppProfile", FastDeadline);
+    return m_backend->gnssConfigurationSetLppProfile(lppProfile);
+}
+
+bool GnssWatchdogBackend::gnssConfigurationSetGlonassPositioningProtocol(uint8_t protocol)
+{
+    Call call(this, "gnssConfigurationSetGlonassPositioningProtocol", FastDeadline);
+    return m_backend->gnssConfigurationSetGlonassPositioningProtocol(protocol);
+}
+
+bool GnssWatchdogBackend::gnssConfigurationSetBlacklist(
+        const QVector<HybrisGnssConstellationType> &constellations)
+{
+    Call call(this, "gnssConfigurationSetBlacklist", FastDeadline);
+    return m_backend->gnssConfigurationSetBlacklist(constellations);
+}
+
+// GnssDebug
+void GnssWatchdogBackend::gnssDebugInit()
+{
+    Call call(this, "gnssDebugInit", SlowDeadline);
+    m_backend->gnssDebugInit();
+}
+
+bool GnssWatchdogBackend::gnssDebugRequestData()
+{
+    Call call(this, "gnssDebugRequestData", FastDeadline);
+    return m_backend->gnssDebugRequestData();
+}
+
+QVector<HybrisGnssThreadInfo> GnssWatchdogBackend::gnssDebugThreads()
+{
+    // Answered by the backend itself, not the HAL.
+    return m_backend->gnssDebugThreads();
+}
+
+// GnnNi
+void GnssWatchdogBackend::gnssNiInit()
+{
+    Call call(this, "gnssNiInit", SlowDeadline);
+    m_backend->gnssNiInit();
+}
+
+void GnssWatchdogBackend::gnssNiRespond(int32_t notifId, HybrisGnssUserResponseType userResponse)
+{
+    Call call(this, "gnssNiRespond", FastDeadline);
+    m_backend->gnssNiRespond(notifId, userResponse);
+}
+
+// GnssXtra
+void GnssWatchdogBackend::gnssXtraInit()
+{
+    Call call(this, "gnssXtraInit", SlowDeadline);
+    m_backend->gnssXtraInit();
+}
+
+bool GnssWatchdogBackend::gnssXtraInjectXtraData(QByteArray &xtraData)
+{
+    Call call(this, "gnssXtraInjectXtraData", SlowDeadline);
+    return m_backend->gnssXtraInjectXtraData(xtraData);
+}
+
+// AGnss
+void GnssWatchdogBackend::aGnssInit()
+{
+    Call call(this, "aGnssInit", SlowDeadline);
+    m_backend->aGnssInit();
+}
+
+bool GnssWatchdogBackend::aGnssDataConnClosed()
+{
+    Call call(this, "aGnssDataConnClosed", FastDeadline);
+    return m_backend->aGnssDataConnClosed();
+}
+
+bool GnssWatchdogBackend::aGnssDataConnFailed()
+{
+    Call call(this, "aGnssDataConnFailed", FastDeadline);
+    return m_backend->aGnssDataConnFailed();
+}
+
+bool GnssWatchdogBackend::aGnssDataConnOpen(const QByteArray &apn, const QString &protocol)
+{
+    Call call(this, "aGnssDataConnOpen", FastDeadline);
+    return m_backend->aGnssDataConnOpen(apn, protocol);
+}
+
+int GnssWatchdogBackend::aGnssSetServer(HybrisAGnssType type, const char *hostname, int port)
+{
+    Call call(this, "aGnssSetServer", FastDeadline);
+    return m_backend->aGnssSetServer(type, hostname, port);
+}
+
+// AGnssRil
+void GnssWatchdogBackend::aGnssRilInit()
+{
+    Call call(this, "aGnssRilInit", SlowDeadline);
+    m_backend->aGnssRilInit();
+}
+
+bool GnssWatchdogBackend::aGnssRilSetRefLocation(const HybrisAGnssRefLocation &location)
+{
+    Call call(this, "aGnssRilSetRefLocation", FastDeadline);
+    return m_backend->aGnssRilSetRefLocation(location);
+}
+
+bool GnssWatchdogBackend::aGnssRilSetSetId(HybrisAGnssSetIDType type, const QByteArray &setId)
+{
+    Call call(this, "aGnssRilSetSetId", FastDeadline);
+    return m_backend->aGnssRilSetSetId(type, setId);
+}
+
+bool GnssWatchdogBackend::aGnssRilUpdateNetworkState(bool connected, HybrisNetworkType type, bool roaming)
+{
+    Call call(this, "aGnssRilUpdateNetworkState", FastDeadline);
+    return m_backend->aGnssRilUpdateNetworkState(connected, type, roaming);
+}
+
+bool GnssWatchdogBackend::aGnssRilUpdateNetworkAvailability(bool available, const QByteArray &apn)
+{
+    Call call(this, "aGnssRilUpdateNetworkAvailability", FastDeadline);
+    return m_backend->aGnssRilUpdateNetworkAvailability(available, apn);
+}
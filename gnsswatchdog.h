@@ -0,0 +1,157 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#ifndef GNSSWATCHDOG_H
+#define GNSSWATCHDOG_H
+
+#include "hybrislocationbackend.h"
+
+#include <QtCore/QByteArray>
+#include <QtCore/QHash>
+#include <QtCore/QVector>
+
+const int GnssCallSamples = 128;
+
+// Latencies are in milliseconds, over the last GnssCallSamples calls.
+struct GnssCallStatistics {
+    QByteArray method;
+    quint64 count;
+    quint32 timeouts;
+    double p50Ms;
+    double p99Ms;
+    double maximumMs;
+};
+
+/*
+    Accounts the latency of the calls into the GNSS backend against per method deadlines.
+    A call blocked in the vendor library cannot be interrupted, it is only detected once it
+    returns. If it never returns, the systemd watchdog notifications sent from the event loop
+    stop and systemd restarts the provider.
+
+    The binder backend only queues most calls and sends them asynchronously, for it the
+    deadlines time the queueing and not the HAL. A HAL that stops replying there shows up
+    in the command queue, not in these statistics.
+*/
+class GnssWatchdog
+{
+public:
+    GnssWatchdog();
+
+    // Returns true when calls exceeded their deadline often enough to restart the provider.
+    bool callFinished(const char *method, int deadlineMs, qint64 elapsedNs);
+    QVector<GnssCallStatistics> statistics() const;
+
+    // Interval of the systemd watchdog notifications in milliseconds, 0 when not enabled.
+    int systemdInterval() const { return m_systemdInterval; }
+    void notifySystemd();
+
+private:
+    struct Samples {
+        Samples() : count(0), timeouts(0) {}
+
+        quint64 count;
+        quint32 timeouts;
+        qint64 elapsedNs[GnssCallSamples];
+    };
+
+    QHash<QByteArray, Samples> m_samples;
+    int m_consecutiveTimeouts;
+    int m_systemdInterval;
+};
+
+/*
+    Forwards every call to the backend and reports its latency to the watchdog. Takes
+    ownership of the backend. Calls are made from the provider thread only.
+*/
+class GnssWatchdogBackend : public HybrisLocationBackend
+{
+public:
+    GnssWatchdogBackend(HybrisLocationBackend *backend, GnssWatchdog *watchdog);
+    ~GnssWatchdogBackend();
+
+    // Gnss
+    bool gnssInit();
+    bool gnssStart();
+    bool gnssStop();
+    void gnssCleanup();
+    bool gnssInjectTime(HybrisGnssUtcTime timeMs, int64_t timeReferenceMs, int32_t uncertaintyMs);
+    bool gnssInjectLocation(double latitudeDegrees, double longitudeDegrees, float accuracyMeters);
+    void gnssDeleteAidingData(HybrisGnssAidingData aidingDataFlags);
+    bool gnssSetPositionMode(HybrisGnssPositionMode mode, HybrisGnssPositionRecurrence recurrence,
+                             uint32_t minIntervalMs, uint32_t preferredAccuracyMeters,
+                             uint32_t preferredTimeMs, bool lowPowerMode);
+
+    // GnssBatching
+    bool gnssBatchingInit();
+    int gnssBatchingGetBatchSize();
+    bool gnssBatchingStart(int64_t periodNanos, bool wakeUpOnFifoFull);
+    void gnssBatchingFlush();
+    bool gnssBatchingStop();
+
+    // GnssMeasurement
+    bool gnssMeasurementStart();
+    void gnssMeasurementStop();
+
+    // GnssNavigationMessage
+    bool gnssNavigationMessageStart();
+    void gnssNavigationMessageStop();
+
+    // GnssGeofencing
+    bool gnssGeofencingInit();
+    bool gnssGeofenceAdd(int32_t geofenceId, double latitudeDegrees, double longitudeDegrees,
+                         double radiusMeters, int32_t lastTransition, int32_t monitorTransitions,
+                         uint32_t notificationResponsivenessMs, uint32_t unknownTimerMs);
+    bool gnssGeofencePause(int32_t geofenceId);
+    bool gnssGeofenceResume(int32_t geofenceId, int32_t monitorTransitions);
+    bool gnssGeofenceRemove(int32_t geofenceId);
+
+    // GnssConfiguration
+    bool gnssConfigurationInit();
+    bool gnssConfigurationSetSuplMode(uint8_t suplMode);
+    bool gnssConfigurationSetLppProfile(uint8_t lppProfile);
+    bool gnssConfigurationSetGlonassPositioningProtocol(uint8_t protocol);
+    bool gnssConfigurationSetBlacklist(const QVector<HybrisGnssConstellationType> &constellations);
+
+    // GnssDebug
+    void gnssDebugInit();
+    bool gnssDebugRequestData();
+    QVector<HybrisGnssThreadInfo> gnssDebugThreads();
+
+    // GnnNi
+    void gnssNiInit();
+    void gnssNiRespond(int32_t notifId, HybrisGnssUserResponseType userResponse);
+
+    // GnssXtra
+    void gnssXtraInit();
+    bool gnssXtraInjectXtraData(QByteArray &xtraData);
+
+    // AGnss
+    void aGnssInit();
+    bool aGnssDataConnClosed();
+    bool aGnssDataConnFailed();
+    bool aGnssDataConnOpen(const QByteArray &apn, const QString &protocol);
+    int aGnssSetServer(HybrisAGnssType type, const char* hostname, int port);
+
+    // AGnssRil
+    void aGnssRilInit();
+    bool aGnssRilSetRefLocation(const HybrisAGnssRefLocation &location);
+    bool aGnssRilSetSetId(HybrisAGnssSetIDType type, const QByteArray &setId);
+    bool aGnssRilUpdateNetworkState(bool connected, HybrisNetworkType type, bool roaming);
+    bool aGnssRilUpdateNetworkAvailability(bool available, const QByteArray &apn);
+
+private:
+    class Call;
+
+    HybrisLocationBackend *m_backend;
+    GnssWatchdog *m_watchdog;
+};
+
+#endif // GNSSWATCHDOG_H
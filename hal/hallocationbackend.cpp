@@ -14,12 +14,17 @@
 
 #include "hybrisprovider.h"
 
+#include <QtCore/QMutex>
+#include <QtCore/QSettings>
 #include <QtNetwork/QHostAddress>
 
 #include <android-config.h>
 
 #include <errno.h>
 #include <grp.h>
+#include <pthread.h>
+#include <sched.h>
+#include <string.h>
 #include <strings.h>
 #include <sys/time.h>
 #include <sys/types.h>
@@ -36,9 +41,15 @@
     // By default expects Android 4.1
 #endif
 
-HybrisLocationBackend *getLocationBackend()
+extern "C" Q_DECL_EXPORT bool hybrisLocationBackendProbe()
 {
-    return qobject_cast<HybrisLocationBackend *>(new HalLocationBackend());
+    const hw_module_t *hwModule;
+    return hw_get_module(GPS_HARDWARE_MODULE_ID, &hwModule) == 0;
+}
+
+extern "C" Q_DECL_EXPORT HybrisLocationBackend *hybrisLocationBackendCreate()
+{
+    return new HalLocationBackend();
 }
 
 namespace
@@ -46,39 +57,168 @@ namespace
 
 const double MpsToKnots = 1.943844;
 
-void locationCallback(GpsLocation *location)
+// Shared with the provider, the [threads] group configures the threads started by the HAL.
+const QString ThreadConfigFile = QStringLiteral("/etc/gps_xtra.ini");
+const int MaximumThreadNameLength = 15;
+
+/*
+    Scheduling of the HAL threads, by default they inherit it from the provider. policy is
+    one of other, batch, idle, fifo or rr, priority applies to fifo and rr and cpus is a list
+    of CPUs and CPU ranges such as 0-3,6.
+*/
+struct HalThreadConfig {
+    HalThreadConfig() : policy(SCHED_OTHER), priority(0), explicitScheduling(false), affinity(false)
+    {
+        CPU_ZERO(&cpus);
+    }
+
+    int policy;
+    int priority;
+    bool explicitScheduling;
+    bool affinity;
+    cpu_set_t cpus;
+} halThreadConfig;
+
+/*
+    Threads started through createThreadCallback(). Entries are kept after the thread exits,
+    so the CPU time spent by short lived threads is still accounted for.
+*/
+struct HalThread {
+    QByteArray name;
+    void (*start)(void *);
+    void *arg;
+    pthread_t thread;
+    clockid_t cpuClock;
+    bool running;
+    qint64 cpuTimeNs;
+    QAtomicInt callbacks;
+};
+
+QMutex halThreadsMutex;
+QVector<HalThread *> halThreads;
+// Callbacks made on threads of the vendor library which were not created through the HAL.
+QAtomicInt otherThreadCallbacks;
+__thread HalThread *currentHalThread = Q_NULLPTR;
+
+void loadThreadConfig()
 {
-    Location loc;
+    QSettings settings(ThreadConfigFile, QSettings::IniFormat);
+    settings.beginGroup(QStringLiteral("threads"));
+
+    const QString policy = settings.value(QStringLiteral("policy")).toString();
+    if (policy == QLatin1String("batch"))
+        halThreadConfig.policy = SCHED_BATCH;
+    else if (policy == QLatin1String("idle"))
+        halThreadConfig.policy = SCHED_IDLE;
+    else if (policy == QLatin1String("fifo"))
+        halThreadConfig.policy = SCHED_FIFO;
+    else if (policy == QLatin1String("rr"))
+        halThreadConfig.policy = SCHED_RR;
+    else if (!policy.isEmpty() && policy != QLatin1String("other"))
+        qWarning("Unknown HAL thread scheduling policy %s", qPrintable(policy));
+    halThreadConfig.explicitScheduling = !policy.isEmpty();
+
+    if (halThreadConfig.policy == SCHED_FIFO || halThreadConfig.policy == SCHED_RR) {
+        halThreadConfig.priority = qBound(sched_get_priority_min(halThreadConfig.policy),
+                                          settings.value(QStringLiteral("priority"), 1).toInt(),
+                                          sched_get_priority_max(halThreadConfig.policy));
+    }
+
+    const QStringList cpus = settings.value(QStringLiteral("cpus")).toString()
+            .split(QLatin1Char(','), QString::SkipEmptyParts);
+    foreach (const QString &range, cpus) {
+        const QStringList bounds = range.trimmed().split(QLatin1Char('-'));
+        bool firstOk = false;
+        bool lastOk = true;
+        const int first = bounds.first().toInt(&firstOk);
+        const int last = bounds.count() > 1 ? bounds.at(1).toInt(&lastOk) : first;
+        if (bounds.count() > 2 || !firstOk || !lastOk || first < 0 || last >= CPU_SETSIZE) {
+            qWarning("Invalid HAL thread CPU range %s", qPrintable(range));
+            continue;
+        }
+        for (int cpu = first; cpu <= last; ++cpu)
+            CPU_SET(cpu, &halThreadConfig.cpus);
+        halThreadConfig.affinity = true;
+    }
+
+    if (halThreadConfig.explicitScheduling || halThreadConfig.affinity) {
+        qCDebug(lcGeoclueHybris) << "HAL thread policy" << halThreadConfig.policy
+                                 << "priority" << halThreadConfig.priority
+                                 << "CPUs" << cpus;
+    }
+}
+
+void countCallback()
+{
+    if (currentHalThread)
+        currentHalThread->callbacks.ref();
+    else
+        otherThreadCallbacks.ref();
+}
+
+void *halThreadStart(void *data)
+{
+    HalThread *thread = static_cast<HalThread *>(data);
+    currentHalThread = thread;
+
+    thread->start(thread->arg);
+
+    timespec cpuTime;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTime);
+
+    QMutexLocker locker(&halThreadsMutex);
+    thread->cpuTimeNs = qint64(cpuTime.tv_sec) * 1000000000 + cpuTime.tv_nsec;
+    thread->running = false;
 
-    loc.setTimestamp(location->timestamp);
+    return Q_NULLPTR;
+}
+
+void decodeGpsLocation(const GpsLocation *location, GnssFix *fix)
+{
+    fix->timestamp = location->timestamp;
+    fix->latitude = qQNaN();
+    fix->longitude = qQNaN();
+    fix->altitude = qQNaN();
+    fix->speed = qQNaN();
+    fix->direction = qQNaN();
+    fix->climb = qQNaN();
+    fix->horizontalAccuracy = qQNaN();
+    fix->verticalAccuracy = qQNaN();
+    fix->elapsedRealtimeNs = 0;
 
     if (location->flags & GPS_LOCATION_HAS_LAT_LONG) {
-        loc.setLatitude(location->latitude);
-        loc.setLongitude(location->longitude);
+        fix->latitude = location->latitude;
+        fix->longitude = location->longitude;
     }
 
     if (location->flags & GPS_LOCATION_HAS_ALTITUDE)
-        loc.setAltitude(location->altitude);
+        fix->altitude = location->altitude;
 
     if (location->flags & GPS_LOCATION_HAS_SPEED)
-        loc.setSpeed(location->speed * MpsToKnots);
+        fix->speed = location->speed * MpsToKnots;
 
     if (location->flags & GPS_LOCATION_HAS_BEARING)
-        loc.setDirection(location->bearing);
+        fix->direction = location->bearing;
 
     if (location->flags & GPS_LOCATION_HAS_ACCURACY) {
-        Accuracy accuracy;
-        accuracy.setHorizontal(location->accuracy);
-        accuracy.setVertical(location->accuracy);
-        loc.setAccuracy(accuracy);
+        fix->horizontalAccuracy = location->accuracy;
+        fix->verticalAccuracy = location->accuracy;
     }
+}
 
-    QMetaObject::invokeMethod(staticProvider, "setLocation", Qt::QueuedConnection,
-                              Q_ARG(Location, loc));
+void locationCallback(GpsLocation *location)
+{
+    countCallback();
+
+    GnssEventQueue *events = staticProvider->gnssEvents();
+    decodeGpsLocation(location, events->beginFix());
+    events->commitFix();
 }
 
 void statusCallback(GpsStatus *status)
 {
+    countCallback();
+
     switch (status->status) {
     case GPS_STATUS_ENGINE_ON:
         QMetaObject::invokeMethod(staticProvider, "engineOn", Qt::QueuedConnection);
@@ -93,83 +233,77 @@ void statusCallback(GpsStatus *status)
 
 void svStatusCallback(GpsSvStatus *svStatus)
 {
-    QList<SatelliteInfo> satellites;
-    QList<int> usedPrns;
+    countCallback();
 
-    for (int i = 0; i < svStatus->num_svs; ++i) {
-        SatelliteInfo satInfo;
+    GnssEventQueue *events = staticProvider->gnssEvents();
+    GnssSatelliteEpoch *epoch = events->beginSatelliteEpoch();
+
+    epoch->satelliteCount = 0;
+    epoch->usedCount = 0;
+
+    for (int i = 0; i < svStatus->num_svs && i < GnssMaxSatellites; ++i) {
+        GnssSatellite &satellite = epoch->satellites[epoch->satelliteCount++];
         GpsSvInfo &svInfo = svStatus->sv_list[i];
-        satInfo.setPrn(svInfo.prn);
-        satInfo.setSnr(svInfo.snr);
-        satInfo.setElevation(svInfo.elevation);
-        satInfo.setAzimuth(svInfo.azimuth);
-        satellites.append(satInfo);
+        satellite.prn = svInfo.prn;
+        satellite.snr = svInfo.snr;
+        satellite.elevation = svInfo.elevation;
+        satellite.azimuth = svInfo.azimuth;
 
         if (svStatus->used_in_fix_mask & (1 << i))
-            usedPrns.append(svInfo.prn);
+            epoch->usedPrns[epoch->usedCount++] = svInfo.prn;
     }
 
-    QMetaObject::invokeMethod(staticProvider, "setSatellite", Qt::QueuedConnection,
-                              Q_ARG(QList<SatelliteInfo>, satellites),
-                              Q_ARG(QList<int>, usedPrns));
+    events->commitSatelliteEpoch();
 }
 
 #if GEOCLUE_ANDROID_GPS_INTERFACE == 3
 void gnssSvStatusCallback(GnssSvStatus *svStatus)
 {
-    QList<SatelliteInfo> satellites;
-    QList<int> usedPrns;
+    countCallback();
+
+    GnssEventQueue *events = staticProvider->gnssEvents();
+    GnssSatelliteEpoch *epoch = events->beginSatelliteEpoch();
+
+    epoch->satelliteCount = 0;
+    epoch->usedCount = 0;
 
-    for (int i = 0; i < svStatus->num_svs; ++i) {
-        SatelliteInfo satInfo;
+    for (int i = 0; i < svStatus->num_svs && i < GnssMaxSatellites; ++i) {
+        GnssSatellite &satellite = epoch->satellites[epoch->satelliteCount++];
         GnssSvInfo &svInfo = svStatus->gnss_sv_list[i];
-        satInfo.setSnr(svInfo.c_n0_dbhz);
-        satInfo.setElevation(svInfo.elevation);
-        satInfo.setAzimuth(svInfo.azimuth);
-        int prn = svInfo.svid;
-        // From https://github.com/barbeau/gpstest
-        // and https://github.com/mvglasow/satstat/wiki/NMEA-IDs
-        if (svInfo.constellation == GNSS_CONSTELLATION_SBAS) {
-            prn -= 87;
-        } else if (svInfo.constellation == GNSS_CONSTELLATION_GLONASS) {
-            prn += 64;
-        } else if (svInfo.constellation == GNSS_CONSTELLATION_BEIDOU) {
-            prn += 200;
-        } else if (svInfo.constellation == GNSS_CONSTELLATION_GALILEO) {
-            prn += 300;
-        }
-        satInfo.setPrn(prn);
-        satellites.append(satInfo);
+        satellite.snr = svInfo.c_n0_dbhz;
+        satellite.elevation = svInfo.elevation;
+        satellite.azimuth = svInfo.azimuth;
+        satellite.prn = hybrisGnssSvidToPrn(svInfo.constellation, svInfo.svid);
 
         if (svInfo.flags & GNSS_SV_FLAGS_USED_IN_FIX)
-            usedPrns.append(svInfo.svid);
+            epoch->usedPrns[epoch->usedCount++] = satellite.prn;
     }
 
-    QMetaObject::invokeMethod(staticProvider, "setSatellite", Qt::QueuedConnection,
-                              Q_ARG(QList<SatelliteInfo>, satellites),
-                              Q_ARG(QList<int>, usedPrns));
+    events->commitSatelliteEpoch();
 }
 #endif
 
 #ifdef USE_GPS_VENDOR_EXTENSION
 void gnssSvStatusCallback_custom(GnssSvStatus *svStatus)
 {
-    QList<SatelliteInfo> satellites;
-    QList<int> usedPrns;
+    countCallback();
+
+    GnssEventQueue *events = staticProvider->gnssEvents();
+    GnssSatelliteEpoch *epoch = events->beginSatelliteEpoch();
 
-    for (int i = 0; i < svStatus->num_svs; ++i) {
-        SatelliteInfo satInfo;
+    epoch->satelliteCount = 0;
+    epoch->usedCount = 0;
+
+    for (int i = 0; i < svStatus->num_svs && i < GnssMaxSatellites; ++i) {
+        GnssSatellite &satellite = epoch->satellites[epoch->satelliteCount++];
         GnssSvInfo &svInfo = svStatus->sv_list[i];
-        satInfo.setPrn(svInfo.prn);
-        satInfo.setSnr(svInfo.snr);
-        satInfo.setElevation(svInfo.elevation);
-        satInfo.setAzimuth(svInfo.azimuth);
-        satellites.append(satInfo);
+        satellite.prn = svInfo.prn;
+        satellite.snr = svInfo.snr;
+        satellite.elevation = svInfo.elevation;
+        satellite.azimuth = svInfo.azimuth;
     }
 
-    QMetaObject::invokeMethod(staticProvider, "setSatellite", Qt::QueuedConnection,
-                              Q_ARG(QList<SatelliteInfo>, satellites),
-                              Q_ARG(QList<int>, usedPrns));
+    events->commitSatelliteEpoch();
 }
 #endif
 
@@ -211,6 +345,8 @@ void parseRmc(const QByteArray &nmea)
 
 void nmeaCallback(GpsUtcTime timestamp, const char *nmeaData, int length)
 {
+    countCallback();
+
     // Trim trailing whitepsace
     while (length > 0 && isspace(nmeaData[length-1]))
         --length;
@@ -234,30 +370,89 @@ void nmeaCallback(GpsUtcTime timestamp, const char *nmeaData, int length)
 
 void setCapabilitiesCallback(uint32_t capabilities)
 {
+    countCallback();
+
     qCDebug(lcGeoclueHybris) << "capabilities" << showbase << hex << capabilities;
+    QMetaObject::invokeMethod(staticProvider, "gnssCapabilities", Qt::QueuedConnection,
+                              Q_ARG(quint32, capabilities), Q_ARG(bool, false));
 }
 
 void acquireWakelockCallback()
 {
+    countCallback();
+
+    staticProvider->gnssWakelock()->acquire();
 }
 
 void releaseWakelockCallback()
 {
+    countCallback();
+
+    QMetaObject::invokeMethod(staticProvider, "gnssReleaseWakelock", Qt::QueuedConnection,
+                              Q_ARG(quint32, staticProvider->gnssWakelock()->generation()));
 }
 
 pthread_t createThreadCallback(const char *name, void (*start)(void *), void *arg)
 {
-    Q_UNUSED(name)
+    HalThread *thread = new HalThread;
+    thread->name = name ? QByteArray(name) : QByteArrayLiteral("gnss-hal");
+    thread->start = start;
+    thread->arg = arg;
+    thread->running = true;
+    thread->cpuTimeNs = 0;
+
+    pthread_attr_t attributes;
+    pthread_attr_init(&attributes);
+
+    if (halThreadConfig.explicitScheduling) {
+        sched_param parameters;
+        parameters.sched_priority = halThreadConfig.priority;
+        pthread_attr_setinheritsched(&attributes, PTHREAD_EXPLICIT_SCHED);
+        pthread_attr_setschedpolicy(&attributes, halThreadConfig.policy);
+        pthread_attr_setschedparam(&attributes, &parameters);
+    }
+
+    if (halThreadConfig.affinity)
+        pthread_attr_setaffinity_np(&attributes, sizeof(cpu_set_t), &halThreadConfig.cpus);
+
+    // Held until the thread is registered, halThreadStart() takes it before the thread exits.
+    QMutexLocker locker(&halThreadsMutex);
+
+    int error = pthread_create(&thread->thread, &attributes, halThreadStart, thread);
+    if (error == EPERM && halThreadConfig.explicitScheduling) {
+        qWarning("Not permitted to set the scheduling policy of HAL thread %s", thread->name.constData());
+        pthread_attr_setinheritsched(&attributes, PTHREAD_INHERIT_SCHED);
+        error = pthread_create(&thread->thread, &attributes, halThreadStart, thread);
+    }
+    if (error == EINVAL && (halThreadConfig.explicitScheduling || halThreadConfig.affinity)) {
+        // The configured policy, priority or CPU set is not valid on this kernel.
+        qWarning("Invalid scheduling attributes for HAL thread %s, using the defaults", thread->name.constData());
+        error = pthread_create(&thread->thread, Q_NULLPTR, halThreadStart, thread);
+    }
+
+    pthread_attr_destroy(&attributes);
+
+    if (error) {
+        qWarning("Failed to create HAL thread %s, %s", thread->name.constData(), strerror(error));
+        delete thread;
+        return 0;
+    }
+
+    pthread_setname_np(thread->thread, thread->name.left(MaximumThreadNameLength).constData());
+    if (pthread_getcpuclockid(thread->thread, &thread->cpuClock) != 0)
+        thread->cpuClock = -1;
 
-    pthread_t threadId;
+    halThreads.append(thread);
 
-    int error = pthread_create(&threadId, 0, (void*(*)(void*))start, arg);
+    qCDebug(lcGeoclueHybris) << "Created HAL thread" << thread->name;
 
-    return error ? 0 : threadId;
+    return thread->thread;
 }
 
 void requestUtcTimeCallback()
 {
+    countCallback();
+
     qCDebug(lcGeoclueHybris) << "GNSS request UTC time";
 
     QMetaObject::invokeMethod(staticProvider, "injectUtcTime", Qt::QueuedConnection);
@@ -267,12 +462,17 @@ void requestUtcTimeCallback()
 void gnssSetSystemInfoCallback(const GnssSystemInfo *info)
 {
     Q_UNUSED(info)
+
+    countCallback();
+
     qCDebug(lcGeoclueHybris) << "GNSS set system info";
 }
 #endif
 
 void agpsStatusCallback(AGpsStatus *status)
 {
+    countCallback();
+
     QHostAddress ipv4;
     QHostAddress ipv6;
     QByteArray ssid;
@@ -303,26 +503,119 @@ void agpsStatusCallback(AGpsStatus *status)
 void gpsNiNotifyCallback(GpsNiNotification *notification)
 {
     Q_UNUSED(notification)
+
+    countCallback();
+
     qCDebug(lcGeoclueHybris) << "GNSS NI notify";
 }
 
 void agpsRilRequestSetId(uint32_t flags)
 {
-    Q_UNUSED(flags)
+    countCallback();
+
     qCDebug(lcGeoclueHybris) << "AGNSS RIL request set ID flags" << showbase << hex << flags;
+
+    QMetaObject::invokeMethod(staticProvider, "agpsRilRequestSetId", Qt::QueuedConnection,
+                              Q_ARG(quint32, flags));
 }
 
 void agpsRilRequestRefLoc(uint32_t flags)
 {
-    Q_UNUSED(flags)
+    countCallback();
+
     qCDebug(lcGeoclueHybris) << "AGNSS RIL request ref location flags" << showbase << hex << flags;
+
+    // Only the serving cell is known, WiFi MAC reference locations are not supported.
+    if (flags & AGPS_RIL_REQUEST_REFLOC_CELLID)
+        QMetaObject::invokeMethod(staticProvider, "agpsRilRequestRefLocation", Qt::QueuedConnection);
 }
 
 void gnssXtraDownloadRequest()
 {
+    countCallback();
+
     QMetaObject::invokeMethod(staticProvider, "xtraDownloadRequest", Qt::QueuedConnection);
 }
 
+void geofenceTransitionCallback(int32_t geofenceId, GpsLocation *location, int32_t transition,
+                                GpsUtcTime timestamp)
+{
+    countCallback();
+
+    GnssFix fix;
+    decodeGpsLocation(location, &fix);
+
+    QMetaObject::invokeMethod(staticProvider, "gnssGeofenceTransition", Qt::QueuedConnection,
+                              Q_ARG(int, geofenceId), Q_ARG(GnssFix, fix),
+                              Q_ARG(int, transition), Q_ARG(qint64, timestamp));
+}
+
+void geofenceStatusCallback(int32_t status, GpsLocation *lastLocation)
+{
+    Q_UNUSED(lastLocation)
+
+    countCallback();
+
+    QMetaObject::invokeMethod(staticProvider, "gnssGeofenceStatus", Qt::QueuedConnection,
+                              Q_ARG(int, status));
+}
+
+void geofenceOperationFinished(int operation, int32_t geofenceId, int32_t status)
+{
+    countCallback();
+
+    QMetaObject::invokeMethod(staticProvider, "gnssGeofenceOperationFinished", Qt::QueuedConnection,
+                              Q_ARG(int, operation), Q_ARG(int, geofenceId), Q_ARG(int, status));
+}
+
+void geofenceAddCallback(int32_t geofenceId, int32_t status)
+{
+    geofenceOperationFinished(HYBRIS_GNSS_GEOFENCE_OPERATION_ADD, geofenceId, status);
+}
+
+void geofenceRemoveCallback(int32_t geofenceId, int32_t status)
+{
+    geofenceOperationFinished(HYBRIS_GNSS_GEOFENCE_OPERATION_REMOVE, geofenceId, status);
+}
+
+void geofencePauseCallback(int32_t geofenceId, int32_t status)
+{
+    geofenceOperationFinished(HYBRIS_GNSS_GEOFENCE_OPERATION_PAUSE, geofenceId, status);
+}
+
+void geofenceResumeCallback(int32_t geofenceId, int32_t status)
+{
+    geofenceOperationFinished(HYBRIS_GNSS_GEOFENCE_OPERATION_RESUME, geofenceId, status);
+}
+
+#if GEOCLUE_ANDROID_GPS_INTERFACE == 3
+void navigationMessage(int type, int svid, int status, const uint8_t *data, size_t length)
+{
+    QMetaObject::invokeMethod(staticProvider, "gnssNavigationMessage", Qt::QueuedConnection,
+                              Q_ARG(int, type), Q_ARG(int, svid), Q_ARG(int, status),
+                              Q_ARG(QByteArray, QByteArray(reinterpret_cast<const char *>(data), length)));
+}
+
+void gpsNavigationMessageCallback(GpsNavigationMessage *message)
+{
+    countCallback();
+
+    // Deprecated GPS only variant, type 1 is L1 C/A.
+    if (message->type == GPS_NAVIGATION_MESSAGE_TYPE_L1CA) {
+        navigationMessage(HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_GPS_L1CA, message->prn, message->status,
+                          message->data, message->data_length);
+    }
+}
+
+void gnssNavigationMessageCallback(GnssNavigationMessage *message)
+{
+    countCallback();
+
+    navigationMessage(message->type, message->svid, message->status, message->data,
+                      message->data_length);
+}
+#endif
+
 #if GEOCLUE_ANDROID_GPS_INTERFACE >= 2
 HybrisApnIpType fromContextProtocol(const QString &protocol)
 {
@@ -388,6 +681,24 @@ AGpsRilCallbacks agpsRilCallbacks = {
     createThreadCallback
 };
 
+GpsGeofenceCallbacks gpsGeofenceCallbacks = {
+    geofenceTransitionCallback,
+    geofenceStatusCallback,
+    geofenceAddCallback,
+    geofenceRemoveCallback,
+    geofencePauseCallback,
+    geofenceResumeCallback,
+    createThreadCallback
+};
+
+#if GEOCLUE_ANDROID_GPS_INTERFACE == 3
+GpsNavigationMessageCallbacks gpsNavigationMessageCallbacks = {
+    sizeof(GpsNavigationMessageCallbacks),
+    gpsNavigationMessageCallback,
+    gnssNavigationMessageCallback
+};
+#endif
+
 // Work-around for compatibility, the public definition of GpsXtraCallbacks has only two members,
 // however, some hardware adaptation definitions contain an extra report_xtra_server_cb member.
 // Add extra pointer length padding and initialise it to nullptr to prevent crashes.
@@ -400,8 +711,14 @@ struct GpsXtraCallbacksWrapper {
 };
 
 HalLocationBackend::HalLocationBackend(QObject *parent)
-:   HybrisLocationBackend(parent), m_gps(Q_NULLPTR), m_agps(Q_NULLPTR), m_agpsril(Q_NULLPTR), m_gpsni(Q_NULLPTR), m_xtra(Q_NULLPTR), m_debug(Q_NULLPTR)
+:   HybrisLocationBackend(parent), m_gps(Q_NULLPTR), m_agps(Q_NULLPTR), m_agpsril(Q_NULLPTR), m_gpsni(Q_NULLPTR), m_xtra(Q_NULLPTR), m_geofencing(Q_NULLPTR),
+#if GEOCLUE_ANDROID_GPS_INTERFACE == 3
+    m_navigationMessage(Q_NULLPTR),
+#endif
+    m_configuration(Q_NULLPTR), m_debug(Q_NULLPTR)
 {
+    loadThreadConfig();
+
     uid_t realUid;
     uid_t effectiveUid;
     uid_t savedUid;
@@ -573,8 +890,11 @@ void HalLocationBackend::gnssDeleteAidingData(HybrisGnssAidingData aidingDataFla
 
 bool HalLocationBackend::gnssSetPositionMode(HybrisGnssPositionMode mode, HybrisGnssPositionRecurrence recurrence,
                                     uint32_t minIntervalMs, uint32_t preferredAccuracyMeters,
-                                    uint32_t preferredTimeMs)
+                                    uint32_t preferredTimeMs, bool lowPowerMode)
 {
+    // No low power mode in the legacy HAL.
+    Q_UNUSED(lowPowerMode)
+
     int error = m_gps->set_position_mode(mode, recurrence, minIntervalMs,
                                          preferredAccuracyMeters, preferredTimeMs);
     if (error) {
@@ -584,12 +904,209 @@ bool HalLocationBackend::gnssSetPositionMode(HybrisGnssPositionMode mode, Hybris
     return true;
 }
 
+// GnssBatching
+// Batching of the legacy HAL lives in the separate fused location HAL, which is not supported.
+bool HalLocationBackend::gnssBatchingInit()
+{
+    return false;
+}
+
+int HalLocationBackend::gnssBatchingGetBatchSize()
+{
+    return 0;
+}
+
+bool HalLocationBackend::gnssBatchingStart(int64_t periodNanos, bool wakeUpOnFifoFull)
+{
+    Q_UNUSED(periodNanos)
+    Q_UNUSED(wakeUpOnFifoFull)
+
+    return false;
+}
+
+void HalLocationBackend::gnssBatchingFlush()
+{
+}
+
+bool HalLocationBackend::gnssBatchingStop()
+{
+    return false;
+}
+
+// GnssMeasurement
+// Raw measurements are only supported through the HIDL interface.
+bool HalLocationBackend::gnssMeasurementStart()
+{
+    return false;
+}
+
+void HalLocationBackend::gnssMeasurementStop()
+{
+}
+
+// GnssNavigationMessage
+bool HalLocationBackend::gnssNavigationMessageStart()
+{
+#if GEOCLUE_ANDROID_GPS_INTERFACE == 3
+    if (!m_navigationMessage) {
+        m_navigationMessage = static_cast<const GpsNavigationMessageInterface *>(
+            m_gps->get_extension(GPS_NAVIGATION_MESSAGE_INTERFACE));
+        if (!m_navigationMessage)
+            return false;
+        qWarning("Initialising GPS Navigation Message Interface");
+    }
+
+    return m_navigationMessage->init(&gpsNavigationMessageCallbacks) ==
+            GPS_NAVIGATION_MESSAGE_OPERATION_SUCCESS;
+#else
+    return false;
+#endif
+}
+
+void HalLocationBackend::gnssNavigationMessageStop()
+{
+#if GEOCLUE_ANDROID_GPS_INTERFACE == 3
+    if (m_navigationMessage)
+        m_navigationMessage->close();
+#endif
+}
+
+// GnssGeofencing
+bool HalLocationBackend::gnssGeofencingInit()
+{
+    m_geofencing = static_cast<const GpsGeofencingInterface *>(m_gps->get_extension(GPS_GEOFENCING_INTERFACE));
+    if (m_geofencing) {
+        qWarning("Initialising GPS Geofencing Interface");
+        m_geofencing->init(&gpsGeofenceCallbacks);
+    }
+    return m_geofencing;
+}
+
+bool HalLocationBackend::gnssGeofenceAdd(int32_t geofenceId, double latitudeDegrees,
+                                         double longitudeDegrees, double radiusMeters,
+                                         int32_t lastTransition, int32_t monitorTransitions,
+                                         uint32_t notificationResponsivenessMs,
+                                         uint32_t unknownTimerMs)
+{
+    if (!m_geofencing)
+        return false;
+
+    m_geofencing->add_geofence_area(geofenceId, latitudeDegrees, longitudeDegrees, radiusMeters,
+                                    lastTransition, monitorTransitions,
+                                    notificationResponsivenessMs, unknownTimerMs);
+    return true;
+}
+
+bool HalLocationBackend::gnssGeofencePause(int32_t geofenceId)
+{
+    if (!m_geofencing)
+        return false;
+
+    m_geofencing->pause_geofence(geofenceId);
+    return true;
+}
+
+bool HalLocationBackend::gnssGeofenceResume(int32_t geofenceId, int32_t monitorTransitions)
+{
+    if (!m_geofencing)
+        return false;
+
+    m_geofencing->resume_geofence(geofenceId, monitorTransitions);
+    return true;
+}
+
+bool HalLocationBackend::gnssGeofenceRemove(int32_t geofenceId)
+{
+    if (!m_geofencing)
+        return false;
+
+    m_geofencing->remove_geofence_area(geofenceId);
+    return true;
+}
+
+// GnssConfiguration
+// The legacy interface takes gps.conf formatted updates.
+bool HalLocationBackend::gnssConfigurationInit()
+{
+    m_configuration = static_cast<const GpsConfigurationInterface *>(m_gps->get_extension(GPS_CONFIGURATION_INTERFACE));
+    if (m_configuration)
+        qWarning("Initialising GPS Configuration Interface");
+    return m_configuration;
+}
+
+bool HalLocationBackend::gnssConfigurationUpdate(const QByteArray &configuration)
+{
+    if (!m_configuration)
+        return false;
+
+    m_configuration->configuration_update(configuration.constData(), configuration.length());
+    return true;
+}
+
+bool HalLocationBackend::gnssConfigurationSetSuplMode(uint8_t suplMode)
+{
+    return gnssConfigurationUpdate("SUPL_MODE=" + QByteArray::number(suplMode) + '\n');
+}
+
+bool HalLocationBackend::gnssConfigurationSetLppProfile(uint8_t lppProfile)
+{
+    return gnssConfigurationUpdate("LPP_PROFILE=" + QByteArray::number(lppProfile) + '\n');
+}
+
+bool HalLocationBackend::gnssConfigurationSetGlonassPositioningProtocol(uint8_t protocol)
+{
+    return gnssConfigurationUpdate("A_GLONASS_POS_PROTOCOL_SELECT=" + QByteArray::number(protocol) + '\n');
+}
+
+bool HalLocationBackend::gnssConfigurationSetBlacklist(const QVector<HybrisGnssConstellationType> &constellations)
+{
+    // Constellations cannot be disabled through gps.conf.
+    return constellations.isEmpty();
+}
+
 // GnssDebug
 void HalLocationBackend::gnssDebugInit()
 {
     m_debug = static_cast<const GpsDebugInterface *>(m_gps->get_extension(GPS_DEBUG_INTERFACE));
 }
 
+bool HalLocationBackend::gnssDebugRequestData()
+{
+    // GpsDebugInterface only provides a free form text dump of the internal state.
+    return false;
+}
+
+QVector<HybrisGnssThreadInfo> HalLocationBackend::gnssDebugThreads()
+{
+    QVector<HybrisGnssThreadInfo> threads;
+
+    QMutexLocker locker(&halThreadsMutex);
+
+    foreach (HalThread *thread, halThreads) {
+        HybrisGnssThreadInfo info;
+        info.name = thread->name;
+        info.running = thread->running;
+        info.cpuTimeNs = thread->cpuTimeNs;
+        info.callbacks = thread->callbacks.load();
+
+        timespec cpuTime;
+        if (thread->running && thread->cpuClock != -1 && clock_gettime(thread->cpuClock, &cpuTime) == 0)
+            info.cpuTimeNs = qint64(cpuTime.tv_sec) * 1000000000 + cpuTime.tv_nsec;
+
+        threads.append(info);
+    }
+
+    HybrisGnssThreadInfo other;
+    other.name = QByteArrayLiteral("other");
+    other.running = true;
+    other.cpuTimeNs = 0;
+    other.callbacks = otherThreadCallbacks.load();
+    if (other.callbacks)
+        threads.append(other);
+
+    return threads;
+}
+
 // GnnNi
 void HalLocationBackend::gnssNiInit()
 {
@@ -684,7 +1201,7 @@ int HalLocationBackend::aGnssSetServer(HybrisAGnssType type, const char* hostnam
     if (m_agps) {
         return m_agps->set_server(type, hostname, port);
     }
-    return 0;
+    return -1;
 }
 
 // AGnssRil
@@ -696,3 +1213,51 @@ void HalLocationBackend::aGnssRilInit()
         m_agpsril->init(&agpsRilCallbacks);
     }
 }
+
+bool HalLocationBackend::aGnssRilSetRefLocation(const HybrisAGnssRefLocation &location)
+{
+    if (!m_agpsril)
+        return false;
+
+    AGpsRefLocation refLocation;
+    memset(&refLocation, 0, sizeof(refLocation));
+    refLocation.type = location.type;
+    refLocation.u.cellID.type = location.type;
+    refLocation.u.cellID.mcc = location.mcc;
+    refLocation.u.cellID.mnc = location.mnc;
+    refLocation.u.cellID.lac = location.lac;
+    refLocation.u.cellID.cid = location.cid;
+#if GEOCLUE_ANDROID_GPS_INTERFACE == 3
+    refLocation.u.cellID.tac = location.tac;
+    refLocation.u.cellID.pcid = location.pcid;
+#endif
+    m_agpsril->set_ref_location(&refLocation, sizeof(refLocation));
+    return true;
+}
+
+bool HalLocationBackend::aGnssRilSetSetId(HybrisAGnssSetIDType type, const QByteArray &setId)
+{
+    if (!m_agpsril)
+        return false;
+
+    m_agpsril->set_set_id(type, setId.constData());
+    return true;
+}
+
+bool HalLocationBackend::aGnssRilUpdateNetworkState(bool connected, HybrisNetworkType type, bool roaming)
+{
+    if (!m_agpsril)
+        return false;
+
+    m_agpsril->update_network_state(connected, type, roaming, Q_NULLPTR);
+    return true;
+}
+
+bool HalLocationBackend::aGnssRilUpdateNetworkAvailability(bool available, const QByteArray &apn)
+{
+    if (!m_agpsril)
+        return false;
+
+    m_agpsril->update_network_availability(available, apn.constData());
+    return true;
+}
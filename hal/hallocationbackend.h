@@ -46,10 +46,43 @@ public:
     void gnssDeleteAidingData(HybrisGnssAidingData aidingDataFlags);
     bool gnssSetPositionMode(HybrisGnssPositionMode mode, HybrisGnssPositionRecurrence recurrence,
                                         uint32_t minIntervalMs, uint32_t preferredAccuracyMeters,
-                                        uint32_t preferredTimeMs);
+                                        uint32_t preferredTimeMs, bool lowPowerMode);
+
+    // GnssBatching
+    bool gnssBatchingInit();
+    int gnssBatchingGetBatchSize();
+    bool gnssBatchingStart(int64_t periodNanos, bool wakeUpOnFifoFull);
+    void gnssBatchingFlush();
+    bool gnssBatchingStop();
+
+    // GnssMeasurement
+    bool gnssMeasurementStart();
+    void gnssMeasurementStop();
+
+    // GnssNavigationMessage
+    bool gnssNavigationMessageStart();
+    void gnssNavigationMessageStop();
+
+    // GnssGeofencing
+    bool gnssGeofencingInit();
+    bool gnssGeofenceAdd(int32_t geofenceId, double latitudeDegrees, double longitudeDegrees,
+                         double radiusMeters, int32_t lastTransition, int32_t monitorTransitions,
+                         uint32_t notificationResponsivenessMs, uint32_t unknownTimerMs);
+    bool gnssGeofencePause(int32_t geofenceId);
+    bool gnssGeofenceResume(int32_t geofenceId, int32_t monitorTransitions);
+    bool gnssGeofenceRemove(int32_t geofenceId);
+
+    // GnssConfiguration
+    bool gnssConfigurationInit();
+    bool gnssConfigurationSetSuplMode(uint8_t suplMode);
+    bool gnssConfigurationSetLppProfile(uint8_t lppProfile);
+    bool gnssConfigurationSetGlonassPositioningProtocol(uint8_t protocol);
+    bool gnssConfigurationSetBlacklist(const QVector<HybrisGnssConstellationType> &constellations);
 
     // GnssDebug
     void gnssDebugInit();
+    bool gnssDebugRequestData();
+    QVector<HybrisGnssThreadInfo> gnssDebugThreads();
 
     // GnnNi
     void gnssNiInit();
@@ -68,8 +101,14 @@ public:
 
     // AGnssRil
     void aGnssRilInit();
+    bool aGnssRilSetRefLocation(const HybrisAGnssRefLocation &location);
+    bool aGnssRilSetSetId(HybrisAGnssSetIDType type, const QByteArray &setId);
+    bool aGnssRilUpdateNetworkState(bool connected, HybrisNetworkType type, bool roaming);
+    bool aGnssRilUpdateNetworkAvailability(bool available, const QByteArray &apn);
 
 private:
+    bool gnssConfigurationUpdate(const QByteArray &configuration);
+
     gps_device_t *m_gpsDevice;
 
     const GpsInterface *m_gps;
@@ -78,6 +117,11 @@ private:
     const AGpsRilInterface *m_agpsril;
     const GpsNiInterface *m_gpsni;
     const GpsXtraInterface *m_xtra;
+    const GpsGeofencingInterface *m_geofencing;
+#if GEOCLUE_ANDROID_GPS_INTERFACE == 3
+    const GpsNavigationMessageInterface *m_navigationMessage;
+#endif
+    const GpsConfigurationInterface *m_configuration;
 
     const GpsDebugInterface *m_debug;
 };
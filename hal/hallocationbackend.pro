@@ -1,4 +1,6 @@
-include($$PWD/../geoclue-providers-hybris.pri)
+include($$PWD/../backend-plugin.pri)
+
+TARGET = geoclue-hybris-hal
 
 HEADERS += \
     hallocationbackend.h
@@ -0,0 +1,131 @@
+/*
+    Copyright (C) 2026 Jolla Ltd.
+
+    This file is part of geoclue-hybris.
+
+    Geoclue-hybris is free software; you can redistribute it and/or
+    modify it under the terms of the GNU Lesser General Public
+    License as published by the Free Software Foundation; either
+    version 2.1 of the License.
+*/
+
+#include "hybrislocationbackend.h"
+#include "hybrisprovider.h"
+
+#include <QtCore/QElapsedTimer>
+#include <QtCore/QFile>
+#include <QtCore/QSaveFile>
+
+#include <dlfcn.h>
+
+namespace
+{
+
+// In order of preference, the binder HAL is the one used by current adaptations.
+const char * const BackendNames[] = { "binder", "hal" };
+
+const int BackendCount = sizeof(BackendNames) / sizeof(BackendNames[0]);
+
+QString backendCacheFile()
+{
+    return QStringLiteral(GEOCLUE_HYBRIS_STATE_DIR "/backend");
+}
+
+// Only known backends are loaded, the cache must not name an arbitrary library.
+bool isKnownBackend(const QString &name)
+{
+    for (int i = 0; i < BackendCount; ++i) {
+        if (name == QLatin1String(BackendNames[i]))
+            return true;
+    }
+    return false;
+}
+
+QString backendPluginPath(const QString &name)
+{
+    return QStringLiteral(GEOCLUE_HYBRIS_PLUGIN_DIR "/libgeoclue-hybris-%1.so").arg(name);
+}
+
+/*
+    Loads the plugin of the named backend and creates the backend, after checking for its HAL
+    when probe is set. Plugins are never unloaded, a failed probe may have left HAL threads or
+    exit handlers behind which still run plugin code.
+*/
+HybrisLocationBackend *loadBackend(const QString &name, bool probe)
+{
+    const QString path = backendPluginPath(name);
+
+    void *handle = dlopen(QFile::encodeName(path).constData(), RTLD_NOW | RTLD_LOCAL | RTLD_NODELETE);
+    if (!handle) {
+        qCDebug(lcGeoclueHybris) << "Failed to load backend" << path << dlerror();
+        return Q_NULLPTR;
+    }
+
+    HybrisLocationBackendProbe probeFunction = reinterpret_cast<HybrisLocationBackendProbe>(
+            dlsym(handle, HYBRIS_LOCATION_BACKEND_PROBE));
+    HybrisLocationBackendCreate createFunction = reinterpret_cast<HybrisLocationBackendCreate>(
+            dlsym(handle, HYBRIS_LOCATION_BACKEND_CREATE));
+    if (!probeFunction || !createFunction) {
+        qWarning("Backend %s is not a location backend plugin", qPrintable(path));
+        dlclose(handle);
+        return Q_NULLPTR;
+    }
+
+    // Created before probing, the HAL backend drops its privileges before the HAL is looked up.
+    HybrisLocationBackend *backend = createFunction();
+
+    if (probe) {
+        QElapsedTimer timer;
+        timer.start();
+        const bool found = probeFunction();
+        qCDebug(lcGeoclueHybris) << "Probed" << name << "backend in" << timer.elapsed() << "ms,"
+                                 << (found ? "found" : "not found");
+        if (!found) {
+            delete backend;
+            return Q_NULLPTR;
+        }
+    }
+
+    return backend;
+}
+
+}
+
+HybrisLocationBackend *getLocationBackend()
+{
+    QFile cacheFile(backendCacheFile());
+    if (cacheFile.open(QIODevice::ReadOnly)) {
+        const QString name = QString::fromLatin1(cacheFile.readLine().trimmed());
+        cacheFile.close();
+
+        if (!isKnownBackend(name)) {
+            qWarning("Ignoring unknown cached location backend");
+        } else if (HybrisLocationBackend *backend = loadBackend(name, false)) {
+            qCDebug(lcGeoclueHybris) << "Using cached" << name << "backend";
+            return backend;
+        }
+    }
+
+    for (int i = 0; i < BackendCount; ++i) {
+        const char *name = BackendNames[i];
+        if (HybrisLocationBackend *backend = loadBackend(QLatin1String(name), true)) {
+            qWarning("Using %s location backend", name);
+
+            QSaveFile file(backendCacheFile());
+            if (file.open(QIODevice::WriteOnly)) {
+                file.write(name);
+                file.write("\n");
+                file.commit();
+            }
+            return backend;
+        }
+    }
+
+    qWarning("No location backend found in %s", GEOCLUE_HYBRIS_PLUGIN_DIR);
+    return Q_NULLPTR;
+}
+
+void resetLocationBackend()
+{
+    QFile::remove(backendCacheFile());
+}
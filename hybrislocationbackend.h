@@ -16,8 +16,11 @@
 
 #include <cstdint>
 
+#include <QtCore/QByteArray>
+#include <QtCore/QMetaType>
 #include <QtCore/QObject>
 #include <QtCore/QString>
+#include <QtCore/QVector>
 
 /** Milliseconds since January 1, 1970 */
 typedef int64_t HybrisGnssUtcTime;
@@ -77,12 +80,66 @@ typedef uint16_t HybrisAGnssRefLocationType;
 
 typedef int HybrisNetworkType;
 
+/** GNSS constellation, same values in the legacy HAL and HIDL interfaces. */
+typedef uint8_t HybrisGnssConstellationType;
+
 enum {
     HYBRIS_GNSS_POSITION_MODE_STANDALONE = 0,
     HYBRIS_GNSS_POSITION_MODE_MS_BASED = 1,
     HYBRIS_GNSS_POSITION_MODE_MS_ASSISTED = 2,
 };
 
+enum {
+    HYBRIS_GNSS_CONSTELLATION_UNKNOWN = 0,
+    HYBRIS_GNSS_CONSTELLATION_GPS = 1,
+    HYBRIS_GNSS_CONSTELLATION_SBAS = 2,
+    HYBRIS_GNSS_CONSTELLATION_GLONASS = 3,
+    HYBRIS_GNSS_CONSTELLATION_QZSS = 4,
+    HYBRIS_GNSS_CONSTELLATION_BEIDOU = 5,
+    HYBRIS_GNSS_CONSTELLATION_GALILEO = 6,
+};
+
+/**
+ * Maps a constellation specific svid to the PRN reported over D-Bus.
+ * From https://github.com/barbeau/gpstest
+ * and https://github.com/mvglasow/satstat/wiki/NMEA-IDs
+ */
+inline int hybrisGnssSvidToPrn(HybrisGnssConstellationType constellation, int svid)
+{
+    switch (constellation) {
+    case HYBRIS_GNSS_CONSTELLATION_SBAS:
+        return svid - 87;
+    case HYBRIS_GNSS_CONSTELLATION_GLONASS:
+        return svid + 64;
+    case HYBRIS_GNSS_CONSTELLATION_BEIDOU:
+        return svid + 200;
+    case HYBRIS_GNSS_CONSTELLATION_GALILEO:
+        return svid + 300;
+    default:
+        return svid;
+    }
+}
+
+/**
+ * GNSS chip capabilities reported through HybrisProvider::gnssCapabilities(), same bits
+ * in the legacy HAL and IGnss@1.x interfaces. IGnss@2.0 no longer reports GEOFENCING,
+ * the other bits are unchanged. LOW_POWER_MODE, SATELLITE_BLACKLIST and
+ * MEASUREMENT_CORRECTIONS are only reported by the IGnss@2.0 callback.
+ */
+enum {
+    HYBRIS_GNSS_CAPABILITY_SCHEDULING = 0x0001,
+    HYBRIS_GNSS_CAPABILITY_MSB = 0x0002,
+    HYBRIS_GNSS_CAPABILITY_MSA = 0x0004,
+    HYBRIS_GNSS_CAPABILITY_SINGLE_SHOT = 0x0008,
+    HYBRIS_GNSS_CAPABILITY_ON_DEMAND_TIME = 0x0010,
+    HYBRIS_GNSS_CAPABILITY_GEOFENCING = 0x0020,
+    HYBRIS_GNSS_CAPABILITY_MEASUREMENTS = 0x0040,
+    HYBRIS_GNSS_CAPABILITY_NAV_MESSAGES = 0x0080,
+    HYBRIS_GNSS_CAPABILITY_LOW_POWER_MODE = 0x0100,
+    HYBRIS_GNSS_CAPABILITY_SATELLITE_BLACKLIST = 0x0200,
+    HYBRIS_GNSS_CAPABILITY_MEASUREMENT_CORRECTIONS = 0x0400,
+};
+
 enum {
     HYBRIS_GNSS_POSITION_RECURRENCE_PERIODIC = 0,
     HYBRIS_GNSS_POSITION_RECURRENCE_SINGLE = 1,
@@ -101,6 +158,217 @@ enum {
     HYBRIS_GNSS_AGNSS_DATA_CONN_FAILED = 5,
 };
 
+/**
+ * Backend commands whose completion may be reported asynchronously
+ * through HybrisProvider::gnssCommandFinished(). GEOFENCE_ADD carries the geofence id
+ * as its data.
+ */
+enum {
+    HYBRIS_GNSS_COMMAND_START = 1,
+    HYBRIS_GNSS_COMMAND_STOP = 2,
+    HYBRIS_GNSS_COMMAND_INJECT_TIME = 3,
+    HYBRIS_GNSS_COMMAND_INJECT_LOCATION = 4,
+    HYBRIS_GNSS_COMMAND_DELETE_AIDING_DATA = 5,
+    HYBRIS_GNSS_COMMAND_SET_POSITION_MODE = 6,
+    HYBRIS_GNSS_COMMAND_NI_RESPOND = 7,
+    HYBRIS_GNSS_COMMAND_XTRA_INJECT_DATA = 8,
+    HYBRIS_AGNSS_COMMAND_DATA_CONN_CLOSED = 9,
+    HYBRIS_AGNSS_COMMAND_DATA_CONN_FAILED = 10,
+    HYBRIS_AGNSS_COMMAND_DATA_CONN_OPEN = 11,
+    HYBRIS_AGNSS_COMMAND_SET_SERVER = 12,
+    HYBRIS_GNSS_COMMAND_BATCHING_START = 13,
+    HYBRIS_GNSS_COMMAND_BATCHING_STOP = 14,
+    HYBRIS_GNSS_COMMAND_BATCHING_FLUSH = 15,
+    HYBRIS_GNSS_COMMAND_MEASUREMENT_CLOSE = 16,
+    HYBRIS_GNSS_COMMAND_GEOFENCE_ADD = 17,
+    HYBRIS_GNSS_COMMAND_GEOFENCE_PAUSE = 18,
+    HYBRIS_GNSS_COMMAND_GEOFENCE_RESUME = 19,
+    HYBRIS_GNSS_COMMAND_GEOFENCE_REMOVE = 20,
+    HYBRIS_GNSS_COMMAND_NAVIGATION_MESSAGE_CLOSE = 21,
+    HYBRIS_GNSS_COMMAND_CONFIGURATION = 22,
+    HYBRIS_GNSS_COMMAND_DEBUG_DATA = 23,
+    HYBRIS_AGNSS_RIL_COMMAND_SET_REF_LOCATION = 24,
+    HYBRIS_AGNSS_RIL_COMMAND_SET_ID = 25,
+    HYBRIS_AGNSS_RIL_COMMAND_UPDATE_NETWORK_STATE = 26,
+    HYBRIS_AGNSS_RIL_COMMAND_UPDATE_NETWORK_AVAILABILITY = 27,
+};
+
+/** AGNSS RIL values, same in the legacy HAL and HIDL interfaces. */
+enum {
+    HYBRIS_AGNSS_RIL_REQUEST_SETID_IMSI = 1,
+    HYBRIS_AGNSS_RIL_REQUEST_SETID_MSISDN = 2,
+};
+
+enum {
+    HYBRIS_AGNSS_SETID_TYPE_NONE = 0,
+    HYBRIS_AGNSS_SETID_TYPE_IMSI = 1,
+    HYBRIS_AGNSS_SETID_TYPE_MSISDN = 2,
+};
+
+enum {
+    HYBRIS_AGNSS_RIL_NETWORK_TYPE_MOBILE = 0,
+    HYBRIS_AGNSS_RIL_NETWORK_TYPE_WIFI = 1,
+};
+
+enum {
+    HYBRIS_AGNSS_REF_LOCATION_TYPE_GSM_CELLID = 1,
+    HYBRIS_AGNSS_REF_LOCATION_TYPE_UMTS_CELLID = 2,
+    HYBRIS_AGNSS_REF_LOCATION_TYPE_LTE_CELLID = 4,
+};
+
+/**
+ * Serving cell passed to IAGnssRil::setRefLocation(). For LTE lac holds the tracking
+ * area code too and cid the E-UTRAN cell identity.
+ */
+struct HybrisAGnssRefLocation {
+    HybrisAGnssRefLocationType type;
+    uint16_t mcc;
+    uint16_t mnc;
+    uint16_t lac;
+    uint32_t cid;
+    uint16_t tac;
+    uint16_t pcid;
+
+    bool operator==(const HybrisAGnssRefLocation &other) const
+    {
+        return type == other.type && mcc == other.mcc && mnc == other.mnc && lac == other.lac
+                && cid == other.cid && tac == other.tac && pcid == other.pcid;
+    }
+    bool operator!=(const HybrisAGnssRefLocation &other) const { return !(*this == other); }
+};
+
+/** Geofence transitions, same values in the legacy HAL and HIDL interfaces. */
+enum {
+    HYBRIS_GNSS_GEOFENCE_ENTERED = 1,
+    HYBRIS_GNSS_GEOFENCE_EXITED = 2,
+    HYBRIS_GNSS_GEOFENCE_UNCERTAIN = 4,
+};
+
+enum {
+    HYBRIS_GNSS_GEOFENCE_UNAVAILABLE = 1,
+    HYBRIS_GNSS_GEOFENCE_AVAILABLE = 2,
+};
+
+/**
+ * Geofence operations whose result is reported asynchronously
+ * through HybrisProvider::gnssGeofenceOperationFinished().
+ */
+enum {
+    HYBRIS_GNSS_GEOFENCE_OPERATION_ADD = 1,
+    HYBRIS_GNSS_GEOFENCE_OPERATION_REMOVE = 2,
+    HYBRIS_GNSS_GEOFENCE_OPERATION_PAUSE = 3,
+    HYBRIS_GNSS_GEOFENCE_OPERATION_RESUME = 4,
+};
+
+enum {
+    HYBRIS_GNSS_GEOFENCE_OPERATION_SUCCESS = 0,
+    HYBRIS_GNSS_GEOFENCE_ERROR_TOO_MANY_GEOFENCES = -100,
+    HYBRIS_GNSS_GEOFENCE_ERROR_ID_EXISTS = -101,
+    HYBRIS_GNSS_GEOFENCE_ERROR_ID_UNKNOWN = -102,
+    HYBRIS_GNSS_GEOFENCE_ERROR_INVALID_TRANSITION = -103,
+    HYBRIS_GNSS_GEOFENCE_ERROR_GENERIC = -149,
+};
+
+/** Configuration values, same bits in gps.conf and IGnssConfiguration. */
+enum {
+    HYBRIS_GNSS_SUPL_MODE_MSB = 0x01,
+    HYBRIS_GNSS_SUPL_MODE_MSA = 0x02,
+};
+
+enum {
+    HYBRIS_GNSS_LPP_PROFILE_USER_PLANE = 0x01,
+    HYBRIS_GNSS_LPP_PROFILE_CONTROL_PLANE = 0x02,
+};
+
+enum {
+    HYBRIS_GNSS_GLONASS_POS_PROTOCOL_RRC_CPLANE = 0x01,
+    HYBRIS_GNSS_GLONASS_POS_PROTOCOL_RRLP_UPLANE = 0x02,
+    HYBRIS_GNSS_GLONASS_POS_PROTOCOL_LPP_UPLANE = 0x04,
+};
+
+/** Navigation message types, same values in the legacy HAL and HIDL interfaces. */
+enum {
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_UNKNOWN = 0,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_GPS_L1CA = 0x0101,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_GPS_L2CNAV = 0x0102,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_GPS_L5CNAV = 0x0103,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_GPS_CNAV2 = 0x0104,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_GLO_L1CA = 0x0301,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_BDS_D1 = 0x0501,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_BDS_D2 = 0x0502,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_GAL_I = 0x0601,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_TYPE_GAL_F = 0x0602,
+};
+
+enum {
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_STATUS_UNKNOWN = 0,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_STATUS_PARITY_PASSED = 1,
+    HYBRIS_GNSS_NAVIGATION_MESSAGE_STATUS_PARITY_REBUILT = 2,
+};
+
+/** Satellite ephemeris state reported by IGnssDebug. */
+enum {
+    HYBRIS_GNSS_EPHEMERIS_TYPE_EPHEMERIS = 0,
+    HYBRIS_GNSS_EPHEMERIS_TYPE_ALMANAC_ONLY = 1,
+    HYBRIS_GNSS_EPHEMERIS_TYPE_NOT_AVAILABLE = 2,
+};
+
+enum {
+    HYBRIS_GNSS_EPHEMERIS_SOURCE_DEMODULATED = 0,
+    HYBRIS_GNSS_EPHEMERIS_SOURCE_SUPL_PROVIDED = 1,
+    HYBRIS_GNSS_EPHEMERIS_SOURCE_OTHER_SERVER_PROVIDED = 2,
+    HYBRIS_GNSS_EPHEMERIS_SOURCE_OTHER = 3,
+};
+
+enum {
+    HYBRIS_GNSS_EPHEMERIS_HEALTH_GOOD = 0,
+    HYBRIS_GNSS_EPHEMERIS_HEALTH_BAD = 1,
+    HYBRIS_GNSS_EPHEMERIS_HEALTH_UNKNOWN = 2,
+};
+
+struct HybrisGnssDebugSatellite {
+    int svid;
+    HybrisGnssConstellationType constellation;
+    uint8_t ephemerisType;
+    uint8_t ephemerisSource;
+    uint8_t ephemerisHealth;
+    float ephemerisAgeSeconds;
+    bool serverPredictionAvailable;
+    float serverPredictionAgeSeconds;
+};
+
+/**
+ * Internal state of the GNSS chip as reported by IGnssDebug::getDebugData(). Time
+ * estimate is in milliseconds since January 1, 1970.
+ */
+struct HybrisGnssDebugData {
+    bool positionValid;
+    double latitudeDegrees;
+    double longitudeDegrees;
+    float altitudeMeters;
+    double horizontalAccuracyMeters;
+    float positionAgeSeconds;
+
+    int64_t timeEstimateMs;
+    float timeUncertaintyNs;
+    float frequencyUncertaintyNsPerSec;
+
+    QVector<HybrisGnssDebugSatellite> satellites;
+};
+
+Q_DECLARE_METATYPE(HybrisGnssDebugData)
+
+/**
+ * A thread started by the GNSS HAL, with the CPU time it used so far in nanoseconds and the
+ * number of HAL callbacks it delivered.
+ */
+struct HybrisGnssThreadInfo {
+    QByteArray name;
+    bool running;
+    qint64 cpuTimeNs;
+    quint32 callbacks;
+};
+
 class HybrisLocationBackend : public QObject
 {
     Q_OBJECT
@@ -118,10 +386,44 @@ public:
     virtual void gnssDeleteAidingData(HybrisGnssAidingData aidingDataFlags) = 0;
     virtual bool gnssSetPositionMode(HybrisGnssPositionMode mode, HybrisGnssPositionRecurrence recurrence,
                                      uint32_t minIntervalMs, uint32_t preferredAccuracyMeters,
-                                     uint32_t preferredTimeMs) = 0;
+                                     uint32_t preferredTimeMs, bool lowPowerMode) = 0;
+
+    // GnssBatching
+    virtual bool gnssBatchingInit() = 0;
+    virtual int gnssBatchingGetBatchSize() = 0;
+    virtual bool gnssBatchingStart(int64_t periodNanos, bool wakeUpOnFifoFull) = 0;
+    virtual void gnssBatchingFlush() = 0;
+    virtual bool gnssBatchingStop() = 0;
+
+    // GnssMeasurement
+    virtual bool gnssMeasurementStart() = 0;
+    virtual void gnssMeasurementStop() = 0;
+
+    // GnssNavigationMessage
+    virtual bool gnssNavigationMessageStart() = 0;
+    virtual void gnssNavigationMessageStop() = 0;
+
+    // GnssGeofencing
+    virtual bool gnssGeofencingInit() = 0;
+    virtual bool gnssGeofenceAdd(int32_t geofenceId, double latitudeDegrees, double longitudeDegrees,
+                                 double radiusMeters, int32_t lastTransition,
+                                 int32_t monitorTransitions, uint32_t notificationResponsivenessMs,
+                                 uint32_t unknownTimerMs) = 0;
+    virtual bool gnssGeofencePause(int32_t geofenceId) = 0;
+    virtual bool gnssGeofenceResume(int32_t geofenceId, int32_t monitorTransitions) = 0;
+    virtual bool gnssGeofenceRemove(int32_t geofenceId) = 0;
+
+    // GnssConfiguration
+    virtual bool gnssConfigurationInit() = 0;
+    virtual bool gnssConfigurationSetSuplMode(uint8_t suplMode) = 0;
+    virtual bool gnssConfigurationSetLppProfile(uint8_t lppProfile) = 0;
+    virtual bool gnssConfigurationSetGlonassPositioningProtocol(uint8_t protocol) = 0;
+    virtual bool gnssConfigurationSetBlacklist(const QVector<HybrisGnssConstellationType> &constellations) = 0;
 
     // GnssDebug
     virtual void gnssDebugInit() = 0;
+    virtual bool gnssDebugRequestData() = 0;
+    virtual QVector<HybrisGnssThreadInfo> gnssDebugThreads() = 0;
 
     // GnnNi
     virtual void gnssNiInit() = 0;
@@ -136,13 +438,33 @@ public:
     virtual bool aGnssDataConnClosed() = 0;
     virtual bool aGnssDataConnFailed() = 0;
     virtual bool aGnssDataConnOpen(const QByteArray &apn, const QString &protocol) = 0;
+    // Returns 0 on success.
     virtual int aGnssSetServer(HybrisAGnssType type, const char* hostname, int port) = 0;
 
     // AGnssRil
     virtual void aGnssRilInit() = 0;
+    virtual bool aGnssRilSetRefLocation(const HybrisAGnssRefLocation &location) = 0;
+    virtual bool aGnssRilSetSetId(HybrisAGnssSetIDType type, const QByteArray &setId) = 0;
+    virtual bool aGnssRilUpdateNetworkState(bool connected, HybrisNetworkType type, bool roaming) = 0;
+    virtual bool aGnssRilUpdateNetworkAvailability(bool available, const QByteArray &apn) = 0;
 
 };
 
+/*
+    The backends are plugins exporting these two C functions. The probe tells whether the
+    GNSS HAL of the backend is present on the device, without opening it.
+*/
+extern "C" {
+typedef bool (*HybrisLocationBackendProbe)();
+typedef HybrisLocationBackend *(*HybrisLocationBackendCreate)();
+}
+
+#define HYBRIS_LOCATION_BACKEND_PROBE   "hybrisLocationBackendProbe"
+#define HYBRIS_LOCATION_BACKEND_CREATE  "hybrisLocationBackendCreate"
+
+// Loads the backend plugin chosen on a previous start, or probes for one.
 HybrisLocationBackend *getLocationBackend();
+// Forgets the cached choice, the next getLocationBackend() probes again.
+void resetLocationBackend();
 
 #endif // HYBRIS_LOCATION_BACKEND_H
@@ -16,6 +16,7 @@
 #include "position_adaptor.h"
 #include "velocity_adaptor.h"
 #include "satellite_adaptor.h"
+#include "hybris_adaptor.h"
 
 #include "connectiond_interface.h"
 #include "connectionselector_interface.h"
@@ -26,18 +27,26 @@
 #include <QtNetwork/QUdpSocket>
 #include <QtNetwork/QHostInfo>
 #include <QtDBus/QDBusConnection>
+#include <QtDBus/QDBusError>
 #include <QtDBus/QDBusMessage>
+#include <QtCore/QCoreApplication>
+#include <QtCore/QSocketNotifier>
+#include <QtCore/QThread>
 
 #include <networkservice.h>
 
 #include <qofonomanager.h>
 #include <qofonoconnectionmanager.h>
 #include <qofonoconnectioncontext.h>
+#include <qofononetworkregistration.h>
+#include <qofonosimmanager.h>
 
 #include <qofonoextmodemmanager.h>
 
+#include <stdlib.h>
 #include <strings.h>
 #include <sys/time.h>
+#include <unistd.h>
 
 Q_DECLARE_METATYPE(QHostAddress)
 
@@ -57,11 +66,88 @@ namespace
 {
 
 const int QuitIdleTime = 30000;
+// hw_get_module() or the hwservicemanager lookup taking longer than this is treated as a failure.
+const int GnssInitTimeout = 20000;
 const int FixTimeout = 30000;
+// Fixes decimated in software may arrive this much early.
+const qint64 FixIntervalTolerance = 200;
 const quint32 MinimumInterval = 1000;
+// Default time the session is kept running after the last client is gone.
+const int StopLinger = 5000;
+// Default and upper bound of the GetPositionOnce() timeout, the default stays within the
+// 25 s default D-Bus call timeout.
+const int PositionRequestDefaultTimeout = 20000;
+const int PositionRequestTimeout = 120000;
+
+// Adaptive update intervals, see adaptiveUpdateInterval(). The last step bounds MaximumInterval.
+const quint32 AdaptiveMaximumInterval = 30000;
+const quint32 AdaptiveSteps[] = { 1000, 2000, 5000, 10000, 20000, 30000, 60000, 120000, 300000 };
+const int AdaptiveStepCount = sizeof(AdaptiveSteps) / sizeof(AdaptiveSteps[0]);
+const double StationarySpeed = 0.5;
+const double MpsToKnots = 1.943844;
 const quint32 PreferredAccuracy = 0;
 const quint32 PreferredInitialFixTime = 0;
 
+const uint GeofenceResponsiveness = 5000;
+const uint GeofenceUnknownTimer = 30000;
+const int GeofenceTransitions = HYBRIS_GNSS_GEOFENCE_ENTERED | HYBRIS_GNSS_GEOFENCE_EXITED |
+                                HYBRIS_GNSS_GEOFENCE_UNCERTAIN;
+
+struct PositioningProfile {
+    const char *name;
+    quint8 suplMode;
+    quint8 lppProfile;
+    quint8 glonassPositioningProtocol;
+    quint32 minimumInterval;
+    bool lowPowerMode;
+    QVector<HybrisGnssConstellationType> blacklist;
+};
+
+/*
+    Indexed by HybrisProvider::Profile. Constellations on their own carrier frequency cost
+    an extra RF path, GPS, Galileo, QZSS and SBAS share L1 and are always kept. The default
+    entry keeps full capability, it applies to clients without a profile so a single power
+    saving client cannot degrade them. Low power mode lets IGnss@1.1 chips duty cycle between
+    fixes.
+*/
+const PositioningProfile Profiles[] = {
+    { "background", HYBRIS_GNSS_SUPL_MODE_MSB, HYBRIS_GNSS_LPP_PROFILE_USER_PLANE,
+      HYBRIS_GNSS_GLONASS_POS_PROTOCOL_LPP_UPLANE,
+      10000, true, QVector<HybrisGnssConstellationType>() << HYBRIS_GNSS_CONSTELLATION_GLONASS
+                                                    << HYBRIS_GNSS_CONSTELLATION_BEIDOU },
+    { "fitness", HYBRIS_GNSS_SUPL_MODE_MSB, HYBRIS_GNSS_LPP_PROFILE_USER_PLANE,
+      HYBRIS_GNSS_GLONASS_POS_PROTOCOL_LPP_UPLANE,
+      1000, false, QVector<HybrisGnssConstellationType>() << HYBRIS_GNSS_CONSTELLATION_BEIDOU },
+    { "", HYBRIS_GNSS_SUPL_MODE_MSB, HYBRIS_GNSS_LPP_PROFILE_USER_PLANE,
+      HYBRIS_GNSS_GLONASS_POS_PROTOCOL_RRLP_UPLANE | HYBRIS_GNSS_GLONASS_POS_PROTOCOL_LPP_UPLANE,
+      0, false, QVector<HybrisGnssConstellationType>() },
+    { "navigation", HYBRIS_GNSS_SUPL_MODE_MSB, HYBRIS_GNSS_LPP_PROFILE_USER_PLANE,
+      HYBRIS_GNSS_GLONASS_POS_PROTOCOL_RRLP_UPLANE | HYBRIS_GNSS_GLONASS_POS_PROTOCOL_LPP_UPLANE,
+      1000, false, QVector<HybrisGnssConstellationType>() },
+};
+
+// Capability bits each version of the capabilities callback can report.
+const quint32 CapabilitiesReported10 = HYBRIS_GNSS_CAPABILITY_SCHEDULING |
+        HYBRIS_GNSS_CAPABILITY_MSB | HYBRIS_GNSS_CAPABILITY_MSA |
+        HYBRIS_GNSS_CAPABILITY_SINGLE_SHOT | HYBRIS_GNSS_CAPABILITY_ON_DEMAND_TIME |
+        HYBRIS_GNSS_CAPABILITY_GEOFENCING | HYBRIS_GNSS_CAPABILITY_MEASUREMENTS |
+        HYBRIS_GNSS_CAPABILITY_NAV_MESSAGES;
+const quint32 CapabilitiesReported20 =
+        (CapabilitiesReported10 & ~HYBRIS_GNSS_CAPABILITY_GEOFENCING) |
+        HYBRIS_GNSS_CAPABILITY_LOW_POWER_MODE | HYBRIS_GNSS_CAPABILITY_SATELLITE_BLACKLIST |
+        HYBRIS_GNSS_CAPABILITY_MEASUREMENT_CORRECTIONS;
+
+// Enough broadcast ephemerides for a warm start without XTRA data.
+const int MinimumValidEphemerides = 8;
+
+// GNSS chip state is polled while positioning, older snapshots are not trusted for aiding.
+const int DebugDataInterval = 60000;
+const qint64 DebugDataMaximumAge = 5 * 60000;
+const float MaximumEphemerisAge = 2 * 3600;
+const float MaximumServerPredictionAge = 24 * 3600;
+// NTP over mobile data does not do better than a few tens of milliseconds.
+const float MaximumTimeUncertaintyNs = 10000000;
+
 const int MaxXtraServers = 3;
 const QString XtraConfigFile = QStringLiteral("/etc/gps_xtra.ini");
 
@@ -69,6 +155,53 @@ void gnssXtraDownloadRequest()
 {
     QMetaObject::invokeMethod(staticProvider, "xtraDownloadRequest", Qt::QueuedConnection);
 }
+
+Location locationFromFix(const GnssFix &fix)
+{
+    Location location;
+    location.setTimestamp(fix.timestamp);
+    location.setLatitude(fix.latitude);
+    location.setLongitude(fix.longitude);
+    location.setAltitude(fix.altitude);
+    location.setSpeed(fix.speed);
+    location.setDirection(fix.direction);
+    location.setClimb(fix.climb);
+
+    Accuracy accuracy;
+    accuracy.setHorizontal(fix.horizontalAccuracy);
+    accuracy.setVertical(fix.verticalAccuracy);
+    location.setAccuracy(accuracy);
+
+    return location;
+}
+
+HybrisProvider::PositionFields positionFields(const Location &location)
+{
+    HybrisProvider::PositionFields positionFields = HybrisProvider::NoPositionFields;
+
+    if (!qIsNaN(location.latitude()))
+        positionFields |= HybrisProvider::LatitudePresent;
+    if (!qIsNaN(location.longitude()))
+        positionFields |= HybrisProvider::LongitudePresent;
+    if (!qIsNaN(location.altitude()))
+        positionFields |= HybrisProvider::AltitudePresent;
+
+    return positionFields;
+}
+
+HybrisProvider::VelocityFields velocityFields(const Location &location)
+{
+    HybrisProvider::VelocityFields velocityFields = HybrisProvider::NoVelocityFields;
+
+    if (!qIsNaN(location.speed()))
+        velocityFields |= HybrisProvider::SpeedPresent;
+    if (!qIsNaN(location.direction()))
+        velocityFields |= HybrisProvider::DirectionPresent;
+    if (!qIsNaN(location.climb()))
+        velocityFields |= HybrisProvider::ClimbPresent;
+
+    return velocityFields;
+}
 }
 
 QDBusArgument &operator<<(QDBusArgument &argument, const Accuracy &accuracy)
@@ -146,13 +279,188 @@ const QDBusArgument &operator>>(const QDBusArgument &argument, QList<SatelliteIn
     return argument;
 }
 
+QDBusArgument &operator<<(QDBusArgument &argument, const EphemerisInfo &info)
+{
+    argument.beginStructure();
+    argument << info.constellation() << info.svid() << info.ephemerisAge() << info.almanacAge();
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, EphemerisInfo &info)
+{
+    int a;
+
+    argument.beginStructure();
+    argument >> a;
+    info.setConstellation(a);
+    argument >> a;
+    info.setSvid(a);
+    argument >> a;
+    info.setEphemerisAge(a);
+    argument >> a;
+    info.setAlmanacAge(a);
+    argument.endStructure();
+    return argument;
+}
+
+QDBusArgument &operator<<(QDBusArgument &argument, const QList<EphemerisInfo> &infos)
+{
+    argument.beginArray(qMetaTypeId<EphemerisInfo>());
+    foreach (const EphemerisInfo &info, infos)
+        argument << info;
+    argument.endArray();
+
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, QList<EphemerisInfo> &infos)
+{
+    infos.clear();
+
+    argument.beginArray();
+    while (!argument.atEnd()) {
+        EphemerisInfo info;
+        argument >> info;
+        infos.append(info);
+    }
+    argument.endArray();
+
+    return argument;
+}
+
+QDBusArgument &operator<<(QDBusArgument &argument, const Location &location)
+{
+    argument.beginStructure();
+    argument << int(positionFields(location)) << int(location.timestamp() / 1000)
+             << location.latitude() << location.longitude() << location.altitude()
+             << location.accuracy();
+    argument << int(velocityFields(location)) << location.speed() << location.direction()
+             << location.climb();
+    argument.endStructure();
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, Location &location)
+{
+    int fields;
+    int timestamp;
+    double d;
+    Accuracy accuracy;
+
+    argument.beginStructure();
+    argument >> fields;
+    argument >> timestamp;
+    location.setTimestamp(qint64(timestamp) * 1000);
+    argument >> d;
+    location.setLatitude(d);
+    argument >> d;
+    location.setLongitude(d);
+    argument >> d;
+    location.setAltitude(d);
+    argument >> accuracy;
+    location.setAccuracy(accuracy);
+    argument >> fields;
+    argument >> d;
+    location.setSpeed(d);
+    argument >> d;
+    location.setDirection(d);
+    argument >> d;
+    location.setClimb(d);
+    argument.endStructure();
+    return argument;
+}
+
+QDBusArgument &operator<<(QDBusArgument &argument, const QList<Location> &locations)
+{
+    argument.beginArray(qMetaTypeId<Location>());
+    foreach (const Location &location, locations)
+        argument << location;
+    argument.endArray();
+
+    return argument;
+}
+
+const QDBusArgument &operator>>(const QDBusArgument &argument, QList<Location> &locations)
+{
+    locations.clear();
+
+    argument.beginArray();
+    while (!argument.atEnd()) {
+        Location location;
+        argument >> location;
+        locations.append(location);
+    }
+    argument.endArray();
+
+    return argument;
+}
+
+/*
+    Opens the GNSS HAL off the main thread, so that a slow hw_get_module() or hwservicemanager
+    lookup does not hold up D-Bus activation. The backend is handed back to the thread of the
+    provider before the thread finishes.
+*/
+class GnssInitThread : public QThread
+{
+public:
+    explicit GnssInitThread(QObject *parent)
+    :   QThread(parent), backend(Q_NULLPTR), initialised(false), elapsed(0),
+        m_targetThread(parent->thread())
+    {
+    }
+
+    HybrisLocationBackend *backend;
+    bool initialised;
+    qint64 elapsed;
+
+protected:
+    void run()
+    {
+        QElapsedTimer timer;
+        timer.start();
+
+        backend = getLocationBackend();
+        initialised = backend && backend->gnssInit();
+        if (backend)
+            backend->moveToThread(m_targetThread);
+        if (!initialised)
+            resetLocationBackend();
+
+        elapsed = timer.elapsed();
+    }
+
+private:
+    QThread *m_targetThread;
+};
+
 HybrisProvider::HybrisProvider(QObject *parent)
-:   QObject(parent), m_backend(Q_NULLPTR),
+:   QObject(parent), m_backend(Q_NULLPTR), m_gnssEventNotifier(Q_NULLPTR), m_droppedFixes(0),
+    m_droppedSatelliteEpochs(0), m_gnssWakelock(QByteArrayLiteral("geoclue-hybris-gnss")),
+    m_measurementsStarted(false), m_navigationMessagesStarted(false), m_navigationMessagesFailed(false),
+    m_onlineAidingPending(false), m_fixLatency(-1), m_gnssInitThread(Q_NULLPTR),
+    m_extensionsInitialised(false), m_deleteAidingDataPending(false),
+    m_halRecoveryCount(0), m_lastHalRecoveryTime(0),
+    m_nextGeofenceId(1), m_geofencingSupported(false), m_geofencingAvailable(false),
     m_status(StatusUnavailable), m_positionInjectionConnected(false), m_xtraDownloadReply(Q_NULLPTR), m_xtraServerIndex(0),
-    m_requestedConnect(false), m_gpsStarted(false), m_locationSettings(Q_NULLPTR),
+    m_requestedConnect(false), m_gpsStarted(false), m_sessionReferenced(false), m_stopLinger(StopLinger),
+    m_positionModeSet(false), m_positionMode(0), m_positionModeRecurrence(0), m_positionModeInterval(0),
+    m_positionModeLowPower(false), m_positionModeAccuracy(PreferredAccuracy),
+    m_sessionStarts(0), m_sessionStops(0), m_sessionResumes(0),
+    m_positionModeChanges(0), m_positionModeSkips(0), m_adaptiveBaseInterval(0),
+    m_adaptiveInterval(0), m_adaptiveTime(0), m_adaptiveSavedTime(0),
+    m_capabilities(0), m_reportedCapabilities(0), m_capabilitiesKnown(false),
+    m_softwareFixInterval(0), m_lastFixTimestamp(0), m_configurationSupported(false),
+    m_profile(ProfileDefault), m_batchSize(0), m_batching(false),
+    m_batchingInterval(0), m_locationSettings(Q_NULLPTR),
     m_networkManager(new NetworkManager(this)), m_cellularTechnology(Q_NULLPTR),
     m_ofonoExtModemManager(new QOfonoExtModemManager(this)),
-    m_connectionManager(new QOfonoConnectionManager(this)), m_connectionContext(Q_NULLPTR), m_ntpSocket(Q_NULLPTR),
+    m_connectionManager(new QOfonoConnectionManager(this)), m_connectionContext(Q_NULLPTR),
+    m_networkRegistration(new QOfonoNetworkRegistration(this)), m_simManager(new QOfonoSimManager(this)),
+    m_agpsRilRefLocationRequested(false), m_agpsRilSetIdFlags(0), m_agpsRilRefLocation(),
+    m_agpsRilSetIdType(HYBRIS_AGNSS_SETID_TYPE_NONE), m_networkConnected(false),
+    m_networkType(HYBRIS_AGNSS_RIL_NETWORK_TYPE_MOBILE), m_networkRoaming(false),
+    m_networkAvailable(false), m_ntpSocket(Q_NULLPTR),
     m_agpsEnabled(false), m_agpsOnlineEnabled(false), m_useForcedNtpInject(false), m_useForcedXtraInject(false),
     m_suplPort(0)
 {
@@ -161,9 +469,16 @@ HybrisProvider::HybrisProvider(QObject *parent)
 
     qRegisterMetaType<Location>();
     qRegisterMetaType<QHostAddress>();
+    qRegisterMetaType<GnssFix>();
+    qRegisterMetaType<QVector<GnssFix> >();
+    qRegisterMetaType<HybrisGnssDebugData>();
     qDBusRegisterMetaType<Accuracy>();
     qDBusRegisterMetaType<SatelliteInfo>();
     qDBusRegisterMetaType<QList<SatelliteInfo> >();
+    qDBusRegisterMetaType<Location>();
+    qDBusRegisterMetaType<QList<Location> >();
+    qDBusRegisterMetaType<EphemerisInfo>();
+    qDBusRegisterMetaType<QList<EphemerisInfo> >();
 
     staticProvider = this;
 
@@ -171,11 +486,17 @@ HybrisProvider::HybrisProvider(QObject *parent)
     new PositionAdaptor(this);
     new VelocityAdaptor(this);
     new SatelliteAdaptor(this);
+    new HybrisAdaptor(this);
+
+    // Fixes and satellite epochs from the HAL callbacks are drained on this thread.
+    m_gnssEventNotifier = new QSocketNotifier(m_gnssEvents.fd(), QSocketNotifier::Read, this);
+    connect(m_gnssEventNotifier, SIGNAL(activated(int)), this, SLOT(processGnssEvents()));
 
     m_manager = new QNetworkAccessManager(this);
 
     connect(m_networkManager, &NetworkManager::technologiesChanged, this, &HybrisProvider::technologiesChanged);
     connect(m_networkManager, &NetworkManager::globalStateChanged, this, &HybrisProvider::stateChanged);
+    connect(m_networkManager, &NetworkManager::defaultRouteChanged, this, &HybrisProvider::updateNetworkState);
 
     technologiesChanged();
 
@@ -185,6 +506,26 @@ HybrisProvider::HybrisProvider(QObject *parent)
     connect(m_connectionManager, SIGNAL(validChanged(bool)),
             this, SLOT(connectionManagerValidChanged()));
 
+    connect(m_networkRegistration, SIGNAL(validChanged(bool)),
+            this, SLOT(networkRegistrationChanged()));
+    connect(m_networkRegistration, SIGNAL(statusChanged(QString)),
+            this, SLOT(networkRegistrationChanged()));
+    connect(m_networkRegistration, SIGNAL(technologyChanged(QString)),
+            this, SLOT(networkRegistrationChanged()));
+    connect(m_networkRegistration, SIGNAL(mccChanged(QString)),
+            this, SLOT(networkRegistrationChanged()));
+    connect(m_networkRegistration, SIGNAL(mncChanged(QString)),
+            this, SLOT(networkRegistrationChanged()));
+    connect(m_networkRegistration, SIGNAL(locationAreaCodeChanged(uint)),
+            this, SLOT(networkRegistrationChanged()));
+    connect(m_networkRegistration, SIGNAL(cellIdChanged(uint)),
+            this, SLOT(networkRegistrationChanged()));
+
+    connect(m_simManager, SIGNAL(subscriberIdentityChanged(QString)),
+            this, SLOT(simManagerChanged()));
+    connect(m_simManager, SIGNAL(subscriberNumbersChanged(QStringList)),
+            this, SLOT(simManagerChanged()));
+
     defaultDataModemChanged(m_ofonoExtModemManager->defaultDataModem());
 
     QDBusConnection connection = QDBusConnection::sessionBus();
@@ -234,6 +575,10 @@ HybrisProvider::HybrisProvider(QObject *parent)
     if (m_useForcedNtpInject)
         qCDebug(lcGeoclueHybris) << "Forcing NTP injection";
 
+    // Lingering past the idle quit time would be cut short by the exit.
+    m_stopLinger = qBound(0, settings.value("session/linger", StopLinger).toInt(), QuitIdleTime - 1000);
+    qCDebug(lcGeoclueHybris) << "Stopping positioning" << m_stopLinger << "ms after the last client";
+
     m_suplHost = settings.value("supl/SUPL_HOST").toString();
     m_suplPort = settings.value("supl/SUPL_PORT").toInt();
     if (!m_suplHost.isEmpty() && m_suplPort > 0)
@@ -243,28 +588,41 @@ HybrisProvider::HybrisProvider(QObject *parent)
         loadDefaultsFromConfigurationFile();
     }
 
-    m_backend = getLocationBackend();
+    m_navigationCacheFile = QStringLiteral(GEOCLUE_HYBRIS_STATE_DIR "/navigation.cache");
+    if (m_navigationCache.load(m_navigationCacheFile))
+        qCDebug(lcGeoclueHybris) << "Loaded navigation data cache" << m_navigationCacheFile;
 
-    if (!m_backend || !m_backend->gnssInit()) {
-        m_status = StatusError;
-        return;
-    }
+    // Fed from the event loop, a HAL call which never returns stops the notifications.
+    if (m_gnssWatchdog.systemdInterval() > 0)
+        m_systemdWatchdogTimer.start(m_gnssWatchdog.systemdInterval(), this);
 
-    m_backend->aGnssInit();
-    m_backend->gnssNiInit();
-    m_backend->aGnssRilInit();
-    m_backend->gnssXtraInit();
-    m_backend->gnssDebugInit();
+    startGnssInit();
+}
 
-    // Set SUPL server if provided
-    if (!m_suplHost.isEmpty() && m_suplPort > 0) {
-        if (!m_backend->aGnssSetServer(HYBRIS_AGNSS_TYPE_SUPL, m_suplHost.toLatin1().constData(), m_suplPort))
-            qWarning("Setting SUPL server to %s (%i) failed", m_suplHost.toLatin1().constData(), m_suplPort);
-    }
+/*
+    The service is registered while the HAL is brought up, calls needing it are replayed
+    from gnssInitFinished().
+*/
+void HybrisProvider::startGnssInit()
+{
+    setStatus(StatusAcquiring);
+
+    m_gnssInitThread = new GnssInitThread(this);
+    connect(m_gnssInitThread, SIGNAL(finished()), this, SLOT(gnssInitFinished()));
+    m_gnssInitThread->start();
+    m_gnssInitTimer.start(GnssInitTimeout, this);
 }
 
 HybrisProvider::~HybrisProvider()
 {
+    saveNavigationCache();
+
+    if (m_gnssInitThread) {
+        // The HAL call cannot be interrupted, leave the thread to process exit.
+        qWarning("GNSS HAL initialisation still running on exit");
+        m_gnssInitThread->setParent(Q_NULLPTR);
+    }
+
     if (m_backend) {
         m_backend->gnssCleanup();
         delete m_backend;
@@ -317,6 +675,157 @@ void HybrisProvider::loadDefaultsFromConfigurationFile()
     }
 }
 
+/*
+    Takes over the backend opened by GnssInitThread and replays what clients requested in
+    the meantime.
+*/
+void HybrisProvider::gnssInitFinished()
+{
+    GnssInitThread *thread = m_gnssInitThread;
+    m_gnssInitThread = Q_NULLPTR;
+    m_gnssInitTimer.stop();
+
+    if (thread->backend)
+        m_backend = new GnssWatchdogBackend(thread->backend, &m_gnssWatchdog);
+    const bool initialised = thread->initialised;
+    thread->deleteLater();
+
+    if (!initialised) {
+        qWarning("GNSS HAL initialisation failed after %lld ms", thread->elapsed);
+        // Nothing to initialise without the HAL.
+        m_extensionsInitialised = true;
+        setStatus(StatusError);
+
+        for (QMap<int, Geofence>::iterator it = m_geofences.begin(); it != m_geofences.end();) {
+            if (it->pendingReply.type() != QDBusMessage::InvalidMessage) {
+                QDBusConnection::sessionBus().send(it->pendingReply.createErrorReply(
+                    QDBusError::Failed, QStringLiteral("GNSS not available")));
+            }
+            const QString service = it->service;
+            it = m_geofences.erase(it);
+            unwatchServiceIfUnused(service);
+        }
+        startIdleTimerIfNeeded();
+        return;
+    }
+
+    qCDebug(lcGeoclueHybris) << "GNSS HAL initialised in" << thread->elapsed << "ms";
+
+    if (m_status == StatusAcquiring || m_status == StatusError)
+        setStatus(StatusUnavailable);
+
+    // Extensions are set up right away if a client is waiting, otherwise in the background.
+    if (m_watchedServices.isEmpty() && m_geofences.isEmpty())
+        QMetaObject::invokeMethod(this, "initExtensions", Qt::QueuedConnection);
+    else
+        initExtensions();
+
+    if (m_deleteAidingDataPending) {
+        m_deleteAidingDataPending = false;
+        m_backend->gnssDeleteAidingData(0xFFFF);
+    }
+
+    for (QMap<int, Geofence>::iterator it = m_geofences.begin(); it != m_geofences.end();) {
+        if (!it->queued) {
+            ++it;
+            continue;
+        }
+
+        it->queued = false;
+        const int id = it.key();
+        if (!m_geofencingSupported
+                || !m_backend->gnssGeofenceAdd(id, it->latitude, it->longitude, it->radius,
+                                               HYBRIS_GNSS_GEOFENCE_UNCERTAIN, it->monitorTransitions,
+                                               it->responsiveness > 0 ? it->responsiveness : GeofenceResponsiveness,
+                                               GeofenceUnknownTimer)) {
+            if (it->pendingReply.type() != QDBusMessage::InvalidMessage) {
+                QDBusConnection::sessionBus().send(it->pendingReply.createErrorReply(
+                    m_geofencingSupported ? QDBusError::Failed : QDBusError::NotSupported,
+                    m_geofencingSupported ? QStringLiteral("Failed to add geofence")
+                                          : QStringLiteral("Geofencing not supported by the GNSS chip")));
+            }
+            const QString service = it->service;
+            it = m_geofences.erase(it);
+            unwatchServiceIfUnused(service);
+            continue;
+        }
+
+        if (it->paused)
+            m_backend->gnssGeofencePause(id);
+        ++it;
+    }
+
+    updateProfile();
+    startPositioningIfNeeded();
+    updateBatching();
+}
+
+/*
+    Calls into the backend kept exceeding their deadlines. The backend is not rebuilt in
+    process, vendor HALs cannot be initialised again after cleanup and the privileges needed
+    to load them have been dropped. Exits with an error instead, systemd restarts the provider.
+*/
+void HybrisProvider::gnssBackendWedged()
+{
+    qWarning("GNSS backend calls keep exceeding their deadlines, exiting");
+    QCoreApplication::exit(EXIT_FAILURE);
+}
+
+/*
+    Sets up the HAL extensions. Each takes one or two synchronous binder transactions, so
+    this is kept out of the constructor and runs after the D-Bus service is registered, or
+    earlier when a client needs an extension.
+*/
+void HybrisProvider::initExtensions()
+{
+    if (m_extensionsInitialised || !m_backend)
+        return;
+
+    m_extensionsInitialised = true;
+
+    QElapsedTimer totalTimer;
+    totalTimer.start();
+    QElapsedTimer timer;
+    timer.start();
+
+    m_backend->aGnssInit();
+    qCDebug(lcGeoclueHybris) << "AGNSS initialised in" << timer.restart() << "ms";
+    m_backend->gnssNiInit();
+    qCDebug(lcGeoclueHybris) << "GNSS NI initialised in" << timer.restart() << "ms";
+    m_backend->aGnssRilInit();
+    sendNetworkState(true);
+    qCDebug(lcGeoclueHybris) << "AGNSS RIL initialised in" << timer.restart() << "ms";
+    m_backend->gnssXtraInit();
+    qCDebug(lcGeoclueHybris) << "GNSS XTRA initialised in" << timer.restart() << "ms";
+    m_backend->gnssDebugInit();
+    qCDebug(lcGeoclueHybris) << "GNSS debug initialised in" << timer.restart() << "ms";
+
+    if (m_backend->gnssBatchingInit()) {
+        m_batchSize = m_backend->gnssBatchingGetBatchSize();
+        qCDebug(lcGeoclueHybris) << "GNSS batching supported, batch size" << m_batchSize;
+    }
+    qCDebug(lcGeoclueHybris) << "GNSS batching initialised in" << timer.restart() << "ms";
+
+    m_configurationSupported = m_backend->gnssConfigurationInit();
+    qCDebug(lcGeoclueHybris) << "GNSS configuration initialised in" << timer.restart() << "ms";
+
+    if (m_backend->gnssGeofencingInit()) {
+        m_geofencingSupported = true;
+        m_geofencingAvailable = true;
+        qCDebug(lcGeoclueHybris) << "GNSS geofencing supported";
+    }
+    qCDebug(lcGeoclueHybris) << "GNSS geofencing initialised in" << timer.restart() << "ms";
+
+    // Set SUPL server if provided
+    if (!m_suplHost.isEmpty() && m_suplPort > 0) {
+        if (m_backend->aGnssSetServer(HYBRIS_AGNSS_TYPE_SUPL, m_suplHost.toLatin1().constData(), m_suplPort) != 0)
+            qWarning("Setting SUPL server to %s (%i) failed", m_suplHost.toLatin1().constData(), m_suplPort);
+    }
+
+    qCDebug(lcGeoclueHybris) << "GNSS extensions initialised in" << totalTimer.elapsed()
+                             << "ms, outside of D-Bus activation";
+}
+
 void HybrisProvider::setLocationSettings(LocationSettings *settings)
 {
     if (!m_locationSettings) {
@@ -343,7 +852,7 @@ void HybrisProvider::AddReference()
     if (!calledFromDBus())
         qFatal("AddReference must only be called from DBus");
 
-    bool wasInactive = m_watchedServices.isEmpty();
+    bool wasInactive = m_watchedServices.isEmpty() && m_geofences.isEmpty();
     const QString service = message().service();
     m_watcher->addWatchedService(service);
     m_watchedServices[service].referenceCount += 1;
@@ -353,6 +862,7 @@ void HybrisProvider::AddReference()
     }
 
     startPositioningIfNeeded();
+    updateBatching();
 }
 
 void HybrisProvider::RemoveReference()
@@ -366,16 +876,16 @@ void HybrisProvider::RemoveReference()
         m_watchedServices[service].referenceCount -= 1;
 
     if (m_watchedServices[service].referenceCount == 0) {
-        m_watcher->removeWatchedService(service);
+        closeMeasurements(service);
         m_watchedServices.remove(service);
+        unwatchServiceIfUnused(service);
     }
 
-    if (m_watchedServices.isEmpty()) {
-        qCDebug(lcGeoclueHybris) << "no watched services, starting idle timer.";
-        m_idleTimer.start(QuitIdleTime, this);
-    }
+    startIdleTimerIfNeeded();
 
     stopPositioningIfNeeded();
+    updateProfile();
+    updateBatching();
 }
 
 QString HybrisProvider::GetProviderInfo(QString &description)
@@ -394,6 +904,8 @@ void HybrisProvider::SetOptions(const QVariantMap &options)
     if (!calledFromDBus())
         qFatal("SetOptions must only be called from DBus");
 
+    initExtensions();
+
     const QString service = message().service();
     if (!m_watchedServices.contains(service)) {
         qWarning("Only active users can call SetOptions");
@@ -404,12 +916,36 @@ void HybrisProvider::SetOptions(const QVariantMap &options)
         m_watchedServices[service].updateInterval =
             options.value(QStringLiteral("UpdateInterval")).toUInt();
 
-        quint32 updateInterval = minimumRequestedUpdateInterval();
+        updatePositionMode();
+    }
+
+    // Lets the interval follow the speed, see adaptiveUpdateInterval().
+    if (options.contains(QStringLiteral("MinimumDistance")) ||
+            options.contains(QStringLiteral("MaximumInterval"))) {
+        ServiceData &data = m_watchedServices[service];
+        if (options.contains(QStringLiteral("MinimumDistance")))
+            data.minimumDistance = qMax(0.0, options.value(QStringLiteral("MinimumDistance")).toDouble());
+        if (options.contains(QStringLiteral("MaximumInterval")))
+            data.maximumInterval = qMin(options.value(QStringLiteral("MaximumInterval")).toUInt(),
+                                        AdaptiveSteps[AdaptiveStepCount - 1]);
+
+        updatePositionMode();
+    }
+
+    // Trades time to fix and accuracy against power, see Profiles.
+    if (options.contains(QStringLiteral("Profile"))) {
+        const QString name = options.value(QStringLiteral("Profile")).toString();
+        Profile profile = ProfileDefault;
+        for (int i = ProfileBackground; i <= ProfileNavigation; ++i) {
+            if (name == QLatin1String(Profiles[i].name))
+                profile = static_cast<Profile>(i);
+        }
+
+        if (profile == ProfileDefault && !name.isEmpty())
+            qWarning("Unknown positioning profile %s", qPrintable(name));
 
-        m_backend->gnssSetPositionMode(m_agpsEnabled ? HYBRIS_GNSS_POSITION_MODE_MS_BASED
-                                                     : HYBRIS_GNSS_POSITION_MODE_STANDALONE,
-                                       HYBRIS_GNSS_POSITION_RECURRENCE_PERIODIC, updateInterval,
-                                       PreferredAccuracy, PreferredInitialFixTime);
+        m_watchedServices[service].profile = profile;
+        updateProfile();
     }
 
     if (options.contains(QStringLiteral("NoCachedAidingData"))
@@ -417,80 +953,537 @@ void HybrisProvider::SetOptions(const QVariantMap &options)
             && m_backend) {
         //GPS_DELETE_ALL = 0xFFFF (almanac, ephemeris, position, time and other cache data)
         m_backend->gnssDeleteAidingData(0xFFFF);
+    } else if (options.value(QStringLiteral("NoCachedAidingData")).toBool() && m_gnssInitThread) {
+        m_deleteAidingDataPending = true;
+    }
+
+    // Fixes are buffered by the GNSS chip and delivered with the LocationsBatched signal.
+    if (options.contains(QStringLiteral("Batching"))) {
+        m_watchedServices[service].batching = options.value(QStringLiteral("Batching")).toBool();
     }
+
+    updateBatching();
 }
 
-int HybrisProvider::GetPosition(int &timestamp, double &latitude, double &longitude,
-                                double &altitude, Accuracy &accuracy)
+/*
+    Subscribes the caller to raw GNSS measurements. Returns a read-only descriptor of the
+    shared memory described in gnssmeasurementchannel.h and an event fd which is signalled
+    when new epochs are available. Measurements flow while positioning is running, which
+    is started for the caller if needed. Fails when positioning cannot run.
+*/
+QDBusUnixFileDescriptor HybrisProvider::OpenMeasurements(QDBusUnixFileDescriptor &notifier)
 {
-    PositionFields positionFields = NoPositionFields;
+    if (!calledFromDBus())
+        qFatal("OpenMeasurements must only be called from DBus");
 
-    timestamp = m_currentLocation.timestamp() / 1000;
-    if (!qIsNaN(m_currentLocation.latitude()))
-        positionFields |= LatitudePresent;
-    latitude = m_currentLocation.latitude();
-    if (!qIsNaN(m_currentLocation.longitude()))
-        positionFields |= LongitudePresent;
-    longitude = m_currentLocation.longitude();
-    if (!qIsNaN(m_currentLocation.altitude()))
-        positionFields |= AltitudePresent;
-    altitude = m_currentLocation.altitude();
-    accuracy = m_currentLocation.accuracy();
+    const QString service = message().service();
+    if (!m_watchedServices.contains(service)) {
+        sendErrorReply(QDBusError::AccessDenied, QStringLiteral("Only active users can open measurements"));
+        return QDBusUnixFileDescriptor();
+    }
 
-    return positionFields;
-}
+    if (!(connection().connectionCapabilities() & QDBusConnection::UnixFileDescriptorPassing)) {
+        sendErrorReply(QDBusError::NotSupported, QStringLiteral("File descriptor passing not supported"));
+        return QDBusUnixFileDescriptor();
+    }
 
-int HybrisProvider::GetVelocity(int &timestamp, double &speed, double &direction, double &climb)
-{
-    VelocityFields velocityFields = NoVelocityFields;
+    if (!hasCapability(HYBRIS_GNSS_CAPABILITY_MEASUREMENTS)) {
+        sendErrorReply(QDBusError::NotSupported, QStringLiteral("Measurements not supported by the GNSS chip"));
+        return QDBusUnixFileDescriptor();
+    }
 
-    timestamp = m_currentLocation.timestamp() / 1000;
-    if (!qIsNaN(m_currentLocation.speed()))
-        velocityFields |= SpeedPresent;
-    speed = m_currentLocation.speed();
-    if (!qIsNaN(m_currentLocation.direction()))
-        velocityFields |= DirectionPresent;
-    direction = m_currentLocation.direction();
-    if (!qIsNaN(m_currentLocation.climb()))
-        velocityFields |= ClimbPresent;
-    climb = m_currentLocation.climb();
+    if ((!m_backend && !m_gnssInitThread) || !m_gnssMeasurements.open()) {
+        sendErrorReply(QDBusError::Failed, QStringLiteral("Measurements not available"));
+        return QDBusUnixFileDescriptor();
+    }
 
-    return velocityFields;
-}
+    ServiceData &data = m_watchedServices[service];
+    if (data.measurementEventFd == -1)
+        data.measurementEventFd = m_gnssMeasurements.addSubscriber();
+
+    const int memoryFd = m_gnssMeasurements.duplicateReadOnlyFd();
+    if (memoryFd == -1 || data.measurementEventFd == -1) {
+        if (memoryFd != -1)
+            close(memoryFd);
+        closeMeasurements(service);
+        sendErrorReply(QDBusError::Failed, QStringLiteral("Failed to open measurement channel"));
+        return QDBusUnixFileDescriptor();
+    }
 
-int HybrisProvider::GetLastSatellite(int &satelliteUsed, int &satelliteVisible,
-                                     QList<int> &usedPrn, QList<SatelliteInfo> &satInfo)
-{
-    satelliteUsed = m_previousUsedPrns.length();
-    satelliteVisible = m_previousVisibleSatellites.length();
-    usedPrn = m_previousUsedPrns;
-    satInfo = m_previousVisibleSatellites;
+    // Measurements only flow with positioning, the caller would otherwise wait forever.
+    startPositioningIfNeeded();
+    if (!m_gpsStarted && !m_gnssInitThread) {
+        close(memoryFd);
+        closeMeasurements(service);
+        if (!positioningEnabled())
+            sendErrorReply(QDBusError::AccessDenied, QStringLiteral("Positioning is disabled"));
+        else
+            sendErrorReply(QDBusError::Failed, QStringLiteral("Positioning could not be started"));
+        return QDBusUnixFileDescriptor();
+    }
 
-    return m_previousSatelliteTimestamp;
+    updateMeasurements();
+    if (m_gpsStarted && !m_measurementsStarted) {
+        close(memoryFd);
+        closeMeasurements(service);
+        sendErrorReply(QDBusError::NotSupported, QStringLiteral("Measurements not supported by the GNSS chip"));
+        return QDBusUnixFileDescriptor();
+    }
+
+    // QDBusUnixFileDescriptor keeps its own duplicate.
+    QDBusUnixFileDescriptor memory(memoryFd);
+    close(memoryFd);
+    notifier.setFileDescriptor(data.measurementEventFd);
+
+    return memory;
 }
 
-int HybrisProvider::GetSatellite(int &satelliteUsed, int &satelliteVisible, QList<int> &usedPrn,
-                                 QList<SatelliteInfo> &satInfo)
+void HybrisProvider::CloseMeasurements()
 {
-    satelliteUsed = m_usedPrns.length();
-    satelliteVisible = m_visibleSatellites.length();
-    usedPrn = m_usedPrns;
-    satInfo = m_visibleSatellites;
+    if (!calledFromDBus())
+        qFatal("CloseMeasurements must only be called from DBus");
 
-    return m_satelliteTimestamp;
+    closeMeasurements(message().service());
 }
 
-void HybrisProvider::timerEvent(QTimerEvent *event)
+/*
+    Returns one fix with a horizontal accuracy of at most maximumAccuracy meters. The
+    current fix is returned if it is recent enough, otherwise a session is started just for
+    the request and stopped as soon as the fix arrives, without the caller holding a
+    reference. Ages and timeout are in milliseconds.
+*/
+Location HybrisProvider::GetPositionOnce(double maximumAccuracy, int maximumAge, int timeout)
 {
-    if (event->timerId() == m_idleTimer.timerId()) {
-        m_idleTimer.stop();
-        qCDebug(lcGeoclueHybris) << "have been idle for too long, quitting";
-        qApp->quit();
-    } else if (event->timerId() == m_fixLostTimer.timerId()) {
-        m_fixLostTimer.stop();
+    if (!calledFromDBus())
+        qFatal("GetPositionOnce must only be called from DBus");
+
+    if (!(maximumAccuracy > 0.0) || maximumAge < 0) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("Invalid accuracy or age"));
+        return Location();
+    }
+
+    const qint64 age = QDateTime::currentMSecsSinceEpoch() - m_currentLocation.timestamp();
+    if (m_currentLocation.timestamp() != 0 && age <= maximumAge &&
+            isPositionAccurate(m_currentLocation, maximumAccuracy)) {
+        return m_currentLocation;
+    }
+
+    if (!positioningEnabled()) {
+        sendErrorReply(QDBusError::AccessDenied, QStringLiteral("Positioning is disabled"));
+        return Location();
+    }
+
+    PositionRequest request;
+    request.pendingReply = message();
+    request.maximumAccuracy = maximumAccuracy;
+    request.timeout = timeout > 0 ? qMin(timeout, PositionRequestTimeout) : PositionRequestDefaultTimeout;
+    request.elapsed.start();
+    m_positionRequests.append(request);
+    setDelayedReply(true);
+
+    m_watcher->addWatchedService(message().service());
+    m_idleTimer.stop();
+
+    startPositionRequestTimer();
+    startPositioningIfNeeded();
+
+    return Location();
+}
+
+/*
+    Adds a geofence monitored by the GNSS chip, positioning does not need to be running.
+    The reply carries the geofence id once the chip has accepted the geofence, transitions
+    are sent to the caller only with the GeofenceTransition signal. Geofences are removed
+    when the caller disconnects from the bus.
+*/
+int HybrisProvider::AddGeofence(double latitude, double longitude, double radius,
+                                int monitorTransitions, uint responsiveness)
+{
+    if (!calledFromDBus())
+        qFatal("AddGeofence must only be called from DBus");
+
+    initExtensions();
+
+    if (!m_geofencingSupported && !m_gnssInitThread) {
+        sendErrorReply(QDBusError::NotSupported, QStringLiteral("Geofencing not supported by the GNSS chip"));
+        return 0;
+    }
+
+    if (qAbs(latitude) > 90.0 || qAbs(longitude) > 180.0 || !(radius > 0.0)
+            || !monitorTransitions || (monitorTransitions & ~GeofenceTransitions)) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("Invalid geofence"));
+        return 0;
+    }
+
+    const int id = m_nextGeofenceId++;
+    const QString service = message().service();
+
+    Geofence &geofence = m_geofences[id];
+    geofence.service = service;
+    geofence.monitorTransitions = monitorTransitions;
+    geofence.latitude = latitude;
+    geofence.longitude = longitude;
+    geofence.radius = radius;
+    geofence.responsiveness = responsiveness;
+
+    if (m_gnssInitThread) {
+        geofence.queued = true;
+    } else if (!m_backend->gnssGeofenceAdd(id, latitude, longitude, radius, HYBRIS_GNSS_GEOFENCE_UNCERTAIN,
+                                    monitorTransitions,
+                                    responsiveness > 0 ? responsiveness : GeofenceResponsiveness,
+                                    GeofenceUnknownTimer)) {
+        m_geofences.remove(id);
+        sendErrorReply(QDBusError::Failed, QStringLiteral("Failed to add geofence"));
+        return 0;
+    }
+
+    setDelayedReply(true);
+    geofence.pendingReply = message();
+
+    m_watcher->addWatchedService(service);
+    m_idleTimer.stop();
+
+    return id;
+}
+
+void HybrisProvider::RemoveGeofence(int id)
+{
+    if (!calledFromDBus())
+        qFatal("RemoveGeofence must only be called from DBus");
+
+    QMap<int, Geofence>::iterator it = m_geofences.find(id);
+    if (it == m_geofences.end() || it->service != message().service()) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("Unknown geofence"));
+        return;
+    }
+
+    const QString service = it->service;
+    if (it->pendingReply.type() != QDBusMessage::InvalidMessage) {
+        QDBusConnection::sessionBus().send(it->pendingReply.createErrorReply(
+            QDBusError::Failed, QStringLiteral("Geofence removed")));
+    }
+    const bool queued = it->queued;
+    m_geofences.erase(it);
+    if (!queued)
+        m_backend->gnssGeofenceRemove(id);
+
+    unwatchServiceIfUnused(service);
+    startIdleTimerIfNeeded();
+}
+
+void HybrisProvider::PauseGeofence(int id)
+{
+    if (!calledFromDBus())
+        qFatal("PauseGeofence must only be called from DBus");
+
+    QMap<int, Geofence>::iterator it = m_geofences.find(id);
+    if (it == m_geofences.end() || it->service != message().service()) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("Unknown geofence"));
+        return;
+    }
+
+    if (it->paused)
+        return;
+
+    it->paused = true;
+    if (!it->queued)
+        m_backend->gnssGeofencePause(id);
+}
+
+void HybrisProvider::ResumeGeofence(int id, int monitorTransitions)
+{
+    if (!calledFromDBus())
+        qFatal("ResumeGeofence must only be called from DBus");
+
+    QMap<int, Geofence>::iterator it = m_geofences.find(id);
+    if (it == m_geofences.end() || it->service != message().service()) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("Unknown geofence"));
+        return;
+    }
+
+    if (!monitorTransitions || (monitorTransitions & ~GeofenceTransitions)) {
+        sendErrorReply(QDBusError::InvalidArgs, QStringLiteral("Invalid geofence transitions"));
+        return;
+    }
+
+    if (!it->paused && it->monitorTransitions == monitorTransitions)
+        return;
+
+    it->paused = false;
+    it->monitorTransitions = monitorTransitions;
+    if (!it->queued)
+        m_backend->gnssGeofenceResume(id, monitorTransitions);
+}
+
+/*
+    Returns the age in seconds of the broadcast ephemeris and almanac of each satellite
+    heard by the GNSS chip, relative to their reference times. Ephemeris ages are negative
+    before the reference time, data not received is reported as 0x7fffffff.
+*/
+QList<EphemerisInfo> HybrisProvider::GetEphemerisAges()
+{
+    const qint64 currentTime = QDateTime::currentMSecsSinceEpoch();
+    QList<EphemerisInfo> infos;
+
+    for (int i = 0; i < GnssNavigationEphemerides; ++i) {
+        const GnssEphemeris &ephemeris = m_navigationCache.ephemeris(i);
+        if (!ephemeris.toeTime)
+            continue;
+
+        EphemerisInfo info;
+        info.setConstellation(ephemeris.constellation);
+        info.setSvid(ephemeris.svid);
+        info.setEphemerisAge((currentTime - ephemeris.toeTime) / 1000);
+        infos.append(info);
+    }
+
+    for (int i = 0; i < GnssNavigationAlmanacs; ++i) {
+        const GnssAlmanac &almanac = m_navigationCache.almanac(i);
+        if (!almanac.toaTime)
+            continue;
+
+        const int age = (currentTime - almanac.toaTime) / 1000;
+        bool found = false;
+        for (int j = 0; j < infos.count() && !found; ++j) {
+            if (infos.at(j).constellation() == almanac.constellation && infos.at(j).svid() == almanac.svid) {
+                infos[j].setAlmanacAge(age);
+                found = true;
+            }
+        }
+
+        if (!found) {
+            EphemerisInfo info;
+            info.setConstellation(almanac.constellation);
+            info.setSvid(almanac.svid);
+            info.setAlmanacAge(age);
+            infos.append(info);
+        }
+    }
+
+    return infos;
+}
+
+/*
+    Returns the last GNSS chip state polled while positioning, Age is the age of the snapshot
+    in seconds. Capabilities are the HYBRIS_GNSS_CAPABILITY bits reported by the chip and
+    FixLatency is the delay in milliseconds of the last fix, if the HAL reports fix times.
+    Threads lists the threads started by a libhardware HAL with their CPU time in
+    milliseconds and the number of callbacks each delivered. Wakelock accounts the suspend
+    blocker held for the HAL, hold times are in milliseconds and Histogram counts the holds
+    shorter than 10 ms, 100 ms, 1 s, 5 s and longer. Calls lists the latency in milliseconds
+    of each backend method and how often it exceeded its deadline. HalRecovery counts the
+    reconnections to a restarted HAL and the time in milliseconds the last one took.
+*/
+QVariantMap HybrisProvider::GetDiagnostics()
+{
+    QVariantMap diagnostics;
+    if (m_capabilitiesKnown)
+        diagnostics.insert(QStringLiteral("Capabilities"), uint(m_capabilities));
+    if (m_fixLatency >= 0)
+        diagnostics.insert(QStringLiteral("FixLatency"), int(m_fixLatency));
+
+    const GnssWakelockStatistics wakelock = m_gnssWakelock.statistics();
+    QVariantMap wakelockInfo;
+    wakelockInfo.insert(QStringLiteral("AcquireCount"), wakelock.acquireCount);
+    wakelockInfo.insert(QStringLiteral("TimeoutCount"), wakelock.timeoutCount);
+    wakelockInfo.insert(QStringLiteral("TotalHoldTime"), wakelock.totalHoldTimeMs);
+    wakelockInfo.insert(QStringLiteral("LongestHoldTime"), wakelock.longestHoldTimeMs);
+    QVariantList histogram;
+    for (int i = 0; i < GnssWakelockBuckets; ++i)
+        histogram.append(wakelock.histogram[i]);
+    wakelockInfo.insert(QStringLiteral("Histogram"), histogram);
+    diagnostics.insert(QStringLiteral("Wakelock"), wakelockInfo);
+
+    QVariantList calls;
+    foreach (const GnssCallStatistics &statistics, m_gnssWatchdog.statistics()) {
+        QVariantMap info;
+        info.insert(QStringLiteral("Method"), QString::fromLatin1(statistics.method));
+        info.insert(QStringLiteral("Count"), statistics.count);
+        info.insert(QStringLiteral("Timeouts"), statistics.timeouts);
+        info.insert(QStringLiteral("Median"), statistics.p50Ms);
+        info.insert(QStringLiteral("P99"), statistics.p99Ms);
+        info.insert(QStringLiteral("Maximum"), statistics.maximumMs);
+        calls.append(info);
+    }
+    diagnostics.insert(QStringLiteral("Calls"), calls);
+
+    QVariantMap recovery;
+    recovery.insert(QStringLiteral("Count"), m_halRecoveryCount);
+    if (m_halRecoveryCount > 0)
+        recovery.insert(QStringLiteral("LastRecoveryTime"), m_lastHalRecoveryTime);
+    diagnostics.insert(QStringLiteral("HalRecovery"), recovery);
+
+    QVariantMap session;
+    session.insert(QStringLiteral("Starts"), m_sessionStarts);
+    session.insert(QStringLiteral("Stops"), m_sessionStops);
+    session.insert(QStringLiteral("Resumes"), m_sessionResumes);
+    session.insert(QStringLiteral("ModeChanges"), m_positionModeChanges);
+    session.insert(QStringLiteral("ModeChangesSkipped"), m_positionModeSkips);
+    session.insert(QStringLiteral("Lingering"), m_stopLingerTimer.isActive());
+    diagnostics.insert(QStringLiteral("Session"), session);
+
+    accountAdaptiveInterval(m_adaptiveBaseInterval, m_adaptiveInterval);
+    QVariantMap adaptive;
+    adaptive.insert(QStringLiteral("Interval"), m_adaptiveInterval);
+    adaptive.insert(QStringLiteral("BaseInterval"), m_adaptiveBaseInterval);
+    adaptive.insert(QStringLiteral("StretchedTime"), m_adaptiveTime);
+    adaptive.insert(QStringLiteral("SavedOnTime"), m_adaptiveSavedTime);
+    diagnostics.insert(QStringLiteral("Adaptive"), adaptive);
+
+    if (m_backend) {
+        QVariantList threads;
+        foreach (const HybrisGnssThreadInfo &thread, m_backend->gnssDebugThreads()) {
+            QVariantMap info;
+            info.insert(QStringLiteral("Name"), QString::fromLatin1(thread.name));
+            info.insert(QStringLiteral("Running"), thread.running);
+            info.insert(QStringLiteral("CpuTime"), double(thread.cpuTimeNs) / 1000000.0);
+            info.insert(QStringLiteral("Callbacks"), thread.callbacks);
+            threads.append(info);
+        }
+        if (!threads.isEmpty())
+            diagnostics.insert(QStringLiteral("Threads"), threads);
+    }
+
+    if (!m_debugDataTimer.isValid())
+        return diagnostics;
+
+    diagnostics.insert(QStringLiteral("Age"), int(m_debugDataTimer.elapsed() / 1000));
+    diagnostics.insert(QStringLiteral("PositionValid"), m_debugData.positionValid);
+    if (m_debugData.positionValid) {
+        diagnostics.insert(QStringLiteral("Latitude"), m_debugData.latitudeDegrees);
+        diagnostics.insert(QStringLiteral("Longitude"), m_debugData.longitudeDegrees);
+        diagnostics.insert(QStringLiteral("Altitude"), double(m_debugData.altitudeMeters));
+        diagnostics.insert(QStringLiteral("HorizontalAccuracy"), m_debugData.horizontalAccuracyMeters);
+        diagnostics.insert(QStringLiteral("PositionAge"), double(m_debugData.positionAgeSeconds));
+    }
+    diagnostics.insert(QStringLiteral("TimeEstimate"), qint64(m_debugData.timeEstimateMs));
+    diagnostics.insert(QStringLiteral("TimeUncertainty"), double(m_debugData.timeUncertaintyNs));
+    diagnostics.insert(QStringLiteral("FrequencyUncertainty"),
+                       double(m_debugData.frequencyUncertaintyNsPerSec));
+
+    QVariantList satellites;
+    foreach (const HybrisGnssDebugSatellite &satellite, m_debugData.satellites) {
+        QVariantMap info;
+        info.insert(QStringLiteral("Constellation"), int(satellite.constellation));
+        info.insert(QStringLiteral("Svid"), satellite.svid);
+        info.insert(QStringLiteral("EphemerisType"), int(satellite.ephemerisType));
+        info.insert(QStringLiteral("EphemerisSource"), int(satellite.ephemerisSource));
+        info.insert(QStringLiteral("EphemerisHealth"), int(satellite.ephemerisHealth));
+        info.insert(QStringLiteral("EphemerisAge"), double(satellite.ephemerisAgeSeconds));
+        info.insert(QStringLiteral("ServerPredictionAvailable"), satellite.serverPredictionAvailable);
+        if (satellite.serverPredictionAvailable) {
+            info.insert(QStringLiteral("ServerPredictionAge"),
+                        double(satellite.serverPredictionAgeSeconds));
+        }
+        satellites.append(info);
+    }
+    diagnostics.insert(QStringLiteral("Satellites"), satellites);
+
+    return diagnostics;
+}
+
+int HybrisProvider::GetPosition(int &timestamp, double &latitude, double &longitude,
+                                double &altitude, Accuracy &accuracy)
+{
+    PositionFields positionFields = NoPositionFields;
+
+    timestamp = m_currentLocation.timestamp() / 1000;
+    if (!qIsNaN(m_currentLocation.latitude()))
+        positionFields |= LatitudePresent;
+    latitude = m_currentLocation.latitude();
+    if (!qIsNaN(m_currentLocation.longitude()))
+        positionFields |= LongitudePresent;
+    longitude = m_currentLocation.longitude();
+    if (!qIsNaN(m_currentLocation.altitude()))
+        positionFields |= AltitudePresent;
+    altitude = m_currentLocation.altitude();
+    accuracy = m_currentLocation.accuracy();
+
+    return positionFields;
+}
+
+int HybrisProvider::GetVelocity(int &timestamp, double &speed, double &direction, double &climb)
+{
+    VelocityFields velocityFields = NoVelocityFields;
+
+    timestamp = m_currentLocation.timestamp() / 1000;
+    if (!qIsNaN(m_currentLocation.speed()))
+        velocityFields |= SpeedPresent;
+    speed = m_currentLocation.speed();
+    if (!qIsNaN(m_currentLocation.direction()))
+        velocityFields |= DirectionPresent;
+    direction = m_currentLocation.direction();
+    if (!qIsNaN(m_currentLocation.climb()))
+        velocityFields |= ClimbPresent;
+    climb = m_currentLocation.climb();
+
+    return velocityFields;
+}
+
+int HybrisProvider::GetLastSatellite(int &satelliteUsed, int &satelliteVisible,
+                                     QList<int> &usedPrn, QList<SatelliteInfo> &satInfo)
+{
+    satelliteUsed = m_previousUsedPrns.length();
+    satelliteVisible = m_previousVisibleSatellites.length();
+    usedPrn = m_previousUsedPrns;
+    satInfo = m_previousVisibleSatellites;
+
+    return m_previousSatelliteTimestamp;
+}
+
+int HybrisProvider::GetSatellite(int &satelliteUsed, int &satelliteVisible, QList<int> &usedPrn,
+                                 QList<SatelliteInfo> &satInfo)
+{
+    satelliteUsed = m_usedPrns.length();
+    satelliteVisible = m_visibleSatellites.length();
+    usedPrn = m_usedPrns;
+    satInfo = m_visibleSatellites;
+
+    return m_satelliteTimestamp;
+}
+
+void HybrisProvider::timerEvent(QTimerEvent *event)
+{
+    if (event->timerId() == m_systemdWatchdogTimer.timerId()) {
+        m_gnssWatchdog.notifySystemd();
+    } else if (event->timerId() == m_gnssInitTimer.timerId()) {
+        m_gnssInitTimer.stop();
+        // A late HAL is still taken over by gnssInitFinished().
+        qWarning("GNSS HAL initialisation did not finish in %d ms", GnssInitTimeout);
+        setStatus(StatusError);
+    } else if (event->timerId() == m_idleTimer.timerId()) {
+        m_idleTimer.stop();
+        qCDebug(lcGeoclueHybris) << "have been idle for too long, quitting";
+        qApp->quit();
+    } else if (event->timerId() == m_positionRequestTimer.timerId()) {
+        m_positionRequestTimer.stop();
+        QList<PositionRequest>::iterator it = m_positionRequests.begin();
+        while (it != m_positionRequests.end()) {
+            if (!it->elapsed.hasExpired(it->timeout)) {
+                ++it;
+                continue;
+            }
+            const QString service = it->pendingReply.service();
+            QDBusConnection::sessionBus().send(it->pendingReply.createErrorReply(
+                QDBusError::TimedOut, QStringLiteral("No position within the timeout")));
+            it = m_positionRequests.erase(it);
+            unwatchServiceIfUnused(service);
+        }
+        startPositionRequestTimer();
+        startIdleTimerIfNeeded();
+        stopPositioningIfNeeded();
+    } else if (event->timerId() == m_stopLingerTimer.timerId()) {
+        m_stopLingerTimer.stop();
+        if (m_watchedServices.isEmpty() && m_positionRequests.isEmpty())
+            stopPositioning();
+    } else if (event->timerId() == m_fixLostTimer.timerId()) {
+        m_fixLostTimer.stop();
         setStatus(StatusAcquiring);
     } else if (event->timerId() == m_ntpRetryTimer.timerId()) {
         sendNtpRequest();
+    } else if (event->timerId() == m_debugTimer.timerId()) {
+        if (!m_backend->gnssDebugRequestData())
+            m_debugTimer.stop();
     } else {
         QObject::timerEvent(event);
     }
@@ -515,7 +1508,7 @@ void HybrisProvider::setLocation(const Location &location)
 
     if (location.timestamp() != 0) {
         setStatus(StatusAvailable);
-        m_fixLostTimer.start(FixTimeout, this);
+        m_fixLostTimer.start(fixTimeout(), this);
     }
 
     m_currentLocation = location;
@@ -526,6 +1519,19 @@ void HybrisProvider::setLocation(const Location &location)
     }
 
     emitLocationChanged();
+
+    if (m_currentLocation.timestamp() != 0 && !m_positionRequests.isEmpty())
+        answerPositionRequests();
+
+    // Adaptive intervals follow the speed of the new fix.
+    if (m_gpsStarted) {
+        foreach (const ServiceData &data, m_watchedServices) {
+            if (data.minimumDistance > 0) {
+                updatePositionMode();
+                break;
+            }
+        }
+    }
 }
 
 void HybrisProvider::setSatellite(const QList<SatelliteInfo> &satellites, const QList<int> &used)
@@ -540,17 +1546,217 @@ void HybrisProvider::setSatellite(const QList<SatelliteInfo> &satellites, const
     emitSatelliteChanged();
 }
 
+void HybrisProvider::processGnssEvents()
+{
+    m_gnssEvents.acknowledge();
+
+    // Both rings are merged in reporting order, satellites usually precede their fix.
+    GnssFix fix;
+    GnssSatelliteEpoch epoch;
+    quint64 fixOrder = 0;
+    quint64 epochOrder = 0;
+    bool haveFix = m_gnssEvents.takeFix(&fix, &fixOrder);
+    bool haveEpoch = m_gnssEvents.takeSatelliteEpoch(&epoch, &epochOrder);
+    while (haveFix || haveEpoch) {
+        if (haveFix && (!haveEpoch || fixOrder < epochOrder)) {
+            processFix(fix);
+            haveFix = m_gnssEvents.takeFix(&fix, &fixOrder);
+        } else {
+            processSatelliteEpoch(epoch);
+            haveEpoch = m_gnssEvents.takeSatelliteEpoch(&epoch, &epochOrder);
+        }
+    }
+
+    if (m_gnssEvents.droppedFixes() != m_droppedFixes ||
+            m_gnssEvents.droppedSatelliteEpochs() != m_droppedSatelliteEpochs) {
+        m_droppedFixes = m_gnssEvents.droppedFixes();
+        m_droppedSatelliteEpochs = m_gnssEvents.droppedSatelliteEpochs();
+        qWarning("GNSS event queue overflow, dropped %llu fixes and %llu satellite epochs in total",
+                 m_droppedFixes, m_droppedSatelliteEpochs);
+    }
+}
+
+void HybrisProvider::processFix(const GnssFix &fix)
+{
+    // Chips without scheduling report every second, drop the fixes nobody asked for.
+    if (m_softwareFixInterval && fix.timestamp &&
+            fix.timestamp - m_lastFixTimestamp < m_softwareFixInterval - FixIntervalTolerance &&
+            fix.timestamp > m_lastFixTimestamp) {
+        m_fixLostTimer.start(fixTimeout(), this);
+        return;
+    }
+    m_lastFixTimestamp = fix.timestamp;
+
+    if (fix.elapsedRealtimeNs > 0) {
+        timespec now;
+        clock_gettime(CLOCK_BOOTTIME, &now);
+        m_fixLatency = (Q_INT64_C(1000000000) * now.tv_sec + now.tv_nsec - fix.elapsedRealtimeNs) / 1000000;
+        qCDebug(lcGeoclueHybrisPosition) << "Fix latency" << m_fixLatency << "ms";
+    }
+    setLocation(locationFromFix(fix));
+}
+
+void HybrisProvider::processSatelliteEpoch(const GnssSatelliteEpoch &epoch)
+{
+    QList<SatelliteInfo> satellites;
+    QList<int> usedPrns;
+
+    satellites.reserve(epoch.satelliteCount);
+    for (int i = 0; i < epoch.satelliteCount; ++i) {
+        SatelliteInfo satInfo;
+        satInfo.setPrn(epoch.satellites[i].prn);
+        satInfo.setElevation(epoch.satellites[i].elevation);
+        satInfo.setAzimuth(epoch.satellites[i].azimuth);
+        satInfo.setSnr(epoch.satellites[i].snr);
+        satellites.append(satInfo);
+    }
+    for (int i = 0; i < epoch.usedCount; ++i)
+        usedPrns.append(epoch.usedPrns[i]);
+
+    setSatellite(satellites, usedPrns);
+}
+
+/*
+    The HAL releases its wakelock right after committing a fix, drain the queue first so the
+    device does not suspend before the fix reached the clients.
+*/
+void HybrisProvider::gnssReleaseWakelock(quint32 generation)
+{
+    processGnssEvents();
+    m_gnssWakelock.release(generation);
+}
+
+/*
+    Called with the fixes buffered by the GNSS chip while batching.
+*/
+void HybrisProvider::gnssLocationBatch(const QVector<GnssFix> &fixes)
+{
+    if (fixes.isEmpty())
+        return;
+
+    qCDebug(lcGeoclueHybrisPosition) << "Received batch of" << fixes.count() << "fixes";
+
+    QList<Location> locations;
+    locations.reserve(fixes.count());
+    foreach (const GnssFix &fix, fixes)
+        locations.append(locationFromFix(fix));
+
+    emit LocationsBatched(locations);
+
+    setLocation(locations.last());
+
+    // Batches arrive far apart, that is not a lost fix.
+    if (m_batching)
+        m_fixLostTimer.stop();
+}
+
+void HybrisProvider::gnssNavigationMessage(int type, int svid, int status, const QByteArray &data)
+{
+    m_navigationCache.addMessage(type, svid, status, data, QDateTime::currentMSecsSinceEpoch());
+}
+
+void HybrisProvider::gnssDebugData(const HybrisGnssDebugData &data)
+{
+    m_debugData = data;
+    m_debugDataTimer.start();
+
+    qCDebug(lcGeoclueHybris) << "GNSS time uncertainty" << data.timeUncertaintyNs << "ns,"
+                             << data.satellites.count() << "satellites";
+
+    if (m_onlineAidingPending && m_gpsStarted)
+        requestOnlineAiding();
+}
+
+void HybrisProvider::gnssGeofenceTransition(int geofenceId, const GnssFix &fix, int transition,
+                                            qint64 timestamp)
+{
+    QMap<int, Geofence>::const_iterator it = m_geofences.constFind(geofenceId);
+    if (it == m_geofences.constEnd() || it->paused)
+        return;
+
+    qCDebug(lcGeoclueHybris) << "Geofence" << geofenceId << "transition" << transition;
+
+    // Only the owner of the geofence is told about it.
+    QDBusMessage signal = QDBusMessage::createTargetedSignal(
+        it->service, QStringLiteral("/org/freedesktop/Geoclue/Providers/Hybris"),
+        QStringLiteral("org.freedesktop.Geoclue.Providers.Hybris"),
+        QStringLiteral("GeofenceTransition"));
+    signal << geofenceId << transition << int(timestamp / 1000)
+           << QVariant::fromValue(locationFromFix(fix));
+    QDBusConnection::sessionBus().send(signal);
+}
+
+void HybrisProvider::gnssGeofenceStatus(int availability)
+{
+    const bool available = availability == HYBRIS_GNSS_GEOFENCE_AVAILABLE;
+    if (m_geofencingAvailable == available)
+        return;
+
+    qCDebug(lcGeoclueHybris) << "Geofencing available" << available;
+
+    m_geofencingAvailable = available;
+    emit GeofenceAvailabilityChanged(available);
+}
+
+void HybrisProvider::gnssGeofenceOperationFinished(int operation, int geofenceId, int status)
+{
+    QMap<int, Geofence>::iterator it = m_geofences.find(geofenceId);
+    if (it == m_geofences.end())
+        return;
+
+    if (status != HYBRIS_GNSS_GEOFENCE_OPERATION_SUCCESS)
+        qWarning("Geofence %d operation %d failed, status %d", geofenceId, operation, status);
+
+    switch (operation) {
+    case HYBRIS_GNSS_GEOFENCE_OPERATION_ADD:
+        if (it->pendingReply.type() == QDBusMessage::InvalidMessage)
+            break;
+
+        if (status == HYBRIS_GNSS_GEOFENCE_OPERATION_SUCCESS) {
+            QDBusConnection::sessionBus().send(it->pendingReply.createReply(geofenceId));
+            it->pendingReply = QDBusMessage();
+        } else {
+            const QString service = it->service;
+            QDBusConnection::sessionBus().send(it->pendingReply.createErrorReply(
+                status == HYBRIS_GNSS_GEOFENCE_ERROR_TOO_MANY_GEOFENCES ? QDBusError::LimitsExceeded
+                                                                       : QDBusError::Failed,
+                QStringLiteral("GNSS chip rejected geofence, status %1").arg(status)));
+            m_geofences.erase(it);
+            m_backend->gnssGeofenceRemove(geofenceId);
+            unwatchServiceIfUnused(service);
+            startIdleTimerIfNeeded();
+        }
+        break;
+    case HYBRIS_GNSS_GEOFENCE_OPERATION_PAUSE:
+        if (status != HYBRIS_GNSS_GEOFENCE_OPERATION_SUCCESS)
+            it->paused = false;
+        break;
+    case HYBRIS_GNSS_GEOFENCE_OPERATION_RESUME:
+        if (status != HYBRIS_GNSS_GEOFENCE_OPERATION_SUCCESS)
+            it->paused = true;
+        break;
+    default:
+        break;
+    }
+}
+
 void HybrisProvider::serviceUnregistered(const QString &service)
 {
+    closeMeasurements(service);
+    removeGeofences(service);
+    for (int i = m_positionRequests.count() - 1; i >= 0; --i) {
+        if (m_positionRequests.at(i).pendingReply.service() == service)
+            m_positionRequests.removeAt(i);
+    }
+    startPositionRequestTimer();
     m_watchedServices.remove(service);
     m_watcher->removeWatchedService(service);
 
-    if (m_watchedServices.isEmpty()) {
-        qCDebug(lcGeoclueHybris) << "no watched services, starting idle timer.";
-        m_idleTimer.start(QuitIdleTime, this);
-    }
+    startIdleTimerIfNeeded();
 
     stopPositioningIfNeeded();
+    updateProfile();
+    updateBatching();
 }
 
 void HybrisProvider::locationEnabledChanged()
@@ -559,8 +1765,12 @@ void HybrisProvider::locationEnabledChanged()
         startPositioningIfNeeded();
     } else {
         setLocation(Location());
+        failPositionRequests(QDBusError::AccessDenied, QStringLiteral("Positioning is disabled"));
         stopPositioningIfNeeded();
     }
+
+    // Withdrawn online assistance also withdraws the subscriber identity.
+    updateAGnssRilSetId(false);
 }
 
 void HybrisProvider::injectPosition(int fields, int timestamp, double latitude, double longitude,
@@ -583,6 +1793,12 @@ void HybrisProvider::injectUtcTime()
 {
     qCDebug(lcGeoclueHybris) << "Time injection requested";
 
+    if (!chipNeedsTime()) {
+        qCDebug(lcGeoclueHybris) << "Skipping time injection, GNSS time uncertainty"
+                                 << m_debugData.timeUncertaintyNs << "ns";
+        return;
+    }
+
     NetworkService *service = m_networkManager->defaultRoute();
     if (!service) {
         qCDebug(lcGeoclueHybris) << "No default network service";
@@ -724,8 +1940,13 @@ void HybrisProvider::xtraDownloadRequest()
 
     qCDebug(lcGeoclueHybris) << "xtra download requested";
 
-    m_xtraServerIndex = 0;
-
+    if (!needsXtraData()) {
+        qCDebug(lcGeoclueHybris) << "Skipping xtra download, GNSS chip has current ephemerides";
+        return;
+    }
+
+    m_xtraServerIndex = 0;
+
     xtraDownloadRequestSendNext();
 }
 
@@ -816,6 +2037,128 @@ void HybrisProvider::agpsStatus(qint16 type, quint16 status, const QHostAddress
     }
 }
 
+/*
+    The HAL asks for the subscriber identity and the serving cell when it starts a SUPL
+    session. Both are answered from oFono and sent again whenever they change, so the
+    reference location follows handovers.
+*/
+void HybrisProvider::agpsRilRequestSetId(quint32 flags)
+{
+    m_agpsRilSetIdFlags = flags;
+    updateAGnssRilSetId(true);
+}
+
+void HybrisProvider::agpsRilRequestRefLocation()
+{
+    m_agpsRilRefLocationRequested = true;
+    updateAGnssRilRefLocation(true);
+}
+
+void HybrisProvider::networkRegistrationChanged()
+{
+    updateAGnssRilRefLocation(false);
+}
+
+void HybrisProvider::simManagerChanged()
+{
+    updateAGnssRilSetId(false);
+}
+
+bool HybrisProvider::servingCell(HybrisAGnssRefLocation *location) const
+{
+    if (!m_networkRegistration->isValid())
+        return false;
+
+    const QString status = m_networkRegistration->status();
+    if (status != QLatin1String("registered") && status != QLatin1String("roaming"))
+        return false;
+
+    bool mccOk;
+    bool mncOk;
+    *location = HybrisAGnssRefLocation();
+    location->mcc = m_networkRegistration->mcc().toUShort(&mccOk);
+    location->mnc = m_networkRegistration->mnc().toUShort(&mncOk);
+    location->lac = m_networkRegistration->locationAreaCode();
+    location->cid = m_networkRegistration->cellId();
+    if (!mccOk || !mncOk || location->cid == 0)
+        return false;
+
+    const QString technology = m_networkRegistration->technology();
+    if (technology == QLatin1String("lte")) {
+        // oFono reports the tracking area code as the location area code.
+        location->type = HYBRIS_AGNSS_REF_LOCATION_TYPE_LTE_CELLID;
+        location->tac = location->lac;
+    } else if (technology == QLatin1String("umts") || technology == QLatin1String("hspa") ||
+               technology == QLatin1String("hsdpa") || technology == QLatin1String("hsupa")) {
+        location->type = HYBRIS_AGNSS_REF_LOCATION_TYPE_UMTS_CELLID;
+    } else if (technology == QLatin1String("gsm") || technology == QLatin1String("gprs") ||
+               technology == QLatin1String("edge")) {
+        location->type = HYBRIS_AGNSS_REF_LOCATION_TYPE_GSM_CELLID;
+    } else {
+        return false;
+    }
+
+    return true;
+}
+
+void HybrisProvider::updateAGnssRilRefLocation(bool requested)
+{
+    if (!m_backend || !m_agpsRilRefLocationRequested)
+        return;
+
+    HybrisAGnssRefLocation location;
+    if (!servingCell(&location)) {
+        if (requested)
+            qCDebug(lcGeoclueHybris) << "No serving cell for the AGNSS reference location";
+        return;
+    }
+
+    if (!requested && location == m_agpsRilRefLocation)
+        return;
+
+    qCDebug(lcGeoclueHybris) << "AGNSS reference cell type" << location.type << "MCC" << location.mcc
+                             << "MNC" << location.mnc << "LAC" << location.lac << "CID" << location.cid;
+
+    m_agpsRilRefLocation = location;
+    m_backend->aGnssRilSetRefLocation(location);
+}
+
+/*
+    The set ID identifies the device to the SUPL server, it is only disclosed when online
+    assistance is enabled. The HAL waits for an answer, so NONE is sent otherwise.
+*/
+void HybrisProvider::updateAGnssRilSetId(bool requested)
+{
+    if (!m_backend || !m_agpsRilSetIdFlags)
+        return;
+
+    HybrisAGnssSetIDType type = HYBRIS_AGNSS_SETID_TYPE_NONE;
+    QByteArray setId;
+
+    // The subscriber identity only leaves the device when online assistance is allowed.
+    if (m_agpsOnlineEnabled && m_simManager->isValid()) {
+        const QString imsi = m_simManager->subscriberIdentity();
+        const QStringList numbers = m_simManager->subscriberNumbers();
+
+        if ((m_agpsRilSetIdFlags & HYBRIS_AGNSS_RIL_REQUEST_SETID_IMSI) && !imsi.isEmpty()) {
+            type = HYBRIS_AGNSS_SETID_TYPE_IMSI;
+            setId = imsi.toLatin1();
+        } else if ((m_agpsRilSetIdFlags & HYBRIS_AGNSS_RIL_REQUEST_SETID_MSISDN) && !numbers.isEmpty()) {
+            type = HYBRIS_AGNSS_SETID_TYPE_MSISDN;
+            setId = numbers.first().toLatin1();
+        }
+    }
+
+    if (!requested && type == m_agpsRilSetIdType && setId == m_agpsRilSetId)
+        return;
+
+    qCDebug(lcGeoclueHybris) << "AGNSS set ID type" << type;
+
+    m_agpsRilSetIdType = type;
+    m_agpsRilSetId = setId;
+    m_backend->aGnssRilSetSetId(type, setId);
+}
+
 void HybrisProvider::dataServiceConnected()
 {
     qCDebug(lcGeoclueHybris) << "Data service connected";
@@ -884,7 +2227,7 @@ void HybrisProvider::engineOn()
     if (m_status != StatusAvailable)
         setStatus(StatusAcquiring);
 
-    m_fixLostTimer.start(FixTimeout, this);
+    m_fixLostTimer.start(fixTimeout(), this);
 }
 
 void HybrisProvider::engineOff()
@@ -899,6 +2242,99 @@ void HybrisProvider::engineOff()
     m_fixLostTimer.stop();
 }
 
+/*
+    Called when a backend command that was queued to the HAL completes.
+*/
+void HybrisProvider::gnssCommandFinished(int command, bool success, int data)
+{
+    if (success)
+        return;
+
+    qCDebug(lcGeoclueHybris) << "GNSS command" << command << "failed";
+
+    if (command == HYBRIS_GNSS_COMMAND_START && m_gpsStarted) {
+        m_gpsStarted = false;
+        m_stopLingerTimer.stop();
+        m_debugTimer.stop();
+        m_onlineAidingPending = false;
+        setStatus(StatusError);
+    }
+
+    // Sent again on the next update instead of being skipped as unchanged.
+    if (command == HYBRIS_GNSS_COMMAND_SET_POSITION_MODE)
+        m_positionModeSet = false;
+
+    // Chip state is unknown, fall back to the configured online aiding.
+    if (command == HYBRIS_GNSS_COMMAND_DEBUG_DATA && m_onlineAidingPending && m_gpsStarted)
+        requestOnlineAiding();
+
+    // The chip never saw the geofence, fail its caller like a rejected geofence.
+    if (command == HYBRIS_GNSS_COMMAND_GEOFENCE_ADD)
+        gnssGeofenceOperationFinished(HYBRIS_GNSS_GEOFENCE_OPERATION_ADD, data,
+                                      HYBRIS_GNSS_GEOFENCE_ERROR_GENERIC);
+
+    if (command == HYBRIS_GNSS_COMMAND_BATCHING_START && m_batching) {
+        qWarning("GNSS batching rejected by the HAL, disabling batching");
+        m_batching = false;
+        m_batchSize = 0;
+        if (m_gpsStarted) {
+            m_backend->gnssStart();
+            m_fixLostTimer.start(fixTimeout(), this);
+        }
+    }
+}
+
+/*
+    Called when the chip reports its capabilities. The IGnss@2.0 callback dropped the
+    geofencing bit, geofencing support of those HALs is only known from the IGnssGeofencing
+    extension. Low power mode and the satellite blacklist can only be reported by the 2.0
+    callback, older HALs are left to reject them through their interface version.
+*/
+void HybrisProvider::gnssCapabilities(quint32 capabilities, bool gnss20Callback)
+{
+    const quint32 reportedCapabilities = gnss20Callback
+            ? CapabilitiesReported20 : CapabilitiesReported10;
+    if (m_capabilitiesKnown && capabilities == m_capabilities
+            && reportedCapabilities == m_reportedCapabilities) {
+        return;
+    }
+
+    qCDebug(lcGeoclueHybris) << "GNSS capabilities" << showbase << hex << capabilities;
+
+    m_capabilities = capabilities;
+    m_reportedCapabilities = reportedCapabilities;
+    m_capabilitiesKnown = true;
+
+    if (m_geofencingSupported
+            && !hasCapability(HYBRIS_GNSS_CAPABILITY_GEOFENCING)) {
+        qCDebug(lcGeoclueHybris) << "GNSS chip does not support geofencing";
+        m_geofencingSupported = false;
+    }
+
+    if (m_navigationMessagesStarted && !hasCapability(HYBRIS_GNSS_CAPABILITY_NAV_MESSAGES)) {
+        m_backend->gnssNavigationMessageStop();
+        m_navigationMessagesStarted = false;
+    }
+
+    if (!m_gpsStarted)
+        return;
+
+    updatePositionMode();
+    updateMeasurements();
+}
+
+/*
+    Called when the backend has reconnected to a restarted HAL and the HAL has answered the
+    replayed session, recoveryTime runs from the death of the HAL to the last reply.
+*/
+void HybrisProvider::gnssRecovered(int recoveryTime)
+{
+    ++m_halRecoveryCount;
+    m_lastHalRecoveryTime = recoveryTime;
+
+    qCDebug(lcGeoclueHybris) << "GNSS HAL recovery" << m_halRecoveryCount << "took" << recoveryTime << "ms";
+}
+
 void HybrisProvider::technologiesChanged()
 {
     if (m_cellularTechnology) {
@@ -916,18 +2352,16 @@ void HybrisProvider::technologiesChanged()
     } else {
         qCDebug(lcGeoclueHybris) << "Cellular technology not available";
     }
+
+    updateNetworkState();
 }
 
 void HybrisProvider::stateChanged(NetworkManager::State state)
 {
-    if (state == NetworkManager::OnlineState && m_gpsStarted) {
-        if (m_useForcedXtraInject) {
-            gnssXtraDownloadRequest();
-        }
-        if (m_useForcedNtpInject) {
-            injectUtcTime();
-        }
-    }
+    updateNetworkState();
+
+    if (state == NetworkManager::OnlineState && m_gpsStarted && !m_onlineAidingPending)
+        requestOnlineAiding();
 }
 
 void HybrisProvider::defaultDataModemChanged(const QString &modem)
@@ -935,6 +2369,8 @@ void HybrisProvider::defaultDataModemChanged(const QString &modem)
     qCDebug(lcGeoclueHybris) << "Default data modem changed to" << modem;
 
     m_connectionManager->setModemPath(modem);
+    m_networkRegistration->setModemPath(modem);
+    m_simManager->setModemPath(modem);
 }
 
 void HybrisProvider::connectionManagerValidChanged()
@@ -959,6 +2395,9 @@ void HybrisProvider::connectionContextValidChanged()
 
         qCDebug(lcGeoclueHybris) << "Found connection context APN" << apn;
 
+        m_cellularApn = apn;
+        updateNetworkState();
+
         m_agpsInterface.clear();
         m_connectionContext->deleteLater();
         m_connectionContext = 0;
@@ -972,53 +2411,177 @@ void HybrisProvider::connectionContextValidChanged()
 void HybrisProvider::cellularConnected(bool connected)
 {
     qCDebug(lcGeoclueHybris) << "Cellular connected" << connected;
+    if (!connected)
+        m_cellularApn.clear();
+    updateNetworkState();
     if (connected)
         dataServiceConnected();
 }
 
-void HybrisProvider::emitLocationChanged()
+void HybrisProvider::updateNetworkState()
 {
-    PositionFields positionFields = NoPositionFields;
+    sendNetworkState(false);
+}
 
-    if (!qIsNaN(m_currentLocation.latitude()))
-        positionFields |= LatitudePresent;
-    if (!qIsNaN(m_currentLocation.longitude()))
-        positionFields |= LongitudePresent;
-    if (!qIsNaN(m_currentLocation.altitude()))
-        positionFields |= AltitudePresent;
+/*
+    Tells the HAL whether a data path exists, so it does not start SUPL sessions that are
+    bound to time out. The APN is only known once the cellular context has been looked up
+    for AGNSS.
+*/
+void HybrisProvider::sendNetworkState(bool force)
+{
+    if (!m_backend || !m_extensionsInitialised)
+        return;
 
-    VelocityFields velocityFields = NoVelocityFields;
+    NetworkService *service = m_networkManager->defaultRoute();
+    const bool connected = service && service->connected();
+    const HybrisNetworkType type = connected && service->type() == QLatin1String("wifi")
+            ? HYBRIS_AGNSS_RIL_NETWORK_TYPE_WIFI : HYBRIS_AGNSS_RIL_NETWORK_TYPE_MOBILE;
+    const bool roaming = connected && service->roaming();
+    const bool available = m_cellularTechnology && m_cellularTechnology->connected();
+    const QByteArray apn = available ? m_cellularApn : QByteArray();
+
+    if (force || connected != m_networkConnected || type != m_networkType || roaming != m_networkRoaming) {
+        qCDebug(lcGeoclueHybris) << "Network state connected" << connected << "type" << type
+                                 << "roaming" << roaming;
+        m_networkConnected = connected;
+        m_networkType = type;
+        m_networkRoaming = roaming;
+        m_backend->aGnssRilUpdateNetworkState(connected, type, roaming);
+    }
 
-    if (!qIsNaN(m_currentLocation.speed()))
-        velocityFields |= SpeedPresent;
-    if (!qIsNaN(m_currentLocation.direction()))
-        velocityFields |= DirectionPresent;
-    if (!qIsNaN(m_currentLocation.climb()))
-        velocityFields |= ClimbPresent;
+    if (force || available != m_networkAvailable || apn != m_networkApn) {
+        qCDebug(lcGeoclueHybris) << "Mobile network available" << available << "APN" << apn;
+        m_networkAvailable = available;
+        m_networkApn = apn;
+        m_backend->aGnssRilUpdateNetworkAvailability(available, apn);
+    }
+}
+
+/*
+    Position updates are broadcast while every watched service takes each fix. Once one asks
+    for a longer interval they are sent to each watched service as targeted signals, decimated
+    to its interval, so a background client is not woken at the rate of the fastest one.
+    Invalid locations, telling that the fix was lost, are always sent.
+*/
+void HybrisProvider::emitLocationChanged()
+{
+    const qint64 timestamp = m_currentLocation.timestamp();
+
+    QDBusMessage velocity = QDBusMessage::createSignal(
+        QStringLiteral("/org/freedesktop/Geoclue/Providers/Hybris"),
+        QStringLiteral("org.freedesktop.Geoclue.Velocity"), QStringLiteral("VelocityChanged"));
+    velocity << int(velocityFields(m_currentLocation)) << int(timestamp / 1000)
+             << m_currentLocation.speed() << m_currentLocation.direction()
+             << m_currentLocation.climb();
+
+    QDBusMessage position = QDBusMessage::createSignal(
+        QStringLiteral("/org/freedesktop/Geoclue/Providers/Hybris"),
+        QStringLiteral("org.freedesktop.Geoclue.Position"), QStringLiteral("PositionChanged"));
+    position << int(positionFields(m_currentLocation)) << int(timestamp / 1000)
+             << m_currentLocation.latitude() << m_currentLocation.longitude()
+             << m_currentLocation.altitude() << QVariant::fromValue(m_currentLocation.accuracy());
+
+    const bool broadcast = isBroadcastUpdate();
+    if (broadcast) {
+        emit VelocityChanged(int(velocityFields(m_currentLocation)), int(timestamp / 1000),
+                             m_currentLocation.speed(), m_currentLocation.direction(),
+                             m_currentLocation.climb());
+        emit PositionChanged(int(positionFields(m_currentLocation)), int(timestamp / 1000),
+                             m_currentLocation.latitude(), m_currentLocation.longitude(),
+                             m_currentLocation.altitude(), m_currentLocation.accuracy());
+    }
 
-    emit VelocityChanged(velocityFields, m_currentLocation.timestamp() / 1000,
-                         m_currentLocation.speed(), m_currentLocation.direction(),
-                         m_currentLocation.climb());
+    for (QMap<QString, ServiceData>::iterator it = m_watchedServices.begin();
+            it != m_watchedServices.end(); ++it) {
+        if (timestamp != 0 && !isUpdateDue(it->updateInterval, it->lastPositionTimestamp, timestamp))
+            continue;
 
-    emit PositionChanged(positionFields, m_currentLocation.timestamp() / 1000,
-                         m_currentLocation.latitude(), m_currentLocation.longitude(),
-                         m_currentLocation.altitude(), m_currentLocation.accuracy());
+        it->lastPositionTimestamp = timestamp;
+        if (broadcast)
+            continue;
+        sendTargetedSignal(it.key(), velocity);
+        sendTargetedSignal(it.key(), position);
+    }
 }
 
 void HybrisProvider::emitSatelliteChanged()
 {
-    emit SatelliteChanged(m_satelliteTimestamp, m_usedPrns.length(), m_visibleSatellites.length(),
-                          m_usedPrns, m_visibleSatellites);
+    QDBusMessage satellite = QDBusMessage::createSignal(
+        QStringLiteral("/org/freedesktop/Geoclue/Providers/Hybris"),
+        QStringLiteral("org.freedesktop.Geoclue.Satellite"), QStringLiteral("SatelliteChanged"));
+    satellite << int(m_satelliteTimestamp) << m_usedPrns.length() << m_visibleSatellites.length()
+              << QVariant::fromValue(m_usedPrns) << QVariant::fromValue(m_visibleSatellites);
+
+    const bool broadcast = isBroadcastUpdate();
+    if (broadcast) {
+        emit SatelliteChanged(m_satelliteTimestamp, m_usedPrns.length(), m_visibleSatellites.length(),
+                              m_usedPrns, m_visibleSatellites);
+    }
+
+    for (QMap<QString, ServiceData>::iterator it = m_watchedServices.begin();
+            it != m_watchedServices.end(); ++it) {
+        if (!isUpdateDue(it->updateInterval, it->lastSatelliteTimestamp, m_satelliteTimestamp))
+            continue;
+
+        it->lastSatelliteTimestamp = m_satelliteTimestamp;
+        if (!broadcast)
+            sendTargetedSignal(it.key(), satellite);
+    }
 }
 
+/*
+    Returns true while no watched service asked for updates less often than each fix, the
+    updates are then broadcast and also reach listeners which do not hold a reference.
+*/
+bool HybrisProvider::isBroadcastUpdate() const
+{
+    foreach (const ServiceData &data, m_watchedServices) {
+        if (data.updateInterval > MinimumInterval)
+            return false;
+    }
+    return true;
+}
+
+bool HybrisProvider::isUpdateDue(quint32 updateInterval, qint64 lastTimestamp, qint64 timestamp) const
+{
+    if (updateInterval <= MinimumInterval || lastTimestamp == 0)
+        return true;
+
+    return timestamp - lastTimestamp >= qint64(updateInterval) - FixIntervalTolerance;
+}
+
+void HybrisProvider::sendTargetedSignal(const QString &service, const QDBusMessage &signal)
+{
+    QDBusMessage message = QDBusMessage::createTargetedSignal(
+        service, signal.path(), signal.interface(), signal.member());
+    message.setArguments(signal.arguments());
+    QDBusConnection::sessionBus().send(message);
+}
+
+/*
+    The GNSS session is idle, running, or lingering after the last client went away so a
+    client reopening shortly after keeps the hot start state. Transitions are counted in
+    GetDiagnostics to show how much the receiver is power cycled.
+*/
 void HybrisProvider::startPositioningIfNeeded()
 {
-    // Positioning is already started.
-    if (m_gpsStarted)
+    // Positioning is already started, possibly lingering for a returning client.
+    if (m_gpsStarted) {
+        if (m_stopLingerTimer.isActive() && !m_watchedServices.isEmpty()) {
+            qCDebug(lcGeoclueHybris) << "Resuming lingering positioning session";
+            m_stopLingerTimer.stop();
+            ++m_sessionResumes;
+        }
+        // Also turns a single shot session periodic once a client holds a reference.
+        if (!m_watchedServices.isEmpty())
+            m_sessionReferenced = true;
+        updatePositionMode();
         return;
+    }
 
     // Positioning is unused.
-    if (m_watchedServices.isEmpty())
+    if (m_watchedServices.isEmpty() && m_positionRequests.isEmpty())
         return;
 
     // Positioning disabled externally
@@ -1030,6 +2593,8 @@ void HybrisProvider::startPositioningIfNeeded()
     if (!m_backend)
         return;
 
+    initExtensions();
+
     // Listen to all PositionChanged signals from org.freedesktop.Geoclue.Position interfaces. Used
     // to inject the current position to achieve a faster fix.
     if (!m_positionInjectionConnected) {
@@ -1040,13 +2605,10 @@ void HybrisProvider::startPositioningIfNeeded()
                          this, SLOT(injectPosition(int,int,double,double,double,Accuracy)));
     }
 
-    if (!m_backend->gnssSetPositionMode(m_agpsEnabled ? HYBRIS_GNSS_POSITION_MODE_MS_BASED
-                                                      : HYBRIS_GNSS_POSITION_MODE_STANDALONE,
-                                        HYBRIS_GNSS_POSITION_RECURRENCE_PERIODIC,
-                                        minimumRequestedUpdateInterval(),
-                                        PreferredAccuracy, PreferredInitialFixTime)) {
+    // The mode is always sent before a start.
+    m_positionModeSet = false;
+    if (!updatePositionMode())
         return;
-    }
 
     qCDebug(lcGeoclueHybris) << "Starting positioning";
 
@@ -1056,14 +2618,29 @@ void HybrisProvider::startPositioningIfNeeded()
     }
 
     m_gpsStarted = true;
+    m_sessionReferenced = !m_watchedServices.isEmpty();
+    ++m_sessionStarts;
 
-    if (m_networkManager->globalState() == NetworkManager::OnlineState) {
-        if (m_useForcedXtraInject) {
-            gnssXtraDownloadRequest();
-        }
-        if (m_useForcedNtpInject) {
-            injectUtcTime();
-        }
+    const quint32 baseInterval = minimumRequestedUpdateInterval(false);
+    accountAdaptiveInterval(baseInterval, qMax(m_positionModeInterval, baseInterval));
+
+    updateBatching();
+    updateMeasurements();
+
+    // Feeds the navigation data cache, not all chips report navigation messages. Started
+    // once, messages only arrive while a session runs and the HAL call may block.
+    if (!m_navigationMessagesStarted && !m_navigationMessagesFailed &&
+            hasCapability(HYBRIS_GNSS_CAPABILITY_NAV_MESSAGES)) {
+        m_navigationMessagesStarted = m_backend->gnssNavigationMessageStart();
+        m_navigationMessagesFailed = !m_navigationMessagesStarted;
+    }
+
+    // Online aiding waits for the chip state when it can be queried.
+    if (m_backend->gnssDebugRequestData()) {
+        m_debugTimer.start(DebugDataInterval, this);
+        m_onlineAidingPending = true;
+    } else {
+        requestOnlineAiding();
     }
 }
 
@@ -1074,9 +2651,26 @@ void HybrisProvider::stopPositioningIfNeeded()
         return;
 
     // Positioning enabled externally and positioning is still being used.
-    if (positioningEnabled() && !m_watchedServices.isEmpty())
+    if (positioningEnabled() && (!m_watchedServices.isEmpty() || !m_positionRequests.isEmpty()))
         return;
 
+    // Only client churn lingers, disabling positioning stops it at once. Sessions only ever
+    // used by single position requests end with the fix.
+    if (positioningEnabled() && m_stopLinger > 0 && m_backend && m_sessionReferenced) {
+        if (!m_stopLingerTimer.isActive()) {
+            qCDebug(lcGeoclueHybris) << "Stopping positioning in" << m_stopLinger << "ms";
+            m_stopLingerTimer.start(m_stopLinger, this);
+        }
+        return;
+    }
+
+    stopPositioning();
+}
+
+void HybrisProvider::stopPositioning()
+{
+    m_stopLingerTimer.stop();
+
     // Stop listening to all PositionChanged signals from org.freedesktop.Geoclue.Position
     // interfaces.
     if (m_positionInjectionConnected) {
@@ -1087,13 +2681,28 @@ void HybrisProvider::stopPositioningIfNeeded()
         m_positionInjectionConnected = false;
     }
 
-    if (m_backend) {
+    // A session which failed to start is not stopped again, nor counted as a stop.
+    if (m_backend && m_gpsStarted) {
         qCDebug(lcGeoclueHybris) << "Stopping positioning";
-        m_backend->gnssStop();
+        if (m_batching) {
+            // Deliver what the chip has buffered before the session ends.
+            m_backend->gnssBatchingFlush();
+            m_backend->gnssBatchingStop();
+            m_batching = false;
+        } else {
+            m_backend->gnssStop();
+        }
         m_gpsStarted = false;
+        m_positionModeSet = false;
+        accountAdaptiveInterval(0, 0);
+        ++m_sessionStops;
+        updateMeasurements();
+        m_debugTimer.stop();
+        m_onlineAidingPending = false;
         setStatus(StatusUnavailable);
     }
-    
+
+    saveNavigationCache();
 
     m_fixLostTimer.stop();
 }
@@ -1126,7 +2735,7 @@ bool HybrisProvider::positioningEnabled()
        && (m_locationSettings->allowedDataSources() & LocationSettings::GpsData);
 }
 
-quint32 HybrisProvider::minimumRequestedUpdateInterval() const
+quint32 HybrisProvider::minimumRequestedUpdateInterval(bool adaptive) const
 {
     quint32 updateInterval = UINT_MAX;
 
@@ -1137,17 +2746,433 @@ quint32 HybrisProvider::minimumRequestedUpdateInterval() const
             continue;
         }
 
+        const quint32 interval = adaptive && data.minimumDistance > 0
+                ? adaptiveUpdateInterval(data) : data.updateInterval;
+
         // Service hasn't requested a specific update interval.
-        if (data.updateInterval == 0)
+        if (interval == 0)
             continue;
 
-        updateInterval = qMin(updateInterval, data.updateInterval);
+        updateInterval = qMin(updateInterval, interval);
     }
 
     if (updateInterval == UINT_MAX)
-        return MinimumInterval;
+        updateInterval = MinimumInterval;
+
+    return qMax(qMax(updateInterval, MinimumInterval), Profiles[m_profile].minimumInterval);
+}
+
+/*
+    Interval giving a client that declared a minimum distance about one fix per distance
+    travelled at the speed of the last fix. It goes from the client's update interval when
+    moving fast to its maximum interval when stationary, in coarse steps so speed noise
+    does not keep changing the position mode.
+*/
+quint32 HybrisProvider::adaptiveUpdateInterval(const ServiceData &data) const
+{
+    const quint32 minimum = qMax(data.updateInterval, MinimumInterval);
+    const quint32 maximum = qMax(data.maximumInterval > 0 ? data.maximumInterval
+                                                          : AdaptiveMaximumInterval, minimum);
+
+    // Speed is unknown until the first fix, and lost with it.
+    const double speed = m_currentLocation.speed() / MpsToKnots;
+    if (m_currentLocation.timestamp() == 0 || qIsNaN(speed))
+        return minimum;
+    if (speed < StationarySpeed)
+        return maximum;
+
+    const double interval = data.minimumDistance / speed * 1000.0;
+    quint32 step = minimum;
+    for (int i = 0; i < AdaptiveStepCount && AdaptiveSteps[i] <= interval; ++i)
+        step = AdaptiveSteps[i];
+
+    return qBound(minimum, step, maximum);
+}
+
+/*
+    Adds the receiver on-time saved by adaptive intervals since the last call, assuming the
+    on-time is proportional to the fix rate, and continues with the given intervals.
+*/
+void HybrisProvider::accountAdaptiveInterval(quint32 baseInterval, quint32 interval)
+{
+    if (m_adaptiveClock.isValid() && m_adaptiveInterval > m_adaptiveBaseInterval) {
+        const qint64 elapsed = m_adaptiveClock.elapsed();
+        m_adaptiveTime += elapsed;
+        m_adaptiveSavedTime += qint64(elapsed * (1.0 - double(m_adaptiveBaseInterval) / m_adaptiveInterval));
+    }
+
+    m_adaptiveClock.start();
+    m_adaptiveBaseInterval = baseInterval;
+    m_adaptiveInterval = interval;
+}
+
+// Time without a fix before the position is reported as lost, clients may ask for any interval.
+int HybrisProvider::fixTimeout() const
+{
+    const qint64 timeout = FixTimeout + qint64(qMax(m_positionModeInterval, m_softwareFixInterval));
+    return int(qMin(timeout, qint64(INT_MAX)));
+}
+
+/*
+    Sends the position mode the chip can honour. Without HAL scheduling the chip runs at
+    its native rate and fixes are decimated in software, MS-based mode is only asked for
+    when the chip supports it.
+*/
+bool HybrisProvider::updatePositionMode()
+{
+    if (!m_backend)
+        return false;
+
+    const quint32 interval = minimumRequestedUpdateInterval(true);
+    const bool scheduling = hasCapability(HYBRIS_GNSS_CAPABILITY_SCHEDULING);
+    m_softwareFixInterval = scheduling || interval <= MinimumInterval ? 0 : interval;
+
+    // Fixes decimated in software still cost the receiver on-time.
+    if (m_gpsStarted) {
+        const quint32 baseInterval = minimumRequestedUpdateInterval(false);
+        accountAdaptiveInterval(baseInterval, scheduling ? interval : baseInterval);
+    }
+
+    const bool msBased = m_agpsEnabled && hasCapability(HYBRIS_GNSS_CAPABILITY_MSB);
+    const bool lowPowerMode = Profiles[m_profile].lowPowerMode &&
+            hasCapability(HYBRIS_GNSS_CAPABILITY_LOW_POWER_MODE);
+    const HybrisGnssPositionMode mode = msBased ? HYBRIS_GNSS_POSITION_MODE_MS_BASED
+                                                : HYBRIS_GNSS_POSITION_MODE_STANDALONE;
+    // Without a client holding a reference the session only serves GetPositionOnce().
+    const HybrisGnssPositionRecurrence recurrence =
+            m_watchedServices.isEmpty() && hasCapability(HYBRIS_GNSS_CAPABILITY_SINGLE_SHOT)
+            ? HYBRIS_GNSS_POSITION_RECURRENCE_SINGLE : HYBRIS_GNSS_POSITION_RECURRENCE_PERIODIC;
+    const quint32 minInterval = scheduling ? interval : MinimumInterval;
+
+    // A single shot session stops after its fix, so the chip is asked for the tightest
+    // accuracy still waited for within the time left to the callers.
+    quint32 preferredAccuracy = PreferredAccuracy;
+    quint32 preferredTime = PreferredInitialFixTime;
+    if (recurrence == HYBRIS_GNSS_POSITION_RECURRENCE_SINGLE) {
+        foreach (const PositionRequest &request, m_positionRequests) {
+            const quint32 accuracy = quint32(qBound(1.0, request.maximumAccuracy, 100000.0));
+            const quint32 left = quint32(qMax(Q_INT64_C(1), request.timeout - request.elapsed.elapsed()));
+            if (!preferredAccuracy || accuracy < preferredAccuracy)
+                preferredAccuracy = accuracy;
+            if (!preferredTime || left < preferredTime)
+                preferredTime = left;
+        }
+    }
+
+    // Each mode change restarts the fix engine on some chips.
+    if (m_positionModeSet && mode == m_positionMode && recurrence == m_positionModeRecurrence &&
+            minInterval == m_positionModeInterval && lowPowerMode == m_positionModeLowPower &&
+            preferredAccuracy == m_positionModeAccuracy) {
+        ++m_positionModeSkips;
+        return true;
+    }
+
+    if (!m_backend->gnssSetPositionMode(mode, recurrence, minInterval, preferredAccuracy,
+                                        preferredTime, lowPowerMode)) {
+        m_positionModeSet = false;
+        return false;
+    }
+
+    m_positionModeSet = true;
+    m_positionMode = mode;
+    m_positionModeRecurrence = recurrence;
+    m_positionModeInterval = minInterval;
+    m_positionModeLowPower = lowPowerMode;
+    m_positionModeAccuracy = preferredAccuracy;
+    ++m_positionModeChanges;
+    return true;
+}
+
+/*
+    Returns true if the GNSS chip reported the capability, or has not reported its
+    capabilities yet, or its capabilities callback cannot report it.
+*/
+bool HybrisProvider::hasCapability(quint32 capability) const
+{
+    return !m_capabilitiesKnown || !(m_reportedCapabilities & capability)
+            || (m_capabilities & capability);
+}
+
+void HybrisProvider::updateProfile()
+{
+    Profile profile = m_watchedServices.isEmpty() ? ProfileDefault : ProfileBackground;
+    foreach (const ServiceData &data, m_watchedServices)
+        profile = qMax(profile, data.profile);
+
+    if (profile == m_profile || !m_backend)
+        return;
+
+    qCDebug(lcGeoclueHybris) << "Switching to positioning profile" << profile;
+
+    m_profile = profile;
+
+    // The chip keeps its gps.conf configuration until a profile is first selected.
+    if (m_configurationSupported) {
+        const PositioningProfile &settings = Profiles[profile];
+        m_backend->gnssConfigurationSetSuplMode(settings.suplMode);
+        m_backend->gnssConfigurationSetLppProfile(settings.lppProfile);
+        m_backend->gnssConfigurationSetGlonassPositioningProtocol(settings.glonassPositioningProtocol);
+        if (!hasCapability(HYBRIS_GNSS_CAPABILITY_SATELLITE_BLACKLIST) ||
+                !m_backend->gnssConfigurationSetBlacklist(settings.blacklist)) {
+            qCDebug(lcGeoclueHybris) << "Constellation blacklist not supported";
+        }
+    }
+
+    if (m_gpsStarted)
+        updatePositionMode();
+}
+
+/*
+    Moves tracking between the regular GNSS session and hardware batching. Batching is only
+    used while every client has asked for it, the others need each fix as it arrives.
+*/
+void HybrisProvider::updateBatching()
+{
+    if (!m_backend || m_batchSize <= 0)
+        return;
+
+    bool batching = m_gpsStarted;
+    foreach (const ServiceData &data, m_watchedServices)
+        batching = batching && data.batching;
+
+    const quint32 interval = minimumRequestedUpdateInterval(true);
+
+    if (batching == m_batching && (!batching || interval == m_batchingInterval))
+        return;
+
+    const bool wasBatching = m_batching;
+    if (m_batching) {
+        m_backend->gnssBatchingFlush();
+        m_backend->gnssBatchingStop();
+        m_batching = false;
+    }
+
+    if (batching) {
+        qCDebug(lcGeoclueHybris) << "Batching fixes every" << interval << "ms, up to"
+                                 << m_batchSize << "fixes per batch";
+
+        // Wake up when the FIFO is full rather than overwriting the oldest fixes.
+        if (m_backend->gnssBatchingStart(qint64(interval) * 1000000, true)) {
+            if (!wasBatching)
+                m_backend->gnssStop();
+            m_batching = true;
+            m_batchingInterval = interval;
+            m_fixLostTimer.stop();
+            return;
+        }
+
+        qWarning("Failed to start GNSS batching");
+    }
+
+    if (wasBatching && m_gpsStarted) {
+        qCDebug(lcGeoclueHybris) << "Resuming regular positioning";
+        m_backend->gnssStart();
+        m_fixLostTimer.start(fixTimeout(), this);
+    }
+}
+
+/*
+    Runs the HAL measurement stream while positioning is on and someone is subscribed.
+*/
+void HybrisProvider::updateMeasurements()
+{
+    if (!m_backend)
+        return;
+
+    const bool measurements = m_gpsStarted && hasCapability(HYBRIS_GNSS_CAPABILITY_MEASUREMENTS) &&
+            m_gnssMeasurements.hasSubscribers();
+    if (measurements == m_measurementsStarted)
+        return;
+
+    if (measurements) {
+        qCDebug(lcGeoclueHybris) << "Starting GNSS measurements";
+        m_measurementsStarted = m_backend->gnssMeasurementStart();
+        if (!m_measurementsStarted)
+            qWarning("Failed to start GNSS measurements");
+    } else {
+        qCDebug(lcGeoclueHybris) << "Stopping GNSS measurements";
+        m_backend->gnssMeasurementStop();
+        m_measurementsStarted = false;
+    }
+}
+
+void HybrisProvider::removeGeofences(const QString &service)
+{
+    QMap<int, Geofence>::iterator it = m_geofences.begin();
+    while (it != m_geofences.end()) {
+        if (it->service != service) {
+            ++it;
+            continue;
+        }
+        m_backend->gnssGeofenceRemove(it.key());
+        it = m_geofences.erase(it);
+    }
+}
+
+// Geofence owners stay watched until their geofences are gone.
+void HybrisProvider::unwatchServiceIfUnused(const QString &service)
+{
+    if (m_watchedServices.contains(service))
+        return;
+
+    foreach (const Geofence &geofence, m_geofences) {
+        if (geofence.service == service)
+            return;
+    }
+
+    foreach (const PositionRequest &request, m_positionRequests) {
+        if (request.pendingReply.service() == service)
+            return;
+    }
+
+    m_watcher->removeWatchedService(service);
+}
+
+void HybrisProvider::startIdleTimerIfNeeded()
+{
+    // Geofences are monitored without any active references.
+    if (m_watchedServices.isEmpty() && m_geofences.isEmpty() && m_positionRequests.isEmpty()) {
+        qCDebug(lcGeoclueHybris) << "no watched services, starting idle timer.";
+        m_idleTimer.start(QuitIdleTime, this);
+    }
+}
+
+bool HybrisProvider::isPositionAccurate(const Location &location, double maximumAccuracy) const
+{
+    const double accuracy = location.accuracy().horizontal();
+    return !qIsNaN(location.latitude()) && !qIsNaN(location.longitude()) &&
+            !qIsNaN(accuracy) && accuracy <= maximumAccuracy;
+}
+
+void HybrisProvider::answerPositionRequests()
+{
+    QList<PositionRequest>::iterator it = m_positionRequests.begin();
+    while (it != m_positionRequests.end()) {
+        if (!isPositionAccurate(m_currentLocation, it->maximumAccuracy)) {
+            ++it;
+            continue;
+        }
+        const QString service = it->pendingReply.service();
+        QDBusConnection::sessionBus().send(
+            it->pendingReply.createReply(QVariant::fromValue(m_currentLocation)));
+        it = m_positionRequests.erase(it);
+        unwatchServiceIfUnused(service);
+    }
+
+    if (!m_positionRequests.isEmpty())
+        return;
+
+    m_positionRequestTimer.stop();
+    startIdleTimerIfNeeded();
+    stopPositioningIfNeeded();
+}
+
+void HybrisProvider::failPositionRequests(QDBusError::ErrorType error, const QString &message)
+{
+    const QList<PositionRequest> requests = m_positionRequests;
+    m_positionRequests.clear();
+    m_positionRequestTimer.stop();
+
+    foreach (const PositionRequest &request, requests) {
+        QDBusConnection::sessionBus().send(request.pendingReply.createErrorReply(error, message));
+        unwatchServiceIfUnused(request.pendingReply.service());
+    }
+
+    startIdleTimerIfNeeded();
+}
+
+// Fires when the oldest pending request times out.
+void HybrisProvider::startPositionRequestTimer()
+{
+    qint64 remaining = -1;
+    foreach (const PositionRequest &request, m_positionRequests) {
+        const qint64 left = qMax(Q_INT64_C(0), request.timeout - request.elapsed.elapsed());
+        if (remaining < 0 || left < remaining)
+            remaining = left;
+    }
+
+    if (remaining < 0)
+        m_positionRequestTimer.stop();
+    else
+        m_positionRequestTimer.start(int(remaining), this);
+}
+
+void HybrisProvider::saveNavigationCache()
+{
+    if (!m_navigationCache.isDirty())
+        return;
+
+    if (!m_navigationCache.save(m_navigationCacheFile))
+        qWarning("Failed to save navigation data cache to %s", qPrintable(m_navigationCacheFile));
+}
+
+void HybrisProvider::requestOnlineAiding()
+{
+    m_onlineAidingPending = false;
+
+    if (m_networkManager->globalState() != NetworkManager::OnlineState)
+        return;
+
+    if (m_useForcedXtraInject)
+        gnssXtraDownloadRequest();
+    if (m_useForcedNtpInject)
+        injectUtcTime();
+}
+
+bool HybrisProvider::hasRecentDebugData() const
+{
+    return m_debugDataTimer.isValid() && !m_debugDataTimer.hasExpired(DebugDataMaximumAge);
+}
+
+/*
+    Returns false if enough satellites have a current broadcast ephemeris or server prediction,
+    otherwise returns true. A recent chip state decides, without one the broadcast ephemerides
+    cached from the navigation messages stand in for what the chip decoded.
+*/
+bool HybrisProvider::needsXtraData() const
+{
+    if (!hasRecentDebugData()) {
+        const int cached = m_navigationCache.validEphemerisCount(QDateTime::currentMSecsSinceEpoch());
+        return cached < MinimumValidEphemerides;
+    }
+
+    int current = 0;
+    foreach (const HybrisGnssDebugSatellite &satellite, m_debugData.satellites) {
+        const bool ephemeris = satellite.ephemerisType == HYBRIS_GNSS_EPHEMERIS_TYPE_EPHEMERIS &&
+                satellite.ephemerisHealth != HYBRIS_GNSS_EPHEMERIS_HEALTH_BAD &&
+                satellite.ephemerisAgeSeconds < MaximumEphemerisAge;
+        const bool prediction = satellite.serverPredictionAvailable &&
+                satellite.serverPredictionAgeSeconds < MaximumServerPredictionAge;
+        if (ephemeris || prediction)
+            ++current;
+    }
+
+    return current < MinimumValidEphemerides;
+}
+
+/*
+    Returns false if the last chip state has a time estimate at least as good as NTP can
+    provide, otherwise returns true.
+*/
+bool HybrisProvider::chipNeedsTime() const
+{
+    if (!hasRecentDebugData() || m_debugData.timeEstimateMs <= 0)
+        return true;
+
+    return m_debugData.timeUncertaintyNs <= 0 ||
+            m_debugData.timeUncertaintyNs > MaximumTimeUncertaintyNs;
+}
+
+void HybrisProvider::closeMeasurements(const QString &service)
+{
+    QMap<QString, ServiceData>::iterator it = m_watchedServices.find(service);
+    if (it == m_watchedServices.end() || it->measurementEventFd == -1)
+        return;
+
+    m_gnssMeasurements.removeSubscriber(it->measurementEventFd);
+    it->measurementEventFd = -1;
 
-    return qMax(updateInterval, MinimumInterval);
+    updateMeasurements();
 }
 
 void HybrisProvider::startDataConnection()
@@ -17,8 +17,13 @@
 #include <QtCore/QObject>
 #include <QtCore/QStringList>
 #include <QtCore/QBasicTimer>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QQueue>
+#include <QtCore/QVector>
 #include <QtDBus/QDBusContext>
+#include <QtDBus/QDBusError>
+#include <QtDBus/QDBusMessage>
+#include <QtDBus/QDBusUnixFileDescriptor>
 #include <QtNetwork/QNetworkReply>
 
 #include "hybrislocationbackend.h"
@@ -27,6 +32,11 @@
 #include <locationsettings.h>
 
 #include "locationtypes.h"
+#include "gnsseventqueue.h"
+#include "gnssmeasurementchannel.h"
+#include "gnssnavigationcache.h"
+#include "gnsswakelock.h"
+#include "gnsswatchdog.h"
 
 Q_DECLARE_LOGGING_CATEGORY(lcGeoclueHybris)
 Q_DECLARE_LOGGING_CATEGORY(lcGeoclueHybrisNmea)
@@ -38,6 +48,7 @@ QT_FORWARD_DECLARE_CLASS(QNetworkAccessManager)
 QT_FORWARD_DECLARE_CLASS(QHostAddress)
 QT_FORWARD_DECLARE_CLASS(QUdpSocket)
 QT_FORWARD_DECLARE_CLASS(QHostInfo)
+QT_FORWARD_DECLARE_CLASS(QSocketNotifier)
 
 class ComJollaConnectiondInterface;
 class ComJollaLipstickConnectionSelectorIfInterface;
@@ -47,6 +58,9 @@ class NetworkTechnology;
 class QOfonoExtModemManager;
 class QOfonoConnectionManager;
 class QOfonoConnectionContext;
+class QOfonoNetworkRegistration;
+class QOfonoSimManager;
+class GnssInitThread;
 
 class HybrisProvider : public QObject, public QDBusContext
 {
@@ -59,6 +73,10 @@ public:
 
     void setLocationSettings(LocationSettings *settings);
 
+    GnssEventQueue *gnssEvents() { return &m_gnssEvents; }
+    GnssMeasurementChannel *gnssMeasurements() { return &m_gnssMeasurements; }
+    GnssWakelock *gnssWakelock() { return &m_gnssWakelock; }
+
     // org.freedesktop.Geoclue
     void AddReference();
     void RemoveReference();
@@ -101,6 +119,15 @@ public:
     };
     Q_DECLARE_FLAGS(VelocityFields, VelocityField)
 
+    // Ordered by demand, the most demanding profile of all clients is used. Clients which
+    // did not select a profile get the default, which outranks the power saving profiles.
+    enum Profile {
+        ProfileBackground,
+        ProfileFitness,
+        ProfileDefault,
+        ProfileNavigation
+    };
+
     // org.freedesktop.Geoclue.Velocity
     int GetVelocity(int &timestamp, double &speed, double &direction, double &climb);
 
@@ -108,6 +135,18 @@ public:
     int GetLastSatellite(int &satelliteUsed, int &satelliteVisible, QList<int> &usedPrn, QList<SatelliteInfo> &satInfo);
     int GetSatellite(int &satelliteUsed, int &satelliteVisible, QList<int> &usedPrn, QList<SatelliteInfo> &satInfo);
 
+    // org.freedesktop.Geoclue.Providers.Hybris
+    QDBusUnixFileDescriptor OpenMeasurements(QDBusUnixFileDescriptor &notifier);
+    void CloseMeasurements();
+    QList<EphemerisInfo> GetEphemerisAges();
+    QVariantMap GetDiagnostics();
+    Location GetPositionOnce(double maximumAccuracy, int maximumAge, int timeout);
+    int AddGeofence(double latitude, double longitude, double radius, int monitorTransitions,
+                    uint responsiveness);
+    void RemoveGeofence(int id);
+    void PauseGeofence(int id);
+    void ResumeGeofence(int id, int monitorTransitions);
+
 signals:
     // org.freedesktop.Geoclue
     void StatusChanged(int status);
@@ -121,10 +160,17 @@ signals:
     // org.freedesktop.Geoclue.Satellite
     void SatelliteChanged(int timestamp, int satelliteUsed, int satelliteVisible, const QList<int> &usedPrn, const QList<SatelliteInfo> &satInfos);
 
+    // org.freedesktop.Geoclue.Providers.Hybris
+    void LocationsBatched(const QList<Location> &locations);
+    void GeofenceAvailabilityChanged(bool available);
+
 protected:
     void timerEvent(QTimerEvent *event);
 
 private slots:
+    void gnssInitFinished();
+    void gnssBackendWedged();
+    void initExtensions();
     void setLocation(const Location &location);
     void setSatellite(const QList<SatelliteInfo> &satellites, const QList<int> &used);
     void serviceUnregistered(const QString &service);
@@ -142,33 +188,80 @@ private slots:
     void dataServiceConnected();
     void connectionErrorReported(const QString &path, const QString &error);
     void connectionSelected(bool selected);
+    void agpsRilRequestSetId(quint32 flags);
+    void agpsRilRequestRefLocation();
 
     void setMagneticVariation(double variation);
 
     void engineOn();
     void engineOff();
 
+    void gnssCommandFinished(int command, bool success, int data);
+    void gnssCapabilities(quint32 capabilities, bool gnss20Callback);
+    void gnssRecovered(int recoveryTime);
+    void processGnssEvents();
+    void gnssReleaseWakelock(quint32 generation);
+    void gnssLocationBatch(const QVector<GnssFix> &fixes);
+    void gnssNavigationMessage(int type, int svid, int status, const QByteArray &data);
+    void gnssDebugData(const HybrisGnssDebugData &data);
+    void gnssGeofenceTransition(int geofenceId, const GnssFix &fix, int transition, qint64 timestamp);
+    void gnssGeofenceStatus(int availability);
+    void gnssGeofenceOperationFinished(int operation, int geofenceId, int status);
+
     void technologiesChanged();
     void stateChanged(NetworkManager::State state);
     void defaultDataModemChanged(const QString &modem);
     void connectionManagerValidChanged();
     void connectionContextValidChanged();
     void cellularConnected(bool connected);
+    void updateNetworkState();
+    void networkRegistrationChanged();
+    void simManagerChanged();
 
 private:
     void loadDefaultsFromConfigurationFile();
+    void startGnssInit();
 
     void emitLocationChanged();
     void emitSatelliteChanged();
+    bool isBroadcastUpdate() const;
+    bool isUpdateDue(quint32 updateInterval, qint64 lastTimestamp, qint64 timestamp) const;
+    void sendTargetedSignal(const QString &service, const QDBusMessage &signal);
     void startPositioningIfNeeded();
     void stopPositioningIfNeeded();
+    void stopPositioning();
+    void processFix(const GnssFix &fix);
+    void processSatelliteEpoch(const GnssSatelliteEpoch &epoch);
     void setStatus(Status status);
     bool positioningEnabled();
-    quint32 minimumRequestedUpdateInterval() const;
+    bool hasCapability(quint32 capability) const;
+    quint32 minimumRequestedUpdateInterval(bool adaptive) const;
+    bool updatePositionMode();
+    void updateProfile();
+    void updateBatching();
+    void updateMeasurements();
+    void closeMeasurements(const QString &service);
+    void saveNavigationCache();
+    void requestOnlineAiding();
+    bool hasRecentDebugData() const;
+    bool needsXtraData() const;
+    bool chipNeedsTime() const;
+    void removeGeofences(const QString &service);
+    void unwatchServiceIfUnused(const QString &service);
+    void startIdleTimerIfNeeded();
+    bool isPositionAccurate(const Location &location, double maximumAccuracy) const;
+    void answerPositionRequests();
+    void failPositionRequests(QDBusError::ErrorType error, const QString &message);
+    void startPositionRequestTimer();
 
     void startDataConnection();
     void stopDataConnection();
 
+    bool servingCell(HybrisAGnssRefLocation *location) const;
+    void updateAGnssRilRefLocation(bool requested);
+    void updateAGnssRilSetId(bool requested);
+    void sendNetworkState(bool force);
+
     void sendNtpRequest();
 
     void processConnectionContexts();
@@ -176,6 +269,36 @@ private:
 
     HybrisLocationBackend *m_backend;
 
+    GnssEventQueue m_gnssEvents;
+    QSocketNotifier *m_gnssEventNotifier;
+    quint64 m_droppedFixes;
+    quint64 m_droppedSatelliteEpochs;
+
+    GnssWakelock m_gnssWakelock;
+    GnssWatchdog m_gnssWatchdog;
+    QBasicTimer m_systemdWatchdogTimer;
+
+    GnssMeasurementChannel m_gnssMeasurements;
+    bool m_measurementsStarted;
+
+    GnssNavigationCache m_navigationCache;
+    QString m_navigationCacheFile;
+    bool m_navigationMessagesStarted;
+    bool m_navigationMessagesFailed;
+
+    QBasicTimer m_debugTimer;
+    HybrisGnssDebugData m_debugData;
+    QElapsedTimer m_debugDataTimer;
+    bool m_onlineAidingPending;
+    qint64 m_fixLatency;
+    GnssInitThread *m_gnssInitThread;
+    QBasicTimer m_gnssInitTimer;
+    bool m_extensionsInitialised;
+    bool m_deleteAidingDataPending;
+
+    int m_halRecoveryCount;
+    int m_lastHalRecoveryTime;
+
     Location m_currentLocation;
 
     qint64 m_satelliteTimestamp;
@@ -189,14 +312,62 @@ private:
     QDBusServiceWatcher *m_watcher;
     struct ServiceData {
         ServiceData()
-        :   referenceCount(0), updateInterval(0)
+        :   referenceCount(0), updateInterval(0), profile(ProfileDefault), batching(false),
+            measurementEventFd(-1), lastPositionTimestamp(0), lastSatelliteTimestamp(0),
+            minimumDistance(0), maximumInterval(0)
         {
         }
 
         int referenceCount;
         quint32 updateInterval;
+        Profile profile;
+        bool batching;
+        int measurementEventFd;
+        // Timestamps of the last fix and satellite epoch sent to the service.
+        qint64 lastPositionTimestamp;
+        qint64 lastSatelliteTimestamp;
+        // Adaptive interval bounds, enabled by a minimum distance in meters.
+        double minimumDistance;
+        quint32 maximumInterval;
     };
     QMap<QString, ServiceData> m_watchedServices;
+    quint32 adaptiveUpdateInterval(const ServiceData &data) const;
+    void accountAdaptiveInterval(quint32 baseInterval, quint32 interval);
+    int fixTimeout() const;
+
+    struct Geofence {
+        Geofence()
+        :   monitorTransitions(0), paused(false), queued(false), latitude(0), longitude(0),
+            radius(0), responsiveness(0)
+        {
+        }
+
+        QString service;
+        int monitorTransitions;
+        bool paused;
+        QDBusMessage pendingReply;
+
+        // Added while the GNSS HAL was initialising, replayed once it is ready.
+        bool queued;
+        double latitude;
+        double longitude;
+        double radius;
+        uint responsiveness;
+    };
+    QMap<int, Geofence> m_geofences;
+    int m_nextGeofenceId;
+
+    // GetPositionOnce() calls waiting for a fix.
+    struct PositionRequest {
+        QDBusMessage pendingReply;
+        double maximumAccuracy;
+        int timeout;
+        QElapsedTimer elapsed;
+    };
+    QList<PositionRequest> m_positionRequests;
+    QBasicTimer m_positionRequestTimer;
+    bool m_geofencingSupported;
+    bool m_geofencingAvailable;
 
     QBasicTimer m_idleTimer;
     QBasicTimer m_fixLostTimer;
@@ -219,6 +390,48 @@ private:
     bool m_requestedConnect;
 
     bool m_gpsStarted;
+    // A client held a reference during the running session.
+    bool m_sessionReferenced;
+
+    // The session keeps running this long after the last client is gone.
+    int m_stopLinger;
+    QBasicTimer m_stopLingerTimer;
+
+    // Position mode last sent while the session is running.
+    bool m_positionModeSet;
+    HybrisGnssPositionMode m_positionMode;
+    HybrisGnssPositionRecurrence m_positionModeRecurrence;
+    quint32 m_positionModeInterval;
+    bool m_positionModeLowPower;
+    quint32 m_positionModeAccuracy;
+
+    quint32 m_sessionStarts;
+    quint32 m_sessionStops;
+    quint32 m_sessionResumes;
+    quint32 m_positionModeChanges;
+    quint32 m_positionModeSkips;
+
+    // Receiver on-time saved by adaptive intervals, see accountAdaptiveInterval().
+    QElapsedTimer m_adaptiveClock;
+    quint32 m_adaptiveBaseInterval;
+    quint32 m_adaptiveInterval;
+    qint64 m_adaptiveTime;
+    qint64 m_adaptiveSavedTime;
+
+    // Until the chip reports its capabilities everything is assumed to be supported, as are
+    // the bits its capabilities callback cannot report.
+    quint32 m_capabilities;
+    quint32 m_reportedCapabilities;
+    bool m_capabilitiesKnown;
+    quint32 m_softwareFixInterval;
+    qint64 m_lastFixTimestamp;
+
+    bool m_configurationSupported;
+    Profile m_profile;
+
+    int m_batchSize;
+    bool m_batching;
+    quint32 m_batchingInterval;
 
     LocationSettings *m_locationSettings;
 
@@ -229,6 +442,23 @@ private:
     QOfonoExtModemManager *m_ofonoExtModemManager;
     QOfonoConnectionManager *m_connectionManager;
     QOfonoConnectionContext *m_connectionContext;
+    QOfonoNetworkRegistration *m_networkRegistration;
+    QOfonoSimManager *m_simManager;
+
+    // What the HAL asked for through the AGNSS RIL interface and what it was last sent.
+    bool m_agpsRilRefLocationRequested;
+    quint32 m_agpsRilSetIdFlags;
+    HybrisAGnssRefLocation m_agpsRilRefLocation;
+    HybrisAGnssSetIDType m_agpsRilSetIdType;
+    QByteArray m_agpsRilSetId;
+
+    // Data connectivity last reported to the HAL.
+    bool m_networkConnected;
+    HybrisNetworkType m_networkType;
+    bool m_networkRoaming;
+    bool m_networkAvailable;
+    QByteArray m_networkApn;
+    QByteArray m_cellularApn;
 
     QUdpSocket *m_ntpSocket;
     QBasicTimer m_ntpRetryTimer;
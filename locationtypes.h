@@ -100,46 +100,66 @@ private:
     QSharedDataPointer<LocationData> d;
 };
 
-class SatelliteInfoData : public QSharedData
+// Plain value type, satellite lists are rebuilt for every epoch.
+class SatelliteInfo
 {
 public:
-    SatelliteInfoData()
-        : prn(0), elevation(0), azimuth(0), snr(0)
-    { }
-    SatelliteInfoData(const SatelliteInfoData &other)
-        : QSharedData(other), prn(other.prn), elevation(other.elevation), azimuth(other.azimuth),
-          snr(other.snr)
-    { }
-    ~SatelliteInfoData() { }
+    SatelliteInfo() : m_prn(0), m_elevation(0), m_azimuth(0), m_snr(0) { }
+
+    inline int prn() const { return m_prn; }
+    inline void setPrn(int prn) { m_prn = prn; }
+    inline int elevation() const { return m_elevation; }
+    inline void setElevation(int elevation) { m_elevation = elevation; }
+    inline int azimuth() const { return m_azimuth; }
+    inline void setAzimuth(int azimuth) { m_azimuth = azimuth; }
+    inline int snr() const { return m_snr; }
+    inline void setSnr(int snr) { m_snr = snr; }
 
-    int prn;        // Item 0
-    int elevation;  // Item 1
-    int azimuth;    // Item 2
-    int snr;        // Item 3
+private:
+    int m_prn;        // Item 0
+    int m_elevation;  // Item 1
+    int m_azimuth;    // Item 2
+    int m_snr;        // Item 3
 };
 
-class SatelliteInfo
+Q_DECLARE_TYPEINFO(SatelliteInfo, Q_PRIMITIVE_TYPE);
+
+// Age in seconds of the navigation data of one satellite, NoData when not received.
+class EphemerisInfo
 {
 public:
-    SatelliteInfo() : d(new SatelliteInfoData) { }
-    SatelliteInfo(const SatelliteInfo &other) : d(other.d) { }
-
-    inline int prn() const { return d->prn; }
-    inline void setPrn(int prn) { d->prn = prn; }
-    inline int elevation() const { return d->elevation; }
-    inline void setElevation(int elevation) { d->elevation = elevation; }
-    inline int azimuth() const { return d->azimuth; }
-    inline void setAzimuth(int azimuth) { d->azimuth = azimuth; }
-    inline int snr() const { return d->snr; }
-    inline void setSnr(int snr) { d->snr = snr; }
+    enum { NoData = 0x7fffffff };
+
+    EphemerisInfo()
+        : m_constellation(0), m_svid(0), m_ephemerisAge(NoData), m_almanacAge(NoData) { }
+
+    inline int constellation() const { return m_constellation; }
+    inline void setConstellation(int constellation) { m_constellation = constellation; }
+
+    inline int svid() const { return m_svid; }
+    inline void setSvid(int svid) { m_svid = svid; }
+
+    inline int ephemerisAge() const { return m_ephemerisAge; }
+    inline void setEphemerisAge(int age) { m_ephemerisAge = age; }
+
+    inline int almanacAge() const { return m_almanacAge; }
+    inline void setAlmanacAge(int age) { m_almanacAge = age; }
 
 private:
-    QSharedDataPointer<SatelliteInfoData> d;
+    int m_constellation;
+    int m_svid;
+    int m_ephemerisAge;
+    int m_almanacAge;
 };
 
+Q_DECLARE_TYPEINFO(EphemerisInfo, Q_PRIMITIVE_TYPE);
+
 Q_DECLARE_METATYPE(Accuracy)
 Q_DECLARE_METATYPE(Location)
+Q_DECLARE_METATYPE(QList<Location>)
 Q_DECLARE_METATYPE(SatelliteInfo)
 Q_DECLARE_METATYPE(QList<SatelliteInfo>)
+Q_DECLARE_METATYPE(EphemerisInfo)
+Q_DECLARE_METATYPE(QList<EphemerisInfo>)
 
 #endif // LOCATIONTYPES_H
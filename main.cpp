@@ -11,6 +11,7 @@
 */
 
 #include <QtCore/QCoreApplication>
+#include <QtCore/QElapsedTimer>
 #include <QtCore/QLoggingCategory>
 #include <QtDBus/QDBusConnection>
 
@@ -26,6 +27,9 @@ int main(int argc, char *argv[])
                                                     "geoclue.provider.hybris.position.debug=false"));
     QCoreApplication a(argc, argv);
 
+    QElapsedTimer startupTimer;
+    startupTimer.start();
+
     QDBusConnection session = QDBusConnection::sessionBus();
     LocationSettings settings;
     HybrisProvider provider;
@@ -35,5 +39,7 @@ int main(int argc, char *argv[])
     if (!session.registerService(QStringLiteral("org.freedesktop.Geoclue.Providers.Hybris")))
         qFatal("Failed to register service org.freedesktop.Geoclue.Providers.Hybris");
 
+    qCDebug(lcGeoclueHybris) << "D-Bus service registered in" << startupTimer.elapsed() << "ms";
+
     return a.exec();
 }
@@ -9,8 +9,8 @@ Obsoletes: geoclue-provider-hybris < %{version}-%{release}
 # libgbinder is currently not a common package, so we have to rely on tar_git.
 BuildRequires: pkgconfig(libgbinder)
 
-# hardcoded build command, can be autodetected
-%define qmake_command %qmake5 binder/binderlocationbackend.pro
+# Backends whose build dependencies are present are built as plugins
+%define qmake_command %qmake5 geoclue-providers-hybris.pro
 
 %include rpm/geoclue-providers-hybris.inc
 
@@ -9,8 +9,8 @@ Obsoletes: geoclue-provider-hybris < %{version}-%{release}
 BuildRequires: pkgconfig(libhardware)
 BuildRequires: pkgconfig(android-headers)
 
-# hardcoded build command, can be autodetected
-%define qmake_command %qmake5 hal/hallocationbackend.pro
+# Backends whose build dependencies are present are built as plugins
+%define qmake_command %qmake5 geoclue-providers-hybris.pro
 
 # Add suid bit to executable
 %define with_suid 1